@@ -182,7 +182,7 @@ void alexaSetup() {
     // Register main callbacks
     StatusBroker::Register(_alexaBrokerCallback);
     espurnaRegisterReload(_alexaConfigure);
-    espurnaRegisterLoop(alexaLoop);
+    espurnaRegisterLoop(alexaLoop, PSTR("alexa"));
 
 }
 
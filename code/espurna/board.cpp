@@ -81,6 +81,9 @@ PROGMEM const char espurna_modules[] =
     #if NTP_SUPPORT
         "NTP "
     #endif
+    #if PROFILER_SUPPORT
+        "PROFILER "
+    #endif
     #if RFM69_SUPPORT
         "RFM69 "
     #endif
@@ -12,6 +12,11 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include <utility>
 #include <vector>
 #include <tuple>
+#include <type_traits>
+
+#if PROFILER_SUPPORT
+#include "profiler.h"
+#endif
 
 // Example usage:
 //
@@ -43,23 +48,240 @@ struct TBroker<R(Args...)> {
 
     TBroker() = default;
 
-    // TODO: https://source.chromium.org/chromium/chromium/src/+/master:base/callback_list.h
-    // Consider giving out 'subscription' / 'token', so that the caller can remove callback later
+    // Name is only used to identify the broker in the profiler output
+    explicit TBroker(const char* name) :
+        name(name)
+    {}
+
+    // Note: see TStaticBroker below when callbacks need to be removed later
 
     void Register(TCallback callback) {
         callbacks.push_back(callback);
+        #if PROFILER_SUPPORT
+            stats.push_back(profiler::add(name, nullptr, nullptr, callbacks.size() - 1));
+        #endif
     }
 
     void Publish(Args... args) {
-        for (auto& callback : callbacks) {
-            callback(args...);
-        }
+        #if PROFILER_SUPPORT
+            for (size_t index = 0; index < callbacks.size(); ++index) {
+                profiler::Measure measure(stats[index]);
+                callbacks[index](args...);
+            }
+        #else
+            for (auto& callback : callbacks) {
+                callback(args...);
+            }
+        #endif
     }
 
     protected:
 
+    const char* name { "broker" };
     TCallbacks callbacks;
 
+    #if PROFILER_SUPPORT
+        std::vector<profiler::stats_t*> stats;
+    #endif
+
+};
+
+// Broker with a fixed number of subscribers, without any heap allocations.
+// Subscribers are either plain functions or functions receiving an opaque `context` pointer.
+// Registration returns a token, which can be used to remove the subscriber later
+// (see https://source.chromium.org/chromium/chromium/src/+/master:base/callback_list.h)
+//
+// Since nothing is copied when publishing, only trivially copyable arguments are allowed.
+// Notice that arguments like `const char*` are expected to outlive the Publish() call,
+// which is not guaranteed for the deferred broker below.
+
+using broker_token_t = unsigned char;
+constexpr broker_token_t BrokerTokenNone = 0xff;
+
+template <size_t Capacity, typename Func>
+struct TStaticBroker {};
+
+template <size_t Capacity, typename ...Args>
+struct TStaticBroker<Capacity, void(Args...)> {
+
+    static_assert(Capacity < BrokerTokenNone, "Capacity must fit into the broker_token_t");
+
+    using TArgs = typename std::tuple<Args...>;
+    using TCallback = void(*)(Args...);
+    using TContextCallback = void(*)(void*, Args...);
+
+    TStaticBroker(const TStaticBroker&) = delete;
+    TStaticBroker& operator=(const TStaticBroker&) = delete;
+
+    TStaticBroker() = default;
+
+    explicit TStaticBroker(const char* name) :
+        name(name)
+    {}
+
+    broker_token_t Register(TCallback callback) {
+        return _register(callback, nullptr, nullptr);
+    }
+
+    broker_token_t Register(TContextCallback callback, void* context) {
+        return _register(nullptr, callback, context);
+    }
+
+    // Safe to call from the subscriber itself, including while publishing
+    void Unregister(broker_token_t token) {
+        if (token < Capacity) {
+            handlers[token] = handler_t{};
+        }
+    }
+
+    size_t Count() const {
+        size_t result = 0;
+        for (const auto& handler : handlers) {
+            if (handler.callback || handler.context_callback) {
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    void Publish(Args... args) {
+        for (size_t index = 0; index < Capacity; ++index) {
+            const auto handler = handlers[index];
+            if (!handler.callback && !handler.context_callback) continue;
+            #if PROFILER_SUPPORT
+                profiler::Measure measure(handler.stats);
+            #endif
+            if (handler.callback) {
+                handler.callback(args...);
+            } else if (handler.context_callback) {
+                handler.context_callback(handler.context, args...);
+            }
+        }
+    }
+
+    protected:
+
+    struct handler_t {
+        TCallback callback { nullptr };
+        TContextCallback context_callback { nullptr };
+        void* context { nullptr };
+        #if PROFILER_SUPPORT
+            profiler::stats_t* stats { nullptr };
+        #endif
+    };
+
+    broker_token_t _register(TCallback callback, TContextCallback context_callback, void* context) {
+        for (size_t index = 0; index < Capacity; ++index) {
+            auto& handler = handlers[index];
+            if (handler.callback || handler.context_callback) continue;
+
+            handler.callback = callback;
+            handler.context_callback = context_callback;
+            handler.context = context;
+            #if PROFILER_SUPPORT
+                // Stats are kept around after the subscriber is removed, reuse them for the same slot
+                if (!stats[index]) {
+                    stats[index] = profiler::add(name, nullptr, nullptr, index);
+                }
+                handler.stats = stats[index];
+            #endif
+
+            return index;
+        }
+
+        return BrokerTokenNone;
+    }
+
+    const char* name { "broker" };
+    handler_t handlers[Capacity];
+
+    #if PROFILER_SUPPORT
+        profiler::stats_t* stats[Capacity] {};
+    #endif
+
+};
+
+// Same as the TStaticBroker, but Publish() only stores the arguments in the ring buffer.
+// Subscribers are called later, when the Dispatch() is called from the main loop. This way,
+// publisher is not blocked by any slow subscriber and it also does not need to know about them.
+// When the buffer is full, the oldest event is delivered right away to make room for the new one,
+// so nothing is lost when there are more events per loop() than the queue can hold.
+
+namespace broker {
+namespace internal {
+
+template <size_t...>
+struct indexes {};
+
+template <size_t Size, size_t ...Indexes>
+struct make_indexes : make_indexes<Size - 1, Size - 1, Indexes...> {};
+
+template <size_t ...Indexes>
+struct make_indexes<0, Indexes...> {
+    using type = indexes<Indexes...>;
+};
+
+} // namespace internal
+} // namespace broker
+
+template <size_t Capacity, size_t QueueSize, typename Func>
+struct TDeferredBroker {};
+
+template <size_t Capacity, size_t QueueSize, typename ...Args>
+struct TDeferredBroker<Capacity, QueueSize, void(Args...)> : public TStaticBroker<Capacity, void(Args...)> {
+
+    using TBase = TStaticBroker<Capacity, void(Args...)>;
+    using TEvent = std::tuple<typename std::decay<Args>::type...>;
+
+    static_assert(QueueSize > 0, "QueueSize must be greater than zero");
+
+    using TBase::TBase;
+
+    void Publish(Args... args) {
+        while (_count == QueueSize) {
+            ++_overflow;
+            _dispatchOne();
+        }
+
+        _queue[(_head + _count) % QueueSize] = TEvent(args...);
+        ++_count;
+    }
+
+    // Only process the events that were queued before the call, subscribers are allowed to Publish() again
+    void Dispatch() {
+        for (size_t pending = _count; pending && _count; --pending) {
+            _dispatchOne();
+        }
+    }
+
+    size_t Pending() const {
+        return _count;
+    }
+
+    // Number of events that had to be delivered from the Publish() itself
+    size_t Overflow() const {
+        return _overflow;
+    }
+
+    private:
+
+    void _dispatchOne() {
+        const TEvent event = _queue[_head];
+        _head = (_head + 1) % QueueSize;
+        --_count;
+        _dispatch(event, typename broker::internal::make_indexes<sizeof...(Args)>::type{});
+    }
+
+    template <size_t ...Indexes>
+    void _dispatch(const TEvent& event, broker::internal::indexes<Indexes...>) {
+        TBase::Publish(std::get<Indexes>(event)...);
+    }
+
+    TEvent _queue[QueueSize];
+    size_t _head { 0 };
+    size_t _count { 0 };
+    size_t _overflow { 0 };
+
 };
 
 // TODO: since 1.14.0 we intoduced static syntax for Brokers, ::Register & ::Publish.
@@ -82,8 +304,53 @@ inline void Publish(Args&&... args) { \
 }\
 }
 
+// Static and deferred brokers also return the token from ::Register and provide ::Unregister.
+// Deferred broker events are only delivered when something calls ::Dispatch, usually the module loop.
+
+#define BrokerDeclareStatic(Name, Capacity, Signature) \
+namespace Name { \
+using type = TStaticBroker<Capacity, Signature>; \
+extern type Instance; \
+template<typename S = type::TArgs, typename ...Args> \
+inline broker_token_t Register(Args&&... args) { \
+    return Instance.Register(std::forward<Args>(args)...); \
+}\
+\
+inline void Unregister(broker_token_t token) { \
+    Instance.Unregister(token); \
+}\
+\
+template<typename S = type::TArgs, typename ...Args> \
+inline void Publish(Args&&... args) { \
+    Instance.Publish(std::forward<Args>(args)...); \
+}\
+}
+
+#define BrokerDeclareDeferred(Name, Capacity, QueueSize, Signature) \
+namespace Name { \
+using type = TDeferredBroker<Capacity, QueueSize, Signature>; \
+extern type Instance; \
+template<typename S = type::TArgs, typename ...Args> \
+inline broker_token_t Register(Args&&... args) { \
+    return Instance.Register(std::forward<Args>(args)...); \
+}\
+\
+inline void Unregister(broker_token_t token) { \
+    Instance.Unregister(token); \
+}\
+\
+template<typename S = type::TArgs, typename ...Args> \
+inline void Publish(Args&&... args) { \
+    Instance.Publish(std::forward<Args>(args)...); \
+}\
+\
+inline void Dispatch() { \
+    Instance.Dispatch(); \
+}\
+}
+
 #define BrokerBind(Name) \
 namespace Name { \
-Name::type Instance; \
+Name::type Instance(#Name); \
 }
 
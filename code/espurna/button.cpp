@@ -777,7 +777,7 @@ void buttonSetup() {
     #endif
 
     // Register system callbacks
-    espurnaRegisterLoop(buttonLoop);
+    espurnaRegisterLoop(buttonLoop, PSTR("button"));
     espurnaRegisterReload(_buttonConfigure);
 
 }
@@ -35,6 +35,20 @@
 #define DEBUG_SERIAL_SUPPORT        0           // TODO: compare UART_MQTT_PORT with DEBUG_PORT? (as strings)
 #endif
 
+#if MQTT_OUTBOX_SPIFFS
+#undef SPIFFS_SUPPORT
+#define SPIFFS_SUPPORT              1           // MQTT outbox file is stored in the SPIFFS
+#endif
+
+#if SENSOR_HISTORY_SPIFFS
+#undef SENSOR_HISTORY_SUPPORT
+#define SENSOR_HISTORY_SUPPORT      1           // Files are updated from the RAM history
+#undef SPIFFS_SUPPORT
+#define SPIFFS_SUPPORT              1           // Magnitude history files are stored in the SPIFFS
+#undef NTP_SUPPORT
+#define NTP_SUPPORT                 1           // Records need the timestamp
+#endif
+
 #if ALEXA_SUPPORT
 #undef BROKER_SUPPORT
 #define BROKER_SUPPORT              1               // If Alexa enabled enable BROKER
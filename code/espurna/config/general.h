@@ -228,6 +228,12 @@
 #define EEPROM_ROTATE_DATA      11              // Reserved for the EEPROM_ROTATE library (3 bytes)
 #define EEPROM_DATA_END         14              // End of custom EEPROM data block
 
+#ifndef EEPROM_COMMIT_DELAY
+#define EEPROM_COMMIT_DELAY     1000            // Wait this many ms after the first commit request, so that
+                                                // multiple requests are written to the flash at once
+                                                // Use "eepromDelay" setting to change it at runtime
+#endif
+
 
 #ifndef SAVE_CRASH_ENABLED
 #define SAVE_CRASH_ENABLED          1           // Save stack trace to EEPROM by default
@@ -378,6 +384,20 @@
 #define LOADAVG_INTERVAL        30000           // Interval between calculating load average (in ms)
 #endif
 
+//------------------------------------------------------------------------------
+// Loop profiler
+//------------------------------------------------------------------------------
+
+#ifndef PROFILER_SUPPORT
+#define PROFILER_SUPPORT        0               // Measure CPU cycles spent in every loop callback, task and broker handler
+                                                // Results are available with `loop.stats` terminal command and in the web UI
+#endif
+
+#ifndef PROFILER_MQTT_INTERVAL
+#define PROFILER_MQTT_INTERVAL  0               // Send profiler stats via MQTT every N seconds (0 to disable)
+                                                // Use "profMqtt" setting to change it at runtime
+#endif
+
 //------------------------------------------------------------------------------
 // BUTTON
 //------------------------------------------------------------------------------
@@ -1112,6 +1132,55 @@
 #define MQTT_QUEUE_MAX_SIZE         20              // Size of the MQTT queue when MQTT_USE_JSON is enabled
 #endif
 
+#ifndef MQTT_QUEUE_ARENA_SIZE
+#define MQTT_QUEUE_ARENA_SIZE       1024            // Space for topics and messages of the MQTT queue, queue is flushed when full
+#endif
+
+#ifndef MQTT_PIPELINE_SIZE
+#define MQTT_PIPELINE_SIZE          16              // Messages waiting to be sent by the client, repeated topic only keeps the last message
+                                                    // (12 bytes of RAM per message slot, always allocated)
+#endif
+
+#ifndef MQTT_PIPELINE_BYTES
+#define MQTT_PIPELINE_BYTES         1024            // Maximum size of the messages waiting in the pipeline
+                                                    // (heap, only while messages are waiting, one allocation per queued message)
+#endif
+
+#ifndef MQTT_PIPELINE_RETRY
+#define MQTT_PIPELINE_RETRY         10              // Try again after this many ms when client refuses to send anything
+#endif
+
+#ifndef MQTT_OUTBOX_SUPPORT
+#define MQTT_OUTBOX_SUPPORT         0               // Store messages sent while disconnected and replay them after connecting
+#endif
+
+#ifndef MQTT_OUTBOX_SIZE
+#define MQTT_OUTBOX_SIZE            1024            // RAM used by the outbox, allocated at once when the first message is stored
+                                                    // and kept until the reboot. Each message takes 11 bytes + topic + payload
+#endif
+
+#ifndef MQTT_OUTBOX_REPLAY_RATE
+#define MQTT_OUTBOX_REPLAY_RATE     10              // Replay this many messages per second, "mqttOutboxRate" setting
+#endif
+
+#ifndef MQTT_OUTBOX_TIMESTAMP
+#define MQTT_OUTBOX_TIMESTAMP       0               // Also replay messages as {"value":<message>,"timestamp":<unix time>}, "mqttOutboxTs" setting
+                                                    // (only when the time was known when the message was stored)
+#endif
+
+#ifndef MQTT_OUTBOX_TIMESTAMP_SUFFIX
+#define MQTT_OUTBOX_TIMESTAMP_SUFFIX "/outbox"      // ...to the <topic><suffix>, original topic always gets the unmodified message
+#endif
+
+#ifndef MQTT_OUTBOX_SPIFFS
+#define MQTT_OUTBOX_SPIFFS          0               // Move the oldest messages to the SPIFFS file instead of dropping them
+                                                    // Requires SPIFFS_SUPPORT
+#endif
+
+#ifndef MQTT_OUTBOX_SPIFFS_SIZE
+#define MQTT_OUTBOX_SPIFFS_SIZE     16384           // Maximum size of the SPIFFS outbox file
+#endif
+
 #ifndef MQTT_BUFFER_MAX_SIZE
 #define MQTT_BUFFER_MAX_SIZE        1024            // Size of the MQTT payload buffer for MQTT_MESSAGE_EVENT. Large messages will only be available via MQTT_MESSAGE_RAW_EVENT.
                                                     // Note: When using MQTT_LIBRARY_PUBSUBCLIENT, MQTT_MAX_PACKET_SIZE should not be more than this value.
@@ -1142,6 +1211,7 @@
 #define MQTT_TOPIC_JSON             "data"
 #define MQTT_TOPIC_ACTION           "action"
 #define MQTT_TOPIC_RELAY            "relay"
+#define MQTT_TOPIC_RELAY_MASK       "mask"
 #define MQTT_TOPIC_LED              "led"
 #define MQTT_TOPIC_BUTTON           "button"
 #define MQTT_TOPIC_IP               "ip"
@@ -1171,6 +1241,7 @@
 #define MQTT_TOPIC_UARTIN           "uartin"
 #define MQTT_TOPIC_UARTOUT          "uartout"
 #define MQTT_TOPIC_LOADAVG          "loadavg"
+#define MQTT_TOPIC_PROFILER         "profiler"
 #define MQTT_TOPIC_BOARD            "board"
 #define MQTT_TOPIC_PULSE            "pulse"
 #define MQTT_TOPIC_SPEED            "speed"
@@ -1231,6 +1302,15 @@
 #define BROKER_SUPPORT          1           // The broker is a poor-man's pubsub manager
 #endif
 
+#ifndef BROKER_SENSOR_SUBSCRIBERS
+#define BROKER_SENSOR_SUBSCRIBERS   4       // Maximum number of subscribers of the sensor read & report brokers
+#endif
+
+#ifndef BROKER_SENSOR_QUEUE_SIZE
+#define BROKER_SENSOR_QUEUE_SIZE    16      // Number of sensor reports waiting to be delivered on the next loop()
+                                            // When full, the oldest report is delivered right away
+#endif
+
 // -----------------------------------------------------------------------------
 // SETTINGS
 // -----------------------------------------------------------------------------
@@ -24,6 +24,14 @@
 #define SENSOR_INIT_INTERVAL                10000           // Try to re-init non-ready sensors every 10s
 #endif
 
+#ifndef SENSOR_ASYNC_TIMEOUT
+#define SENSOR_ASYNC_TIMEOUT                2000            // Abort asynchronous reading when it takes longer than this
+#endif
+
+#ifndef SENSOR_CHANGE_HEARTBEAT
+#define SENSOR_CHANGE_HEARTBEAT             300             // Sensors that detect changes by themselves are read at least every 5 minutes
+#endif
+
 #ifndef SENSOR_REPORT_EVERY
 #define SENSOR_REPORT_EVERY                 10              // Report every this many readings
 #endif
@@ -36,6 +44,57 @@
 #define SENSOR_REPORT_MAX_EVERY             60              // Maximum
 #endif
 
+#ifndef SENSOR_FILTER_CAPACITY
+#define SENSOR_FILTER_CAPACITY              16              // Readings stored by every magnitude filter (between SENSOR_REPORT_MIN_EVERY and SENSOR_REPORT_MAX_EVERY)
+                                                            // With larger "snsReport", median uses the last 16 readings and moving average sums groups of them
+#endif
+
+#ifndef SENSOR_FILTER_EWMA_ALPHA
+#define SENSOR_FILTER_EWMA_ALPHA            0.2             // Weight of the new value for the EWMA filter
+#endif
+
+#ifndef SENSOR_FILTER_HAMPEL_WINDOW
+#define SENSOR_FILTER_HAMPEL_WINDOW         7               // Number of values used to detect outliers
+#endif
+
+#ifndef SENSOR_FILTER_HAMPEL_THRESHOLD
+#define SENSOR_FILTER_HAMPEL_THRESHOLD      3.0             // Outlier is this many standard deviations away from the median
+#endif
+
+#ifndef SENSOR_FILTER_KALMAN_PROCESS_NOISE
+#define SENSOR_FILTER_KALMAN_PROCESS_NOISE      0.01        // Expected variance of the real value between the readings
+#endif
+
+#ifndef SENSOR_FILTER_KALMAN_MEASUREMENT_NOISE
+#define SENSOR_FILTER_KALMAN_MEASUREMENT_NOISE  1.0         // Expected variance of the readings
+#endif
+
+#ifndef SENSOR_HISTORY_SUPPORT
+#define SENSOR_HISTORY_SUPPORT              0               // Keep the recent values of every magnitude in RAM
+#endif
+
+#ifndef SENSOR_HISTORY_INTERVAL
+#define SENSOR_HISTORY_INTERVAL             60              // Store magnitude value every 60 seconds
+#endif
+
+#ifndef SENSOR_HISTORY_SIZE
+#define SENSOR_HISTORY_SIZE                 128             // RAM used by each magnitude history, in 16bit words
+                                                            // (usually one value per word, 128 words ~ 2 hours)
+#endif
+
+#ifndef SENSOR_HISTORY_SPIFFS
+#define SENSOR_HISTORY_SPIFFS               0               // Also store min / avg / max of the values to the SPIFFS file
+                                                            // Requires SPIFFS_SUPPORT and NTP_SUPPORT
+#endif
+
+#ifndef SENSOR_HISTORY_SPIFFS_INTERVAL
+#define SENSOR_HISTORY_SPIFFS_INTERVAL      300             // Every 5 minutes
+#endif
+
+#ifndef SENSOR_HISTORY_SPIFFS_SIZE
+#define SENSOR_HISTORY_SPIFFS_SIZE          288             // Number of records in the file (288 x 5 minutes ~ 24 hours)
+#endif
+
 #ifndef SENSOR_USE_INDEX
 #define SENSOR_USE_INDEX                    0               // Use the index in topic (i.e. temperature/0)
 #endif
@@ -308,6 +367,10 @@
 #define DIGITAL_SUPPORT                 0
 #endif
 
+#ifndef DIGITAL_DEBOUNCE
+#define DIGITAL_DEBOUNCE                50      // GPIO level must stay the same for this many ms to be reported
+#endif
+
 #ifndef DIGITAL1_PIN
 #define DIGITAL1_PIN                     2
 #endif
@@ -929,6 +992,8 @@
 
 #ifndef PMS_USE_SOFT
 #define PMS_USE_SOFT                    0       // If PMS_USE_SOFT == 1, DEBUG_SERIAL_SUPPORT must be 0
+                                                // Hardware serial is recommended, software serial blocks the loop for ~7ms
+                                                // while sending each command (7 bytes at 9600 baud)
 #endif
 
 #ifndef PMS_RX_PIN
@@ -978,6 +1043,7 @@
 
 #ifndef PZEM004T_USE_SOFT
 #define PZEM004T_USE_SOFT               0       // Software serial is not working atm, use hardware serial
+                                                // (it would also block the loop for ~7ms while sending each request)
 #endif
 
 #ifndef PZEM004T_RX_PIN
@@ -1000,6 +1066,10 @@
 #define PZEM004T_READ_INTERVAL          1500    // Read interval between same device
 #endif
 
+#ifndef PZEM004T_READ_TIMEOUT
+#define PZEM004T_READ_TIMEOUT           1000    // Time to wait for the device response
+#endif
+
 #ifndef PZEM004T_MAX_DEVICES
 #define PZEM004T_MAX_DEVICES            3
 #endif
@@ -1258,6 +1328,10 @@
 #define ADE7953_ADDRESS                  0x38
 #endif
 
+#ifndef ADE7953_SAMPLE_INTERVAL
+#define ADE7953_SAMPLE_INTERVAL          1000            // Sample power and integrate energy every 1s, regardless of the read interval
+#endif
+
 // -----------------------------------------------------------------------------
 // SI1145 UV Sensor over I2C
 // Enable support by passing SI1145_SUPPORT=1 build flag
@@ -1314,6 +1388,18 @@
 #define I2C_PERFORM_SCAN                1       // Perform a bus scan on boot
 #endif
 
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE                  16      // Maximum number of the queued transactions
+#endif
+
+#ifndef I2C_BURST_SIZE
+#define I2C_BURST_SIZE                  32      // Maximum length of the single transaction, adjacent register reads are merged up to this size
+#endif
+
+#ifndef I2C_TRANSACTION_RETRIES
+#define I2C_TRANSACTION_RETRIES         2       // Retry failed transaction this many times, then clear the bus if SDA is stuck low
+#endif
+
 // =============================================================================
 // Configuration helpers
 // =============================================================================
@@ -491,7 +491,7 @@ void kingartCurtainSetup() {
 #endif
 
     // Register loop to poll the UART for new messages
-    espurnaRegisterLoop(_KACurtainLoop);
+    espurnaRegisterLoop(_KACurtainLoop, PSTR("curtain"));
 
 }
 
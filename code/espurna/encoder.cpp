@@ -146,7 +146,7 @@ void encoderSetup() {
     _encoderConfigure();
 
     // Main callbacks
-    espurnaRegisterLoop(_encoderLoop);
+    espurnaRegisterLoop(_encoderLoop, PSTR("encoder"));
     espurnaRegisterReload(_encoderConfigure);
 
     DEBUG_MSG_P(PSTR("[ENCODER] Number of encoders: %u\n"), _encoders.size());
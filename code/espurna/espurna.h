@@ -43,10 +43,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 using void_callback_f = void (*)();
 
-void espurnaRegisterLoop(void_callback_f callback);
+// `name` is only used by the profiler, expected to be a PSTR() / string literal (address is shown when nullptr)
+void espurnaRegisterLoop(void_callback_f callback, const char* name = nullptr);
 void espurnaRegisterReload(void_callback_f callback);
 void espurnaReload();
 
+// Unlike loop callbacks, tasks are only called from the loop() when they are due.
+// - periodic task is called every `interval` ms
+// - task with zero `interval` is only called after espurnaTaskSchedule(), once
+// When multiple tasks are due at the same time, higher `priority` is called first.
+using espurna_task_t = unsigned char;
+constexpr espurna_task_t EspurnaTaskNone = 0xff;
+
+espurna_task_t espurnaRegisterTask(void_callback_f callback, const char* name = nullptr, unsigned long interval = 0, unsigned char priority = 0);
+void espurnaTaskSchedule(espurna_task_t task, unsigned long delay = 0);
+void espurnaTaskInterval(espurna_task_t task, unsigned long interval);
+void espurnaTaskCancel(espurna_task_t task);
+
 unsigned long espurnaLoopDelay();
 
 void extraSetup();
@@ -0,0 +1,44 @@
+// -----------------------------------------------------------------------------
+// Exponentially Weighted Moving Average Filter
+// -----------------------------------------------------------------------------
+
+#if SENSOR_SUPPORT
+
+#pragma once
+
+// Every value moves the result by `alpha` of the difference. Smoothing does not depend on
+// the report window, so the state is kept between the reports
+
+class EwmaFilter {
+
+    public:
+
+        void add(double value) {
+            if (!_count) {
+                _value = value;
+                _count = 1;
+                return;
+            }
+            _value += SENSOR_FILTER_EWMA_ALPHA * (value - _value);
+        }
+
+        unsigned char count() const {
+            return _count;
+        }
+
+        void reset() {}
+
+        double result() const {
+            return _value;
+        }
+
+        void resize(unsigned char size) {}
+
+    protected:
+
+        unsigned char _count = 0;
+        float _value = 0;
+
+};
+
+#endif // SENSOR_SUPPORT
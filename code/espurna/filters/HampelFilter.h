@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// Hampel Filter
+// -----------------------------------------------------------------------------
+
+#if SENSOR_SUPPORT
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Outlier rejection. New value is compared with the median of the last SENSOR_FILTER_HAMPEL_WINDOW values,
+// and replaced with it when the difference is more than SENSOR_FILTER_HAMPEL_THRESHOLD times the scaled
+// median absolute deviation. Window keeps the raw values, so the real step change is accepted after about
+// the half of the window. Result is the average of the (corrected) values since the last report
+
+class HampelFilter {
+
+    static_assert(SENSOR_FILTER_HAMPEL_WINDOW >= 3, "Window must have at least 3 values");
+
+    public:
+
+        void add(double value) {
+            float accepted = value;
+
+            if (_count >= 3) {
+                float sorted[SENSOR_FILTER_HAMPEL_WINDOW];
+                std::copy(_window, _window + _count, sorted);
+
+                const float median = _median(sorted, _count);
+                for (unsigned char n = 0; n < _count; ++n) {
+                    sorted[n] = std::fabs(sorted[n] - median);
+                }
+
+                // 1.4826 scales MAD to the standard deviation of the normally distributed values
+                const float deviation = 1.4826f * _median(sorted, _count);
+                if (std::fabs(accepted - median) > (SENSOR_FILTER_HAMPEL_THRESHOLD * deviation)) {
+                    accepted = median;
+                }
+            }
+
+            _window[_index] = value;
+            _index = (_index + 1) % SENSOR_FILTER_HAMPEL_WINDOW;
+            if (_count < SENSOR_FILTER_HAMPEL_WINDOW) ++_count;
+
+            _last = accepted;
+            _sum += accepted;
+            ++_samples;
+        }
+
+        unsigned char count() const {
+            return (_samples > UINT8_MAX) ? UINT8_MAX : _samples;
+        }
+
+        void reset() {
+            _sum = 0;
+            _samples = 0;
+        }
+
+        double result() const {
+            return _samples ? (_sum / _samples) : _last;
+        }
+
+        void resize(unsigned char size) {}
+
+    protected:
+
+        static float _median(float* values, unsigned char count) {
+            const unsigned char middle = count / 2;
+            std::nth_element(values, values + middle, values + count);
+            float result = values[middle];
+            if ((count & 1) == 0) {
+                result = (result + *std::max_element(values, values + middle)) / 2;
+            }
+            return result;
+        }
+
+        unsigned char _index = 0;
+        unsigned char _count = 0;
+        unsigned long _samples = 0;
+        float _last = 0;
+        double _sum = 0;
+        float _window[SENSOR_FILTER_HAMPEL_WINDOW] = {0};
+
+};
+
+#endif // SENSOR_SUPPORT
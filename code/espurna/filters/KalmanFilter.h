@@ -0,0 +1,51 @@
+// -----------------------------------------------------------------------------
+// 1-D Kalman Filter
+// -----------------------------------------------------------------------------
+
+#if SENSOR_SUPPORT
+
+#pragma once
+
+// Estimates the constant value with the noisy measurements. Process noise allows the estimate to
+// follow the real changes, measurement noise is the expected variance of the readings (both are in
+// the units of the sensor value). State is kept between the reports
+
+class KalmanFilter {
+
+    public:
+
+        void add(double value) {
+            if (!_count) {
+                _value = value;
+                _error = SENSOR_FILTER_KALMAN_MEASUREMENT_NOISE;
+                _count = 1;
+                return;
+            }
+
+            _error += SENSOR_FILTER_KALMAN_PROCESS_NOISE;
+            const float gain = _error / (_error + SENSOR_FILTER_KALMAN_MEASUREMENT_NOISE);
+            _value += gain * (value - _value);
+            _error *= (1.0f - gain);
+        }
+
+        unsigned char count() const {
+            return _count;
+        }
+
+        void reset() {}
+
+        double result() const {
+            return _value;
+        }
+
+        void resize(unsigned char size) {}
+
+    protected:
+
+        unsigned char _count = 0;
+        float _value = 0;
+        float _error = 0;
+
+};
+
+#endif // SENSOR_SUPPORT
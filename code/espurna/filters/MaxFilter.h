@@ -7,9 +7,7 @@
 
 #pragma once
 
-#include "BaseFilter.h"
-
-class MaxFilter : public BaseFilter {
+class MaxFilter {
 
     public:
 
@@ -17,7 +15,7 @@ class MaxFilter : public BaseFilter {
             if (value > _max) _max = value;
         }
 
-        unsigned char count() {
+        unsigned char count() const {
             return 1;
         }
 
@@ -25,7 +23,7 @@ class MaxFilter : public BaseFilter {
             _max = 0;
         }
 
-        double result() {
+        double result() const {
             return _max;
         }
 
@@ -33,7 +31,7 @@ class MaxFilter : public BaseFilter {
 
     protected:
 
-        double _max = 0;
+        float _max = 0;
 
 };
 
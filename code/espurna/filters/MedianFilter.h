@@ -7,85 +7,158 @@
 
 #pragma once
 
-#include "BaseFilter.h"
+#include <cstddef>
+#include <cstdint>
 
-class MedianFilter : public BaseFilter {
+// Median of the last `size` values (up to the `Capacity`), updated with every new value in O(log n)
+//
+// Values are kept in the ring buffer. `_heap` is indexed from -size/2 to (size-1)/2 and holds ring positions:
+// - _heap[0] is the median
+// - _heap[1...] is the min-heap of the values above the median, children of `i` are `2i` and `2i+1`
+// - _heap[...-1] is the max-heap of the values below the median, children of `-i` are `-2i` and `-2i-1`
+// `_pos` is the reverse mapping, so the oldest value is replaced in-place and only sifted through its own heap.
+// (based on the "Mediator" by A. Shelly, https://stackoverflow.com/a/5970314)
+
+template <size_t Capacity>
+class MedianFilter {
+
+    static_assert((Capacity > 0) && (Capacity < 128), "Heap positions must fit into the int8_t");
 
     public:
 
-        ~MedianFilter() {
-            if (_data) delete _data;
+        MedianFilter() {
+            resize(1);
         }
 
         void add(double value) {
-            if (_pointer <= _size) {
-                _data[_pointer] = value;
-                _pointer++;
+            const bool fresh = (_count < _size);
+            int p = _pos[_index];
+            const float old = _data[_index];
+
+            _data[_index] = value;
+            _index = (_index + 1) % _size;
+            if (fresh) ++_count;
+
+            if (p > 0) {
+                if (!fresh && (old < value)) {
+                    _minSortDown(p * 2);
+                } else if (_minSortUp(p)) {
+                    _maxSortDown(-1);
+                }
+            } else if (p < 0) {
+                if (!fresh && (value < old)) {
+                    _maxSortDown(p * 2);
+                } else if (_maxSortUp(p)) {
+                    _minSortDown(1);
+                }
+            } else {
+                if (_maxCount()) _maxSortDown(-1);
+                if (_minCount()) _minSortDown(1);
             }
         }
 
-        unsigned char count() {
-            return _pointer;
+        unsigned char count() const {
+            return _count;
         }
 
-        void reset() {
-            if (_pointer > 0) {
-                _data[0] = _data[_pointer-1];
-                _pointer = 1;
-            } else {
-                _pointer = 0;
+        // Window slides over the reports, nothing to do here
+        void reset() {}
+
+        double result() const {
+            if (!_count) return 0.0;
+
+            float value = _data[_at(0)];
+            if ((_count & 1) == 0) {
+                value = (value + _data[_at(-1)]) / 2;
             }
-        }
 
-        double result() {
+            return value;
+        }
 
-            double sum = 0;
+        void resize(unsigned char size) {
+            if (size > Capacity) size = Capacity;
+            if (!size) size = 1;
 
-            if (_pointer > 2) {
+            _size = size;
+            _index = 0;
+            _count = 0;
 
-                for (unsigned char i = 1; i <= _pointer - 2; i++) {
+            // Alternate between the heaps, so they are balanced while the window is filling up
+            for (int n = _size - 1; n >= 0; --n) {
+                _pos[n] = ((n + 1) / 2) * ((n & 1) ? -1 : 1);
+                _at(_pos[n]) = n;
+            }
+        }
 
-                    // For each position,
-                    // we find the median with the previous and next value
-                    // and use that for the sum
+    protected:
 
-                    double previous = _data[i-1];
-                    double current = _data[i];
-                    double next = _data[i+1];
+        uint8_t& _at(int i) {
+            return _heap[i + (_size / 2)];
+        }
 
-                    if (previous > current) std::swap(previous, current);
-                    if (current > next) std::swap(current, next);
-                    if (previous > current) std::swap(previous, current);
+        uint8_t _at(int i) const {
+            return _heap[i + (_size / 2)];
+        }
 
-                    sum += current;
+        int _minCount() const {
+            return (_count - 1) / 2;
+        }
 
-                }
+        int _maxCount() const {
+            return _count / 2;
+        }
 
-                sum /= (_pointer - 2);
+        bool _less(int i, int j) const {
+            return _data[_at(i)] < _data[_at(j)];
+        }
 
-            } else if (_pointer > 0) {
+        void _exchange(int i, int j) {
+            const uint8_t tmp = _at(i);
+            _at(i) = _at(j);
+            _at(j) = tmp;
+            _pos[_at(i)] = i;
+            _pos[_at(j)] = j;
+        }
 
-                sum = _data[0];
+        bool _compareExchange(int i, int j) {
+            if (!_less(i, j)) return false;
+            _exchange(i, j);
+            return true;
+        }
 
+        // Restore the heap order of `i` and everything below it, starting from the `i` <-> `i / 2`
+        void _minSortDown(int i) {
+            for (; i <= _minCount(); i *= 2) {
+                if ((i > 1) && (i < _minCount()) && _less(i + 1, i)) ++i;
+                if (!_compareExchange(i, i / 2)) break;
             }
+        }
 
-            return sum;
+        void _maxSortDown(int i) {
+            for (; i >= -_maxCount(); i *= 2) {
+                if ((i < -1) && (i > -_maxCount()) && _less(i, i - 1)) --i;
+                if (!_compareExchange(i / 2, i)) break;
+            }
+        }
 
+        // `true` when the value ended up as the median, and the other heap needs to be checked
+        bool _minSortUp(int i) {
+            while ((i > 0) && _compareExchange(i, i / 2)) i /= 2;
+            return (i == 0);
         }
 
-        void resize(unsigned char size) {
-            if (_size == size) return;
-            _size = size;
-            if (_data) delete _data;
-            _data = new double[_size+1];
-            for (unsigned char i=0; i<=_size; i++) _data[i] = 0;
-            _pointer = 0;
+        bool _maxSortUp(int i) {
+            while ((i < 0) && _compareExchange(i / 2, i)) i /= 2;
+            return (i == 0);
         }
 
-    protected:
+        unsigned char _size = 0;
+        unsigned char _index = 0;
+        unsigned char _count = 0;
 
-        unsigned char _pointer = 0;
-        double * _data = NULL;
+        float _data[Capacity] = {0};
+        int8_t _pos[Capacity] = {0};
+        uint8_t _heap[Capacity] = {0};
 
 };
 
@@ -7,44 +7,67 @@
 
 #pragma once
 
-#include <vector>
-#include "BaseFilter.h"
+#include <cstddef>
 
-class MovingAverageFilter : public BaseFilter {
+// Sum of the last `size` values. Storage is a part of the object, resize() never allocates.
+// When `size` is larger than the `Capacity`, consecutive values are grouped into `Capacity` slots of (almost) equal
+// length and the window moves one slot at a time. The sum covers exactly `size` values whenever the current slot is complete,
+// i.e. on every report, since the filter is resized to the report window.
+
+template <size_t Capacity>
+class MovingAverageFilter {
+
+    static_assert((Capacity > 0) && (Capacity < 256), "Capacity must fit into the unsigned char");
 
     public:
 
         void add(double value) {
-            _sum = _sum + value - _data[_pointer];
-            _data[_pointer] = value;
-            _pointer = (_pointer + 1) % _size;
+            if (_fill == _length(_pointer)) {
+                _pointer = (_pointer + 1) % _slots;
+                _sum -= _data[_pointer];
+                _data[_pointer] = 0;
+                _fill = 0;
+            }
+
+            _data[_pointer] += value;
+            _sum += value;
+            ++_fill;
         }
 
-        unsigned char count() {
+        unsigned char count() const {
             return _pointer;
         }
 
         void reset() {}
 
-        double result() {
+        double result() const {
             return _sum;
         }
 
         void resize(unsigned char size) {
+            if (!size) size = 1;
             if (_size == size) return;
             _size = size;
-            if (_data) delete _data;
-            _data = new double[_size];
-            for (unsigned char i=0; i<_size; i++) _data[i] = 0;
+            _slots = (size > Capacity) ? Capacity : size;
+            for (unsigned char i=0; i<_slots; i++) _data[i] = 0;
             _pointer = 0;
+            _fill = 0;
             _sum = 0;
         }
 
     protected:
 
+        // First `_size % _slots` slots are one value longer than the rest
+        unsigned char _length(unsigned char slot) const {
+            return (_size / _slots) + ((slot < (_size % _slots)) ? 1 : 0);
+        }
+
+        unsigned char _size = 1;
+        unsigned char _slots = 1;
         unsigned char _pointer = 0;
+        unsigned char _fill = 0;
         double _sum = 0;
-        double * _data = NULL;
+        float _data[Capacity] = {0};
 
 };
 
@@ -0,0 +1,181 @@
+// -----------------------------------------------------------------------------
+// Sensor Filter (one of the filters, stored in-place)
+// -----------------------------------------------------------------------------
+
+#if SENSOR_SUPPORT
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include "EwmaFilter.h"
+#include "HampelFilter.h"
+#include "KalmanFilter.h"
+#include "LastFilter.h"
+#include "MaxFilter.h"
+#include "MedianFilter.h"
+#include "MovingAverageFilter.h"
+#include "SumFilter.h"
+
+// Values are used by the snsFilter settings, new types must only be appended
+enum class FilterType : unsigned char {
+    Last,
+    Sum,
+    Max,
+    MovingAverage,
+    Median,
+    Ewma,
+    Hampel,
+    Kalman
+};
+
+// Every magnitude holds the filter object directly, without a separate heap allocation.
+// Calls are dispatched through the switch instead of the vtable, which allows the compiler to inline them.
+// Windowed filters hold up to `Capacity` values, resize() only changes the number of values used.
+
+template <size_t Capacity>
+class SensorFilter {
+
+    public:
+
+        SensorFilter() :
+            SensorFilter(FilterType::Last)
+        {}
+
+        explicit SensorFilter(FilterType type) {
+            setType(type);
+        }
+
+        FilterType type() const {
+            return _type;
+        }
+
+        // Filter state is discarded
+        void setType(FilterType type) {
+            _type = type;
+            switch (type) {
+                case FilterType::Last:
+                    new (&_filter.last) LastFilter();
+                    break;
+                case FilterType::Sum:
+                    new (&_filter.sum) SumFilter();
+                    break;
+                case FilterType::Max:
+                    new (&_filter.max) MaxFilter();
+                    break;
+                case FilterType::MovingAverage:
+                    new (&_filter.average) MovingAverageFilter<Capacity>();
+                    break;
+                case FilterType::Median:
+                    new (&_filter.median) MedianFilter<Capacity>();
+                    break;
+                case FilterType::Ewma:
+                    new (&_filter.ewma) EwmaFilter();
+                    break;
+                case FilterType::Hampel:
+                    new (&_filter.hampel) HampelFilter();
+                    break;
+                case FilterType::Kalman:
+                    new (&_filter.kalman) KalmanFilter();
+                    break;
+            }
+            _size = 0;
+        }
+
+        void add(double value) {
+            switch (_type) {
+                case FilterType::Last:          _filter.last.add(value); break;
+                case FilterType::Sum:           _filter.sum.add(value); break;
+                case FilterType::Max:           _filter.max.add(value); break;
+                case FilterType::MovingAverage: _filter.average.add(value); break;
+                case FilterType::Median:        _filter.median.add(value); break;
+                case FilterType::Ewma:          _filter.ewma.add(value); break;
+                case FilterType::Hampel:        _filter.hampel.add(value); break;
+                case FilterType::Kalman:        _filter.kalman.add(value); break;
+            }
+        }
+
+        unsigned char count() const {
+            switch (_type) {
+                case FilterType::Last:          return _filter.last.count();
+                case FilterType::Sum:           return _filter.sum.count();
+                case FilterType::Max:           return _filter.max.count();
+                case FilterType::MovingAverage: return _filter.average.count();
+                case FilterType::Median:        return _filter.median.count();
+                case FilterType::Ewma:          return _filter.ewma.count();
+                case FilterType::Hampel:        return _filter.hampel.count();
+                case FilterType::Kalman:        return _filter.kalman.count();
+            }
+            return 0;
+        }
+
+        void reset() {
+            switch (_type) {
+                case FilterType::Last:          _filter.last.reset(); break;
+                case FilterType::Sum:           _filter.sum.reset(); break;
+                case FilterType::Max:           _filter.max.reset(); break;
+                case FilterType::MovingAverage: _filter.average.reset(); break;
+                case FilterType::Median:        _filter.median.reset(); break;
+                case FilterType::Ewma:          _filter.ewma.reset(); break;
+                case FilterType::Hampel:        _filter.hampel.reset(); break;
+                case FilterType::Kalman:        _filter.kalman.reset(); break;
+            }
+        }
+
+        double result() const {
+            switch (_type) {
+                case FilterType::Last:          return _filter.last.result();
+                case FilterType::Sum:           return _filter.sum.result();
+                case FilterType::Max:           return _filter.max.result();
+                case FilterType::MovingAverage: return _filter.average.result();
+                case FilterType::Median:        return _filter.median.result();
+                case FilterType::Ewma:          return _filter.ewma.result();
+                case FilterType::Hampel:        return _filter.hampel.result();
+                case FilterType::Kalman:        return _filter.kalman.result();
+            }
+            return 0.0;
+        }
+
+        void resize(unsigned char size) {
+            if (_size == size) return;
+            _size = size;
+            switch (_type) {
+                case FilterType::Last:          _filter.last.resize(size); break;
+                case FilterType::Sum:           _filter.sum.resize(size); break;
+                case FilterType::Max:           _filter.max.resize(size); break;
+                case FilterType::MovingAverage: _filter.average.resize(size); break;
+                case FilterType::Median:        _filter.median.resize(size); break;
+                case FilterType::Ewma:          _filter.ewma.resize(size); break;
+                case FilterType::Hampel:        _filter.hampel.resize(size); break;
+                case FilterType::Kalman:        _filter.kalman.resize(size); break;
+            }
+        }
+
+        unsigned char size() const {
+            return _size;
+        }
+
+    protected:
+
+        // Every filter is trivially copyable and destructible, so is the union
+        union filter_t {
+            filter_t() : last() {}
+
+            LastFilter last;
+            SumFilter sum;
+            MaxFilter max;
+            MovingAverageFilter<Capacity> average;
+            MedianFilter<Capacity> median;
+            EwmaFilter ewma;
+            HampelFilter hampel;
+            KalmanFilter kalman;
+        };
+
+        FilterType _type = FilterType::Last;
+        unsigned char _size = 0;
+        filter_t _filter;
+
+};
+
+#endif // SENSOR_SUPPORT
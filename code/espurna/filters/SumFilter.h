@@ -7,9 +7,9 @@
 
 #pragma once
 
-#include "BaseFilter.h"
+// Keeps double, energy deltas would lose precision as float
 
-class SumFilter : public BaseFilter {
+class SumFilter {
 
     public:
 
@@ -17,7 +17,7 @@ class SumFilter : public BaseFilter {
             _value += value;
         }
 
-        unsigned char count() {
+        unsigned char count() const {
             return 1;
         }
 
@@ -25,7 +25,7 @@ class SumFilter : public BaseFilter {
             _value = 0.0;
         }
 
-        double result() {
+        double result() const {
             return _value;
         }
 
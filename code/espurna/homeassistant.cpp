@@ -24,6 +24,9 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 bool _ha_enabled = false;
 bool _ha_send_flag = false;
 
+settings::Cached<String> _ha_hostname("hostname", String());
+settings::Cached<String> _ha_prefix("haPrefix", HOMEASSISTANT_PREFIX);
+
 // -----------------------------------------------------------------------------
 // UTILS
 // -----------------------------------------------------------------------------
@@ -206,7 +209,12 @@ void _haSendDiscovery() {
 #if SENSOR_SUPPORT
 
 void _haSendMagnitude(unsigned char index, JsonObject& config) {
-    config["name"] = _haFixName(getSetting("hostname") + String(" ") + magnitudeTopic(magnitudeType(index)));
+    String name;
+    name.reserve(_ha_hostname.get().length() + 16);
+    name += _ha_hostname.get();
+    name += ' ';
+    name += magnitudeTopic(magnitudeType(index));
+    config["name"] = _haFixName(name);
     config["state_topic"] = mqttTopic(magnitudeTopicIndex(index).c_str(), false);
     config["unit_of_measurement"] = magnitudeUnits(index);
 }
@@ -218,9 +226,9 @@ void ha_discovery_t::prepareMagnitudes(ha_config_t& config) {
 
     for (unsigned char i=0; i<magnitudeCount(); i++) {
 
-        String topic = getSetting("haPrefix", HOMEASSISTANT_PREFIX) +
+        String topic = _ha_prefix.get() +
             "/sensor/" +
-            getSetting("hostname") + "_" + String(i) +
+            _ha_hostname.get() + "_" + String(i) +
             "/config";
         String message;
 
@@ -247,7 +255,7 @@ void ha_discovery_t::prepareMagnitudes(ha_config_t& config) {
 
 void _haSendSwitch(unsigned char i, JsonObject& config) {
 
-    String name = getSetting("hostname");
+    String name = _ha_hostname.get();
     if (relayCount() > 1) {
         name += String("_") + String(i);
     }
@@ -298,9 +306,9 @@ void ha_discovery_t::prepareSwitches(ha_config_t& config) {
 
     for (unsigned char i=0; i<relayCount(); i++) {
 
-        String topic = getSetting("haPrefix", HOMEASSISTANT_PREFIX) +
+        String topic = _ha_prefix.get() +
             "/" + switchType +
-            "/" + getSetting("hostname") + "_" + String(i) +
+            "/" + _ha_hostname.get() + "_" + String(i) +
             "/config";
         String message;
 
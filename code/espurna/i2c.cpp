@@ -10,6 +10,9 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 #if I2C_SUPPORT
 
+#include <algorithm>
+#include <vector>
+
 unsigned int _i2c_locked[16] = {0};
 
 #if I2C_USE_BRZO
@@ -28,7 +31,8 @@ int _i2cGetSCL() {
     return getSetting("i2cSCL", I2C_SCL_PIN);
 }
 
-int _i2cClearbus(int sda, int scl) {
+// `wait` is only needed on boot, see below
+int _i2cClearbus(int sda, int scl, unsigned long wait) {
 
     #if defined(TWCR) && defined(TWEN)
         // Disable the Atmel 2-Wire interface so we can control the SDA and SCL pins directly
@@ -39,7 +43,7 @@ int _i2cClearbus(int sda, int scl) {
     pinMode(sda, INPUT_PULLUP);
     pinMode(scl, INPUT_PULLUP);
 
-    nice_delay(2500);
+    if (wait) nice_delay(wait);
     // Wait 2.5 secs. This is strictly only necessary on the first power
     // up of the DS3231 module to allow it to initialize properly,
     // but is also assists in reliable programming of FioV3 boards as it gives the
@@ -175,6 +179,13 @@ void i2c_read_buffer(uint8_t address, uint8_t * buffer, size_t len) {
     brzo_i2c_end_transaction();
 }
 
+uint8_t i2c_read_buffer(uint8_t address, uint8_t reg, uint8_t * buffer, size_t len) {
+    brzo_i2c_start_transaction(address, _i2c_scl_frequency);
+    brzo_i2c_write(&reg, 1, true);
+    brzo_i2c_read(buffer, len, false);
+    return brzo_i2c_end_transaction();
+}
+
 #else // not I2C_USE_BRZO
 
 void i2c_wakeup(uint8_t address) {
@@ -241,6 +252,19 @@ void i2c_read_buffer(uint8_t address, uint8_t * buffer, size_t len) {
     Wire.endTransmission();
 }
 
+// Register address is followed by the repeated start, so the device does not lose the register pointer
+uint8_t i2c_read_buffer(uint8_t address, uint8_t reg, uint8_t * buffer, size_t len) {
+    Wire.beginTransmission((uint8_t) address);
+    Wire.write((uint8_t) reg);
+    const uint8_t error = Wire.endTransmission(false);
+    if (error) return error;
+
+    if (Wire.requestFrom(address, (uint8_t) len) != len) return 4;
+    for (size_t i=0; i<len; i++) buffer[i] = Wire.read();
+
+    return 0;
+}
+
 #endif // I2C_USE_BRZO
 
 uint8_t i2c_write_uint8(uint8_t address, uint8_t reg, uint8_t value) {
@@ -288,7 +312,7 @@ int16_t i2c_read_int16_le(uint8_t address, uint8_t reg) {
 void i2cClearBus() {
     DEBUG_MSG_P(
         PSTR("[I2C] Clear bus (response: %d)\n"),
-        _i2cClearbus(_i2cGetSDA(), _i2cGetSCL())
+        _i2cClearbus(_i2cGetSDA(), _i2cGetSCL(), 2500)
     );
 }
 
@@ -359,6 +383,168 @@ void i2cScan() {
     if (nDevices == 0) DEBUG_MSG_P(PSTR("[I2C] No devices found\n"));
 }
 
+// -----------------------------------------------------------------------------
+// Transaction queue
+// -----------------------------------------------------------------------------
+
+struct i2c_transaction_t {
+    uint8_t address;
+    uint8_t reg;                    // First register, when reading
+    uint8_t length;
+    bool read;
+    uint8_t data[I2C_BURST_SIZE];   // Data to write
+    i2c_transaction_callback_f callback;
+};
+
+struct i2c_stats_t {
+    uint8_t address;
+    uint32_t transactions;          // Executed on the bus, merged reads are counted once
+    uint32_t merged;                // Reads that were merged into another transaction
+    uint32_t errors;                // Failed attempts, including the retries
+    uint32_t failures;              // Transactions that failed after every retry
+    uint32_t bus_time;              // Time spent in the transactions, in microseconds
+};
+
+std::vector<i2c_transaction_t> _i2c_queue;
+std::vector<i2c_stats_t> _i2c_stats;
+
+i2c_stats_t& _i2cStats(uint8_t address) {
+    for (auto& stats : _i2c_stats) {
+        if (stats.address == address) return stats;
+    }
+
+    _i2c_stats.push_back({address, 0, 0, 0, 0, 0});
+    return _i2c_stats.back();
+}
+
+void _i2cBegin(int sda, int scl) {
+    #if I2C_USE_BRZO
+        brzo_i2c_setup(sda, scl, getSetting("i2cCST", I2C_CLOCK_STRETCH_TIME));
+    #else
+        Wire.begin(sda, scl);
+    #endif
+}
+
+// Device holding SDA low would block every transaction on the bus. Clearing it changes pin modes, so the bus needs to be set up again
+void _i2cRecover() {
+    const auto sda = _i2cGetSDA();
+    const auto scl = _i2cGetSCL();
+    if (digitalRead(sda) != LOW) return;
+
+    const auto result = _i2cClearbus(sda, scl, 0);
+    DEBUG_MSG_P(PSTR("[I2C] SDA is stuck low, clear bus (response: %d)\n"), result);
+    _i2cBegin(sda, scl);
+}
+
+bool i2cQueueRead(uint8_t address, uint8_t reg, size_t length, i2c_transaction_callback_f callback) {
+    if (!length || (length > I2C_BURST_SIZE) || ((reg + length) > 0x100)) return false;
+    if (_i2c_queue.size() >= I2C_QUEUE_SIZE) return false;
+
+    i2c_transaction_t transaction;
+    transaction.address = address;
+    transaction.reg = reg;
+    transaction.length = length;
+    transaction.read = true;
+    transaction.callback = std::move(callback);
+    _i2c_queue.push_back(std::move(transaction));
+
+    return true;
+}
+
+bool i2cQueueWrite(uint8_t address, const uint8_t * data, size_t length, i2c_transaction_callback_f callback) {
+    if (!length || (length > I2C_BURST_SIZE)) return false;
+    if (_i2c_queue.size() >= I2C_QUEUE_SIZE) return false;
+
+    i2c_transaction_t transaction;
+    transaction.address = address;
+    transaction.reg = data[0];
+    transaction.length = length;
+    transaction.read = false;
+    memcpy(transaction.data, data, length);
+    transaction.callback = std::move(callback);
+    _i2c_queue.push_back(std::move(transaction));
+
+    return true;
+}
+
+// Only one transaction per loop. Reads of the same device that overlap or are right next to the first one are done
+// in the same burst, but only until there is a write to that device (to keep the order) and only for adjacent registers
+// (reading registers in between could have side-effects, e.g. clear the status or pop the FIFO)
+void _i2cQueueLoop() {
+
+    if (_i2c_queue.empty()) return;
+
+    std::vector<i2c_transaction_t> batch;
+    batch.push_back(std::move(_i2c_queue.front()));
+    _i2c_queue.erase(_i2c_queue.begin());
+
+    const uint8_t address = batch.front().address;
+    const bool read = batch.front().read;
+
+    uint16_t first = batch.front().reg;
+    uint16_t last = first + batch.front().length;
+
+    if (read) {
+        for (auto it = _i2c_queue.begin(); it != _i2c_queue.end();) {
+            if ((*it).address != address) {
+                ++it;
+                continue;
+            }
+
+            if (!(*it).read) break;
+
+            const uint16_t reg = (*it).reg;
+            const uint16_t end = reg + (*it).length;
+            const uint16_t span = std::max(last, end) - std::min(first, reg);
+            if ((reg <= last) && (end >= first) && (span <= I2C_BURST_SIZE)) {
+                first = std::min(first, reg);
+                last = std::max(last, end);
+                batch.push_back(std::move(*it));
+                it = _i2c_queue.erase(it);
+                continue;
+            }
+
+            ++it;
+        }
+    }
+
+    uint8_t buffer[I2C_BURST_SIZE];
+    const size_t length = read ? (last - first) : batch.front().length;
+    if (!read) memcpy(buffer, batch.front().data, length);
+
+    auto& stats = _i2cStats(address);
+    uint8_t error = 0;
+    for (unsigned char attempt = 0; attempt <= I2C_TRANSACTION_RETRIES; ++attempt) {
+        const unsigned long start = micros();
+        error = read
+            ? i2c_read_buffer(address, first, buffer, length)
+            : i2c_write_buffer(address, buffer, length);
+        stats.bus_time += micros() - start;
+        if (!error) break;
+        ++stats.errors;
+    }
+
+    ++stats.transactions;
+    stats.merged += batch.size() - 1;
+
+    if (error) {
+        ++stats.failures;
+        DEBUG_MSG_P(PSTR("[I2C] Transaction with 0x%02X failed (error: %u)\n"), address, error);
+        _i2cRecover();
+    }
+
+    // Callbacks are free to queue more transactions
+    for (auto& transaction : batch) {
+        if (!transaction.callback) continue;
+        if (transaction.read) {
+            transaction.callback(error, buffer + (transaction.reg - first), transaction.length);
+        } else {
+            transaction.callback(error, nullptr, 0);
+        }
+    }
+
+}
+
 #if TERMINAL_SUPPORT
 
 void _i2cInitCommands() {
@@ -373,6 +559,17 @@ void _i2cInitCommands() {
         terminalOK();
     });
 
+    terminalRegisterCommand(F("I2C.STATS"), [](const terminal::CommandContext& ctx) {
+        ctx.output.printf_P(PSTR("%-8s %12s %10s %10s %10s %12s\n"), "address", "transactions", "merged", "errors", "failures", "bus time us");
+        for (const auto& stats : _i2c_stats) {
+            ctx.output.printf_P(PSTR("0x%02X     %12u %10u %10u %10u %12u\n"),
+                stats.address, stats.transactions, stats.merged,
+                stats.errors, stats.failures, stats.bus_time
+            );
+        }
+        terminalOK();
+    });
+
 }
 
 #endif // TERMINAL_SUPPORT
@@ -383,12 +580,9 @@ void i2cSetup() {
     const auto scl = _i2cGetSCL();
 
     #if I2C_USE_BRZO
-        auto cst = getSetting("i2cCST", I2C_CLOCK_STRETCH_TIME);
         _i2c_scl_frequency = getSetting("i2cFreq", I2C_SCL_FREQUENCY);
-        brzo_i2c_setup(sda, scl, cst);
-    #else
-        Wire.begin(sda, scl);
     #endif
+    _i2cBegin(sda, scl);
 
     DEBUG_MSG_P(PSTR("[I2C] Using GPIO%02d for SDA and GPIO%02d for SCL\n"), sda, scl);
 
@@ -404,6 +598,8 @@ void i2cSetup() {
         i2cScan();
     #endif
 
+    espurnaRegisterLoop(_i2cQueueLoop, PSTR("i2c"));
+
 }
 
 #endif
@@ -18,6 +18,11 @@ Copyright (C) 2017-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include <Wire.h>
 #endif
 
+#include <functional>
+
+// Receives the bus error code (0 when OK) and the data that was read (nothing, for writes)
+using i2c_transaction_callback_f = std::function<void(uint8_t error, const uint8_t* data, size_t length)>;
+
 void i2c_wakeup(uint8_t address);
 uint8_t i2c_write_buffer(uint8_t address, uint8_t * buffer, size_t len);
 uint8_t i2c_write_uint8(uint8_t address, uint8_t value);
@@ -33,6 +38,13 @@ uint16_t i2c_read_uint16_le(uint8_t address, uint8_t reg);
 int16_t i2c_read_int16(uint8_t address, uint8_t reg);
 int16_t i2c_read_int16_le(uint8_t address, uint8_t reg);
 void i2c_read_buffer(uint8_t address, uint8_t * buffer, size_t len);
+uint8_t i2c_read_buffer(uint8_t address, uint8_t reg, uint8_t * buffer, size_t len);
+
+// Transactions are executed by the loop one at a time, so multiple drivers could share the bus without blocking it.
+// Reads of the adjacent registers of the same device are merged into the single burst read.
+// Return `false` when the queue is full or the transaction is too large
+bool i2cQueueRead(uint8_t address, uint8_t reg, size_t length, i2c_transaction_callback_f callback);
+bool i2cQueueWrite(uint8_t address, const uint8_t * data, size_t length, i2c_transaction_callback_f callback = nullptr);
 
 void i2cScan();
 void i2cClearBus();
@@ -154,10 +154,16 @@ void _idbConfigure() {
     if (_idb_enabled && !_idb_client) _idbInitClient();
 }
 
-void _idbBrokerSensor(const String& topic, unsigned char id, double, const char* value) {
-    idbSend(topic.c_str(), id, value);
+#if SENSOR_SUPPORT
+
+void _idbBrokerSensor(unsigned char type, unsigned char index, double value, unsigned char decimals) {
+    char buffer[64];
+    dtostrf(value, 1, decimals, buffer);
+    idbSend(magnitudeTopic(type).c_str(), index, buffer);
 }
 
+#endif // SENSOR_SUPPORT
+
 void _idbBrokerStatus(const String& topic, unsigned char id, unsigned int value) {
     idbSend(topic.c_str(), id, String(int(value)).c_str());
 }
@@ -265,7 +271,7 @@ void idbSetup() {
     #endif
 
     espurnaRegisterReload(_idbConfigure);
-    espurnaRegisterLoop(_idbFlush);
+    espurnaRegisterLoop(_idbFlush, PSTR("influxdb"));
 
     #if TERMINAL_SUPPORT
         terminalRegisterCommand(F("IDB.SEND"), [](const terminal::CommandContext& ctx) {
@@ -415,7 +415,7 @@ void irSetup() {
         DEBUG_MSG_P(PSTR("[IR] Transmitter initialized \n"));
     #endif
 
-    espurnaRegisterLoop(_irLoop);
+    espurnaRegisterLoop(_irLoop, PSTR("ir"));
 
 }
 
@@ -244,47 +244,43 @@ void _ledBrokerCallback(const String& topic, unsigned char, unsigned int) {
 }
 
 #if MQTT_SUPPORT
-void _ledMQTTCallback(unsigned int type, const char * topic, const char * payload) {
+// Only want `led/+/<MQTT_SETTER>`, where magnitude is `led/<LED_ID>`
+void _ledMQTTLed(const mqtt::match_t& match, const char * payload) {
 
-    if (type == MQTT_CONNECT_EVENT) {
-        char buffer[strlen(MQTT_TOPIC_LED) + 3];
-        snprintf_P(buffer, sizeof(buffer), PSTR("%s/+"), MQTT_TOPIC_LED);
-        mqttSubscribe(buffer);
+    unsigned int ledID;
+    if (!match.number(0, ledID) || (ledID >= ledCount())) {
+        DEBUG_MSG_P(PSTR("[LED] Wrong ledID (%s)\n"), match.topic);
+        return;
     }
 
-    if (type == MQTT_MESSAGE_EVENT) {
-
-        // Only want `led/+/<MQTT_SETTER>`
-        const String magnitude = mqttMagnitude((char *) topic);
-        if (!magnitude.startsWith(MQTT_TOPIC_LED)) return;
+    // Check if LED is managed
+    if (_leds[ledID].mode != LED_MODE_MANUAL) return;
 
-        // Get led ID from after the slash when t is `led/<LED_ID>`
-        unsigned int ledID = magnitude.substring(strlen(MQTT_TOPIC_LED) + 1).toInt();
-        if (ledID >= ledCount()) {
-            DEBUG_MSG_P(PSTR("[LED] Wrong ledID (%d)\n"), ledID);
-            return;
-        }
+    // Get value based on rpc payload logic (see rpc.ino)
+    const auto value = rpcParsePayload(payload);
+    switch (value) {
+        case PayloadStatus::On:
+        case PayloadStatus::Off:
+            _ledStatus(_leds[ledID], (value == PayloadStatus::On));
+            break;
+        case PayloadStatus::Toggle:
+            _ledToggle(_leds[ledID]);
+            break;
+        case PayloadStatus::Unknown:
+        default:
+            _ledLoadPattern(_leds[ledID], payload);
+            _ledStatus(_leds[ledID], true);
+            break;
+    }
 
-        // Check if LED is managed
-        if (_leds[ledID].mode != LED_MODE_MANUAL) return;
+}
 
-        // Get value based on rpc payload logic (see rpc.ino)
-        const auto value = rpcParsePayload(payload);
-        switch (value) {
-            case PayloadStatus::On:
-            case PayloadStatus::Off:
-                _ledStatus(_leds[ledID], (value == PayloadStatus::On));
-                break;
-            case PayloadStatus::Toggle:
-                _ledToggle(_leds[ledID]);
-                break;
-            case PayloadStatus::Unknown:
-            default:
-                _ledLoadPattern(_leds[ledID], payload);
-                _ledStatus(_leds[ledID], true);
-                break;
-        }
+void _ledMQTTCallback(unsigned int type, const char * topic, const char * payload) {
 
+    if (type == MQTT_CONNECT_EVENT) {
+        char buffer[strlen(MQTT_TOPIC_LED) + 3];
+        snprintf_P(buffer, sizeof(buffer), PSTR("%s/+"), MQTT_TOPIC_LED);
+        mqttSubscribe(buffer);
     }
 
 }
@@ -477,6 +473,7 @@ void ledSetup() {
 
     #if MQTT_SUPPORT
         mqttRegister(_ledMQTTCallback);
+        mqttRegisterTopic(MQTT_TOPIC_LED "/+", _ledMQTTLed);
     #endif
 
     #if WEB_SUPPORT
@@ -491,7 +488,7 @@ void ledSetup() {
     DEBUG_MSG_P(PSTR("[LED] Number of leds: %d\n"), _leds.size());
 
     // Main callbacks
-    espurnaRegisterLoop(ledLoop);
+    espurnaRegisterLoop(ledLoop, PSTR("led"));
     espurnaRegisterReload(_ledConfigure);
 
 }
@@ -21,7 +21,6 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "light_config.h"
 
 #include <Ticker.h>
-#include <Schedule.h>
 #include <ArduinoJson.h>
 #include <vector>
 
@@ -52,7 +51,8 @@ struct channel_t {
     unsigned char inputValue;    // raw value, without the brightness
     unsigned char value;         // normalized value, including brightness
     unsigned char target;        // target value
-    double current;              // transition value
+    uint32_t current;            // transition value, Q16 fixed-point
+    int32_t delta;               // transition step, Q16 fixed-point
 
 };
 
@@ -71,6 +71,7 @@ bool _light_provider_update = false;
 
 bool _light_use_transitions = false;
 unsigned int _light_transition_time = LIGHT_TRANSITION_TIME;
+unsigned long _light_transition_steps = 0;
 
 bool _light_dirty = false;
 bool _light_state = false;
@@ -107,26 +108,27 @@ const char _light_channel_desc[5][5] PROGMEM = {
 };
 static_assert((LIGHT_CHANNELS * LIGHT_CHANNELS) <= (sizeof(_light_channel_desc)), "Out-of-bounds array access");
 
-// Gamma Correction lookup table (8 bit)
-const unsigned char _light_gamma_table[] PROGMEM = {
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-    1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,
-    3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,
-    6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,   10,  10,  11,  11,  11,
-    12,  12,  13,  13,  14,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,
-    19,  20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,
-    29,  30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,
-    41,  42,  43,  43,  44,  45,  46,  47,  48,  49,  50,  50,  51,  52,  53,  54,
-    55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  71,
-    72,  73,  74,  75,  76,  77,  78,  80,  81,  82,  83,  84,  86,  87,  88,  89,
-    91,  92,  93,  94,  96,  97,  98,  100, 101, 102, 104, 105, 106, 108, 109, 110,
-    112, 113, 115, 116, 118, 119, 121, 122, 123, 125, 126, 128, 130, 131, 133, 134,
-    136, 137, 139, 140, 142, 144, 145, 147, 149, 150, 152, 154, 155, 157, 159, 160,
-    162, 164, 166, 167, 169, 171, 173, 175, 176, 178, 180, 182, 184, 186, 187, 189,
-    191, 193, 195, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
-    223, 225, 227, 229, 231, 233, 235, 238, 240, 242, 244, 246, 248, 251, 253, 255
+// Gamma Correction lookup table (16 bit, gamma 2.2)
+// Values in-between are interpolated, so the transitions are not limited to 8 bits at the low end
+const uint16_t _light_gamma_table[] PROGMEM = {
+    0,     0,     2,     4,     7,     11,    17,    24,    32,    42,    53,    65,    79,    94,    111,   129,
+    148,   169,   192,   216,   242,   270,   299,   330,   362,   396,   432,   469,   508,   549,   591,   635,
+    681,   729,   779,   830,   883,   938,   995,   1053,  1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+    1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,  2334,  2427,  2521,  2618,  2717,  2817,  2920,  3024,
+    3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,  4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,
+    5115,  5257,  5401,  5547,  5695,  5845,  5998,  6152,  6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+    7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,  9111,  9305,  9501,  9699,  9900,  10102, 10307, 10515,
+    10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254, 12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140,
+    14386, 14635, 14885, 15138, 15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919, 22231, 22546, 22863, 23182,
+    23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826, 26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627,
+    28988, 29351, 29717, 30086, 30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680, 40112, 40546, 40982, 41421,
+    41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025, 45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793,
+    49275, 49761, 50249, 50739, 51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535
 };
-static_assert(Light::VALUE_MAX <= sizeof(_light_gamma_table), "Out-of-bounds array access");
+static_assert(Light::VALUE_MAX < (sizeof(_light_gamma_table) / sizeof(_light_gamma_table[0])), "Out-of-bounds array access");
 
 // -----------------------------------------------------------------------------
 // UTILS
@@ -139,7 +141,8 @@ channel_t::channel_t() :
     inputValue(0),
     value(0),
     target(0),
-    current(0.0)
+    current(0),
+    delta(0)
 {}
 
 channel_t::channel_t(unsigned char pin, bool inverse) :
@@ -149,7 +152,8 @@ channel_t::channel_t(unsigned char pin, bool inverse) :
     inputValue(0),
     value(0),
     target(0),
-    current(0.0)
+    current(0),
+    delta(0)
 {
     pinMode(pin, OUTPUT);
 }
@@ -559,12 +563,35 @@ void _lightAdjustMireds(const char *payload) {
 // PROVIDER
 // -----------------------------------------------------------------------------
 
-unsigned int _toPWM(unsigned int value, bool gamma, bool inverse) {
-    value = constrain(value, Light::VALUE_MIN, Light::VALUE_MAX);
-    if (gamma) value = pgm_read_byte(_light_gamma_table + value);
-    if (Light::VALUE_MAX != Light::PWM_LIMIT) value = _lightMap(value, Light::VALUE_MIN, Light::VALUE_MAX, Light::PWM_MIN, Light::PWM_LIMIT);
-    if (inverse) value = LIGHT_LIMIT_PWM - value;
-    return value;
+constexpr uint32_t _lightQ16(uint32_t value) {
+    return value << 16;
+}
+
+// `value` is Q16 fixed-point, fractional part of the transition value is used for the gamma interpolation
+// and for the PWM ranges wider than the value range (e.g. dimmer's 10000)
+unsigned int _toPWM(uint32_t value, bool gamma, bool inverse) {
+    constexpr uint32_t Min = _lightQ16(Light::VALUE_MIN);
+    constexpr uint32_t Max = _lightQ16(Light::VALUE_MAX);
+    constexpr uint32_t Range = Light::PWM_LIMIT - Light::PWM_MIN;
+    static_assert(Range < 65536, "PWM range must fit into 16 bits");
+
+    value = constrain(value, Min, Max);
+
+    // 0...65535 output level
+    uint32_t level;
+    if (gamma) {
+        const uint32_t index = value >> 16;
+        const uint32_t fraction = value & 0xffff;
+        const uint32_t low = pgm_read_word(_light_gamma_table + index);
+        const uint32_t high = (index < static_cast<uint32_t>(Light::VALUE_MAX)) ? pgm_read_word(_light_gamma_table + index + 1) : low;
+        level = low + (((high - low) * fraction) >> 16);
+    } else {
+        level = std::min<uint32_t>((value - Min) / static_cast<uint32_t>(Light::VALUE_MAX - Light::VALUE_MIN), 65535u);
+    }
+
+    unsigned int pwm = Light::PWM_MIN + ((level * Range) + 32767) / 65535;
+    if (inverse) pwm = LIGHT_LIMIT_PWM - pwm;
+    return pwm;
 }
 
 // Returns a PWM value for the given channel ID
@@ -573,27 +600,48 @@ unsigned int _toPWM(unsigned char id) {
     return _toPWM(_light_channels[id].current, useGamma, _light_channels[id].inverse);
 }
 
-void _lightTransition(unsigned long step) {
+void _lightTransitionTick() {
+    _light_provider_update = true;
+}
+
+// Deltas are calculated once, every step only adds them. Last step sets the target value,
+// so there are no rounding errors left. Changes during the transition start from the current value.
+void _lightTransitionStart(unsigned long steps) {
+
+    _light_transition_steps = steps ? steps : 1;
 
-    // Transitions based on current step. If step == 0, then it is the last transition
     for (auto& channel : _light_channels) {
-        if (!step) {
-            channel.current = channel.target;
-        } else {
-            channel.current += (double) (channel.target - channel.current) / (step + 1);
-        }
+        const int32_t distance = static_cast<int32_t>(_lightQ16(channel.target)) - static_cast<int32_t>(channel.current);
+        channel.delta = distance / static_cast<int32_t>(_light_transition_steps);
     }
 
+    _light_transition_ticker.attach_ms(LIGHT_TRANSITION_STEP, _lightTransitionTick);
+
 }
 
-void _lightProviderScheduleUpdate(unsigned long steps);
+void _lightTransition() {
+
+    if (_light_transition_steps > 1) {
+        --_light_transition_steps;
+        for (auto& channel : _light_channels) {
+            channel.current += channel.delta;
+        }
+        return;
+    }
 
-void _lightProviderUpdate(unsigned long steps) {
+    _light_transition_steps = 0;
+    _light_transition_ticker.detach();
 
-    if (_light_provider_update) return;
-    _light_provider_update = true;
+    for (auto& channel : _light_channels) {
+        channel.current = _lightQ16(channel.target);
+        channel.delta = 0;
+    }
+
+}
 
-    _lightTransition(--steps);
+void _lightProviderUpdate() {
+
+    _lightTransition();
 
     #if LIGHT_PROVIDER == LIGHT_PROVIDER_MY92XX
 
@@ -614,15 +662,18 @@ void _lightProviderUpdate(unsigned long steps) {
 
     #endif
 
-    // This is not the final value, update again
-    if (steps) _light_transition_ticker.once_ms(LIGHT_TRANSITION_STEP, _lightProviderScheduleUpdate, steps);
+}
+
+// Ticker only sets the flag, provider is updated from the main loop
+void _lightProviderLoop() {
 
+    if (!_light_provider_update) return;
     _light_provider_update = false;
 
-}
+    if (_light_transition_steps) {
+        _lightProviderUpdate();
+    }
 
-void _lightProviderScheduleUpdate(unsigned long steps) {
-    schedule_function(std::bind(_lightProviderUpdate, steps));
 }
 
 // -----------------------------------------------------------------------------
@@ -689,9 +740,54 @@ void _lightRestoreSettings() {
 // -----------------------------------------------------------------------------
 
 #if MQTT_SUPPORT
-void _lightMQTTCallback(unsigned int type, const char * topic, const char * payload) {
+void _lightMQTTGroupColor(const mqtt::match_t&, const char * payload) {
+    lightColor(payload, true);
+    lightUpdate(true, mqttForward(), false);
+}
 
-    String mqtt_group_color = getSetting("mqttGroupColor");
+// Color temperature in mireds
+void _lightMQTTMireds(const mqtt::match_t&, const char * payload) {
+    _lightAdjustMireds(payload);
+    lightUpdate(true, mqttForward());
+}
+
+// Color temperature in kelvins
+void _lightMQTTKelvin(const mqtt::match_t&, const char * payload) {
+    _lightAdjustKelvin(payload);
+    lightUpdate(true, mqttForward());
+}
+
+void _lightMQTTColorRGB(const mqtt::match_t&, const char * payload) {
+    lightColor(payload, true);
+    lightUpdate(true, mqttForward());
+}
+
+void _lightMQTTColorHSV(const mqtt::match_t&, const char * payload) {
+    lightColor(payload, false);
+    lightUpdate(true, mqttForward());
+}
+
+void _lightMQTTBrightness(const mqtt::match_t&, const char * payload) {
+    _lightAdjustBrightness(payload);
+    lightUpdate(true, mqttForward());
+}
+
+void _lightMQTTTransition(const mqtt::match_t&, const char * payload) {
+    lightTransitionTime(atol(payload));
+}
+
+// magnitude is channel/<channel id>
+void _lightMQTTChannel(const mqtt::match_t& match, const char * payload) {
+    unsigned int channelID;
+    if (!match.number(0, channelID) || (channelID >= _light_channels.size())) {
+        DEBUG_MSG_P(PSTR("[LIGHT] Wrong channelID (%s)\n"), match.topic);
+        return;
+    }
+    _lightAdjustChannel(channelID, payload);
+    lightUpdate(true, mqttForward());
+}
+
+void _lightMQTTCallback(unsigned int type, const char * topic, const char * payload) {
 
     if (type == MQTT_CONNECT_EVENT) {
 
@@ -708,8 +804,13 @@ void _lightMQTTCallback(unsigned int type, const char * topic, const char * payl
             mqttSubscribe(MQTT_TOPIC_KELVIN);
         }
 
-        // Group color
-        if (mqtt_group_color.length() > 0) mqttSubscribeRaw(mqtt_group_color.c_str());
+        // Group color, which could have changed since the last time
+        mqttUnregisterTopics(_lightMQTTGroupColor);
+        const String mqtt_group_color = getSetting("mqttGroupColor");
+        if (mqtt_group_color.length() > 0) {
+            mqttSubscribeRaw(mqtt_group_color.c_str());
+            mqttRegisterRawTopic(mqtt_group_color.c_str(), _lightMQTTGroupColor);
+        }
 
         // Channels
         char buffer[strlen(MQTT_TOPIC_CHANNEL) + 3];
@@ -718,71 +819,17 @@ void _lightMQTTCallback(unsigned int type, const char * topic, const char * payl
 
     }
 
-    if (type == MQTT_MESSAGE_EVENT) {
-
-        // Group color
-        if ((mqtt_group_color.length() > 0) && (mqtt_group_color.equals(topic))) {
-            lightColor(payload, true);
-            lightUpdate(true, mqttForward(), false);
-            return;
-        }
-
-        // Match topic
-        String t = mqttMagnitude((char *) topic);
-
-        // Color temperature in mireds
-        if (t.equals(MQTT_TOPIC_MIRED)) {
-            _lightAdjustMireds(payload);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-
-        // Color temperature in kelvins
-        if (t.equals(MQTT_TOPIC_KELVIN)) {
-            _lightAdjustKelvin(payload);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-
-        // Color
-        if (t.equals(MQTT_TOPIC_COLOR_RGB)) {
-            lightColor(payload, true);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-        if (t.equals(MQTT_TOPIC_COLOR_HSV)) {
-            lightColor(payload, false);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-
-        // Brightness
-        if (t.equals(MQTT_TOPIC_BRIGHTNESS)) {
-            _lightAdjustBrightness(payload);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-
-        // Transitions
-        if (t.equals(MQTT_TOPIC_TRANSITION)) {
-            lightTransitionTime(atol(payload));
-            return;
-        }
-
-        // Channel
-        if (t.startsWith(MQTT_TOPIC_CHANNEL)) {
-            unsigned int channelID = t.substring(strlen(MQTT_TOPIC_CHANNEL)+1).toInt();
-            if (channelID >= _light_channels.size()) {
-                DEBUG_MSG_P(PSTR("[LIGHT] Wrong channelID (%d)\n"), channelID);
-                return;
-            }
-            _lightAdjustChannel(channelID, payload);
-            lightUpdate(true, mqttForward());
-            return;
-        }
-
-    }
+}
 
+void _lightMQTTSetup() {
+    mqttRegister(_lightMQTTCallback);
+    mqttRegisterTopic(MQTT_TOPIC_MIRED, _lightMQTTMireds);
+    mqttRegisterTopic(MQTT_TOPIC_KELVIN, _lightMQTTKelvin);
+    mqttRegisterTopic(MQTT_TOPIC_COLOR_RGB, _lightMQTTColorRGB);
+    mqttRegisterTopic(MQTT_TOPIC_COLOR_HSV, _lightMQTTColorHSV);
+    mqttRegisterTopic(MQTT_TOPIC_BRIGHTNESS, _lightMQTTBrightness);
+    mqttRegisterTopic(MQTT_TOPIC_TRANSITION, _lightMQTTTransition);
+    mqttRegisterTopic(MQTT_TOPIC_CHANNEL "/+", _lightMQTTChannel);
 }
 
 void lightMQTT() {
@@ -1150,7 +1197,7 @@ void lightUpdate(bool save, bool forward, bool group_forward) {
     // Channel transition will be handled by the provider function
     // User can configure total transition time, step time is a fixed value
     const unsigned long steps = _light_use_transitions ? _light_transition_time / LIGHT_TRANSITION_STEP : 1;
-    _light_transition_ticker.once_ms(LIGHT_TRANSITION_STEP, _lightProviderScheduleUpdate, steps);
+    _lightTransitionStart(steps);
 
     // Delay every communication 100ms to avoid jamming
     const unsigned char mask =
@@ -1425,7 +1472,7 @@ void lightSetup() {
     #endif
 
     #if MQTT_SUPPORT
-        mqttRegister(_lightMQTTCallback);
+        _lightMQTTSetup();
     #endif
 
     #if TERMINAL_SUPPORT
@@ -1439,6 +1486,7 @@ void lightSetup() {
         #endif
         _lightConfigure();
     });
+    espurnaRegisterLoop(_lightProviderLoop, PSTR("light"));
 
 }
 
@@ -44,6 +44,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "nofuss.h"
 #include "ntp.h"
 #include "ota.h"
+#include "profiler.h"
 #include "relay.h"
 #include "rfbridge.h"
 #include "rfm69.h"
@@ -65,15 +66,47 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 std::vector<void_callback_f> _loop_callbacks;
 std::vector<void_callback_f> _reload_callbacks;
 
+#if PROFILER_SUPPORT
+std::vector<profiler::stats_t*> _loop_callbacks_stats;
+#endif
+
 bool _reload_config = false;
 unsigned long _loop_delay = 0;
 
+// -----------------------------------------------------------------------------
+// TASKS
+// -----------------------------------------------------------------------------
+
+struct loop_task_t {
+    void_callback_f callback;
+    unsigned long interval;
+    unsigned long start;
+    unsigned long delay;
+    unsigned char priority;
+    bool armed;
+    #if PROFILER_SUPPORT
+        profiler::stats_t* stats;
+    #endif
+};
+
+std::vector<loop_task_t> _loop_tasks;
+
+// Task IDs, sorted by priority
+std::vector<espurna_task_t> _loop_tasks_order;
+
+// Nothing is due until `_loop_tasks_wait` ms have passed since `_loop_tasks_checked`
+unsigned long _loop_tasks_checked = 0;
+unsigned long _loop_tasks_wait = std::numeric_limits<unsigned long>::max();
+
 // -----------------------------------------------------------------------------
 // GENERAL CALLBACKS
 // -----------------------------------------------------------------------------
 
-void espurnaRegisterLoop(void_callback_f callback) {
+void espurnaRegisterLoop(void_callback_f callback, const char* name) {
     _loop_callbacks.push_back(callback);
+    #if PROFILER_SUPPORT
+        _loop_callbacks_stats.push_back(profiler::add("loop", name, reinterpret_cast<const void*>(callback)));
+    #endif
 }
 
 void espurnaRegisterReload(void_callback_f callback) {
@@ -94,6 +127,92 @@ unsigned long espurnaLoopDelay() {
     return _loop_delay;
 }
 
+espurna_task_t espurnaRegisterTask(void_callback_f callback, const char* name, unsigned long interval, unsigned char priority) {
+    if (_loop_tasks.size() >= EspurnaTaskNone) return EspurnaTaskNone;
+
+    const auto task = static_cast<espurna_task_t>(_loop_tasks.size());
+    #if PROFILER_SUPPORT
+        _loop_tasks.push_back({callback, interval, millis(), interval, priority, interval > 0,
+            profiler::add("task", name, reinterpret_cast<const void*>(callback), task)});
+    #else
+        _loop_tasks.push_back({callback, interval, millis(), interval, priority, interval > 0});
+    #endif
+
+    auto it = std::find_if(_loop_tasks_order.begin(), _loop_tasks_order.end(), [priority](espurna_task_t other) {
+        return _loop_tasks[other].priority < priority;
+    });
+    _loop_tasks_order.insert(it, task);
+
+    _loop_tasks_wait = 0;
+    return task;
+}
+
+void espurnaTaskSchedule(espurna_task_t task, unsigned long delay) {
+    if (task >= _loop_tasks.size()) return;
+    auto& ref = _loop_tasks[task];
+    ref.start = millis();
+    ref.delay = delay;
+    ref.armed = true;
+    _loop_tasks_wait = 0;
+}
+
+void espurnaTaskInterval(espurna_task_t task, unsigned long interval) {
+    if (task >= _loop_tasks.size()) return;
+    _loop_tasks[task].interval = interval;
+    if (interval) {
+        espurnaTaskSchedule(task, interval);
+    }
+}
+
+void espurnaTaskCancel(espurna_task_t task) {
+    if (task >= _loop_tasks.size()) return;
+    _loop_tasks[task].armed = false;
+}
+
+void _espurnaTasks() {
+
+    if (_loop_tasks.empty()) return;
+    if (millis() - _loop_tasks_checked < _loop_tasks_wait) return;
+
+    // Note: callbacks are allowed to register new tasks, do not hold any references
+    for (size_t index = 0; index < _loop_tasks_order.size(); ++index) {
+        auto& task = _loop_tasks[_loop_tasks_order[index]];
+        if (!task.armed) continue;
+        if (millis() - task.start < task.delay) continue;
+
+        // Re-arm before calling, task can re-schedule or cancel itself
+        if (task.interval) {
+            task.start = millis();
+            task.delay = task.interval;
+        } else {
+            task.armed = false;
+        }
+
+        #if PROFILER_SUPPORT
+            profiler::Measure measure(task.stats);
+        #endif
+        task.callback();
+    }
+
+    // Remember when the next task is due, so we don't have to check every one of them each loop
+    unsigned long wait = std::numeric_limits<unsigned long>::max();
+    const auto now = millis();
+    for (const auto& task : _loop_tasks) {
+        if (!task.armed) continue;
+        const auto elapsed = now - task.start;
+        wait = std::min(wait, (elapsed < task.delay) ? (task.delay - elapsed) : 0ul);
+    }
+
+    _loop_tasks_checked = now;
+    _loop_tasks_wait = wait;
+
+}
+
+unsigned long _espurnaTasksWait() {
+    const auto elapsed = millis() - _loop_tasks_checked;
+    return (elapsed < _loop_tasks_wait) ? (_loop_tasks_wait - elapsed) : 0;
+}
+
 // -----------------------------------------------------------------------------
 // BOOTING
 // -----------------------------------------------------------------------------
@@ -295,6 +414,9 @@ void setup() {
     #if KINGART_CURTAIN_SUPPORT
         kingartCurtainSetup();
     #endif
+    #if PROFILER_SUPPORT
+        profilerSetup();
+    #endif
 
     // 3rd party code hook
     #if USE_EXTRA
@@ -324,10 +446,19 @@ void loop() {
 
     // Call registered loop callbacks
     for (unsigned char i = 0; i < _loop_callbacks.size(); i++) {
+        #if PROFILER_SUPPORT
+            profiler::Measure measure(_loop_callbacks_stats[i]);
+        #endif
         (_loop_callbacks[i])();
     }
 
-    // Power saving delay
-    if (_loop_delay) delay(_loop_delay);
+    // Call tasks that are due
+    _espurnaTasks();
+
+    // Power saving delay, but never past the next task deadline
+    if (_loop_delay) {
+        const auto wait = std::min(_loop_delay, _espurnaTasksWait());
+        if (wait) delay(wait);
+    }
 
 }
@@ -155,6 +155,23 @@ void MCP23S08SetPin(uint8_t pinNumber, bool state)
     MCP23S08WriteRegister(OLAT, registerData);
 }
 
+/**
+ * @brief Set expander MCP23S08 state of multiple pins with a single register write.
+ *
+ * @param mask Pins to be set.
+ * @param state The pin states, bit per pin.
+ *
+ * @return void
+ */
+void MCP23S08SetPins(uint8_t mask, uint8_t state)
+{
+    uint8_t registerData = MCP23S08ReadRegister(OLAT);
+
+    registerData = (registerData & ~mask) | (state & mask);
+
+    MCP23S08WriteRegister(OLAT, registerData);
+}
+
 /**
  * @brief Get MCP23S08 pin state.
  *
@@ -37,6 +37,7 @@ void MCP23S08WriteRegister(uint8_t address, uint8_t data);
 
 void MCP23S08SetDirection(uint8_t pinNumber, uint8_t mode);
 void MCP23S08SetPin(uint8_t pinNumber, bool state);
+void MCP23S08SetPins(uint8_t mask, uint8_t state);
 bool MCP23S08GetPin(uint8_t pinNumber);
 
 bool mcpGpioValid(unsigned char gpio);
@@ -127,7 +127,7 @@ String mdnsResolve(String name) {
 void mdnsClientSetup() {
 
     // Register loop
-    espurnaRegisterLoop(mdnsClientLoop);
+    espurnaRegisterLoop(mdnsClientLoop, PSTR("mdns"));
 
 }
 
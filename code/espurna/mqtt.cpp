@@ -11,9 +11,10 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 
 #if MQTT_SUPPORT
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <utility>
-#include <Ticker.h>
 
 #include "system.h"
 #include "mdns.h"
@@ -26,6 +27,16 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #include "libs/AsyncClientHelpers.h"
 #include "libs/SecureClientHelpers.h"
 
+#include "mqtt_pipeline.h"
+
+#if MQTT_OUTBOX_SUPPORT
+#include "mqtt_outbox.h"
+#endif
+
+#if MQTT_OUTBOX_SPIFFS
+#include <FS.h>
+#endif
+
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
     AsyncMqttClient _mqtt;
@@ -85,14 +96,91 @@ String _mqtt_payload_offline;
 
 std::vector<mqtt_callback_f> _mqtt_callbacks;
 
+mqtt::TopicTrie _mqtt_topics;
+mqtt::TopicTrie _mqtt_raw_topics;
+
+// Parts of the `<root>/#<setter>` around the magnitude, see mqttMagnitude()
+String _mqtt_magnitude_prefix;
+String _mqtt_magnitude_suffix;
+
+// Queued messages are linked with their parent (or the root), so the JSON payload
+// can be written with a single pass over the queue. Strings are stored in the arena.
 struct mqtt_message_t {
     static const unsigned char END = 255;
+    static const uint16_t NONE = 0xFFFF;
     unsigned char parent = END;
-    char * topic;
-    char * message = NULL;
+    unsigned char child = END;      // first child
+    unsigned char last = END;       // last child
+    unsigned char next = END;       // next sibling
+    uint16_t topic = NONE;          // arena offsets
+    uint16_t message = NONE;
 };
-std::vector<mqtt_message_t> _mqtt_queue;
-Ticker _mqtt_flush_ticker;
+
+static_assert(MQTT_QUEUE_MAX_SIZE < mqtt_message_t::END, "MQTT_QUEUE_MAX_SIZE is too big");
+static_assert(MQTT_QUEUE_ARENA_SIZE < mqtt_message_t::NONE, "MQTT_QUEUE_ARENA_SIZE is too big");
+
+mqtt_message_t _mqtt_queue[MQTT_QUEUE_MAX_SIZE];
+unsigned char _mqtt_queue_size = 0;
+unsigned char _mqtt_queue_first = mqtt_message_t::END;
+unsigned char _mqtt_queue_last = mqtt_message_t::END;
+
+// Allocated once, when the first message is queued
+std::unique_ptr<char[]> _mqtt_queue_arena;
+size_t _mqtt_queue_arena_used = 0;
+
+// Flush is delayed until no new messages were queued for MQTT_USE_JSON_DELAY. It's a task instead of the Ticker,
+// so the pipeline is only ever touched from the loop and never while the client is in the middle of sending
+espurna_task_t _mqtt_flush_task = EspurnaTaskNone;
+
+// Everything sent while connected goes through the pipeline first. Messages are published from the loop,
+// as many as the client accepts in a single run, so the TCP stack is able to merge them into fewer segments.
+// When client refuses to send (not enough space in the TCP window or the client buffer), we try again a bit later.
+
+mqtt::Pipeline _mqtt_pipeline(MQTT_PIPELINE_SIZE, MQTT_PIPELINE_BYTES);
+espurna_task_t _mqtt_pipeline_task = EspurnaTaskNone;
+size_t _mqtt_pipeline_retries = 0;
+
+void _mqttPipelineOnDisconnect();
+void _mqttPipelineInfo();
+
+#if MQTT_OUTBOX_SUPPORT
+
+// Messages that could not be sent are replayed after connecting, oldest first.
+// Optionally, messages that no longer fit into the RAM are moved to the SPIFFS file.
+
+#if MQTT_OUTBOX_SPIFFS
+void _mqttOutboxSpill(const mqtt::Outbox::entry_t& entry);
+mqtt::Outbox _mqtt_outbox(MQTT_OUTBOX_SIZE, _mqttOutboxSpill);
+
+const char _mqtt_outbox_file_name[] = "/mqtt_outbox";
+size_t _mqtt_outbox_file_size = 0;
+size_t _mqtt_outbox_file_offset = 0;
+size_t _mqtt_outbox_file_dropped = 0;
+#else
+mqtt::Outbox _mqtt_outbox(MQTT_OUTBOX_SIZE);
+#endif
+
+espurna_task_t _mqtt_outbox_task = EspurnaTaskNone;
+unsigned long _mqtt_outbox_interval = 1000 / MQTT_OUTBOX_REPLAY_RATE;
+bool _mqtt_outbox_timestamp = (1 == MQTT_OUTBOX_TIMESTAMP);
+
+// With QoS > 0 (and only the AsyncMqttClient reports that), the entry is removed after broker acknowledges it
+bool _mqtt_outbox_waiting = false;
+bool _mqtt_outbox_from_file = false;
+size_t _mqtt_outbox_removed = 0;
+uint16_t _mqtt_outbox_packet = 0;
+volatile bool _mqtt_outbox_acked = false;
+
+// Hashes of the topics sent directly while the outbox still has something to replay.
+// Older messages of these topics are not replayed, so they don't replace the current (retained) value
+std::vector<uint32_t> _mqtt_outbox_live;
+
+bool _mqttOutboxPush(const char* topic, const char* message, bool retain);
+size_t _mqttOutboxPending();
+void _mqttOutboxLive(const char* topic);
+void _mqttOutboxInfo();
+
+#endif // MQTT_OUTBOX_SUPPORT
 
 // -----------------------------------------------------------------------------
 // Private
@@ -294,6 +382,14 @@ void _mqttConfigure() {
         _mqttApplySetting(_mqtt_forward, forward);
     }
 
+    // Incoming messages are matched against these
+    {
+        const String pattern = _mqtt_topic + _mqtt_setter;
+        const int position = pattern.indexOf("#");
+        _mqtt_magnitude_prefix = pattern.substring(0, position);
+        _mqtt_magnitude_suffix = pattern.substring(position + 1);
+    }
+
     // MQTT options
     {
         String user = getSetting("mqttUser", MQTT_USER);
@@ -481,6 +577,10 @@ void _mqttInitCommands() {
 
     terminalRegisterCommand(F("MQTT.INFO"), [](const terminal::CommandContext&) {
         _mqttInfo();
+        _mqttPipelineInfo();
+        #if MQTT_OUTBOX_SUPPORT
+            _mqttOutboxInfo();
+        #endif
         terminalOK();
     });
 
@@ -536,6 +636,10 @@ void _mqttOnConnect() {
         callback(MQTT_CONNECT_EVENT, nullptr, nullptr);
     }
 
+    #if MQTT_OUTBOX_SUPPORT
+        _mqttOutboxOnConnect();
+    #endif
+
 }
 
 void _mqttOnDisconnect() {
@@ -547,6 +651,12 @@ void _mqttOnDisconnect() {
 
     DEBUG_MSG_P(PSTR("[MQTT] Disconnected!\n"));
 
+    _mqttPipelineOnDisconnect();
+
+    #if MQTT_OUTBOX_SUPPORT
+        _mqttOutboxOnDisconnect();
+    #endif
+
     // Notify all subscribers about the disconnect
     for (auto& callback : _mqtt_callbacks) {
         callback(MQTT_DISCONNECT_EVENT, nullptr, nullptr);
@@ -568,6 +678,42 @@ bool _mqttMaybeSkipRetained(char* topic) {
     return false;
 }
 
+// Length of the magnitude part, or -1 when topic does not match the `<root>/#<setter>`
+int _mqttMagnitudeLength(const char * topic, size_t length) {
+
+    const size_t prefix = _mqtt_magnitude_prefix.length();
+    const size_t suffix = _mqtt_magnitude_suffix.length();
+
+    if (length < (prefix + suffix)) return -1;
+    if (strncmp(topic, _mqtt_magnitude_prefix.c_str(), prefix) != 0) return -1;
+    if (strcmp(topic + length - suffix, _mqtt_magnitude_suffix.c_str()) != 0) return -1;
+
+    return length - prefix - suffix;
+
+}
+
+// Modules registered with mqttRegisterTopic() / mqttRegisterRawTopic() only receive matching messages,
+// everything else is still passed to every mqttRegister() callback
+
+void _mqttDispatch(char* topic, char* message) {
+
+    _mqtt_raw_topics.match(topic, message);
+
+    const size_t topic_length = strlen(topic);
+    const int length = _mqttMagnitudeLength(topic, topic_length);
+    if (length > 0) {
+        char magnitude[length + 1];
+        memcpy(magnitude, topic + _mqtt_magnitude_prefix.length(), length);
+        magnitude[length] = '\0';
+        _mqtt_topics.match(magnitude, message);
+    }
+
+    for (auto& callback : _mqtt_callbacks) {
+        callback(MQTT_MESSAGE_EVENT, topic, message);
+    }
+
+}
+
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
 // MQTT Broker can sometimes send messages in bulk. Even when message size is less than MQTT_BUFFER_MAX_SIZE, we *could*
@@ -593,9 +739,7 @@ void _mqttOnMessageAsync(char* topic, char* payload, AsyncMqttClientMessagePrope
     DEBUG_MSG_P(PSTR("[MQTT] Received %s => %s\n"), topic, message);
 
     // Call subscribers with the message buffer
-    for (auto& callback : _mqtt_callbacks) {
-        callback(MQTT_MESSAGE_EVENT, topic, message);
-    }
+    _mqttDispatch(topic, message);
 
 }
 
@@ -616,9 +760,7 @@ void _mqttOnMessage(char* topic, char* payload, unsigned int len) {
     DEBUG_MSG_P(PSTR("[MQTT] Received %s => %s\n"), topic, message);
 
     // Call subscribers with the message buffer
-    for (auto& callback : _mqtt_callbacks) {
-        callback(MQTT_MESSAGE_EVENT, topic, message);
-    }
+    _mqttDispatch(topic, message);
 
 }
 
@@ -636,21 +778,14 @@ void _mqttOnMessage(char* topic, char* payload, unsigned int len) {
 */
 String mqttMagnitude(char * topic) {
 
-    String pattern = _mqtt_topic + _mqtt_setter;
-    int position = pattern.indexOf("#");
-    if (position == -1) return String();
-    String start = pattern.substring(0, position);
-    String end = pattern.substring(position + 1);
+    const int length = _mqttMagnitudeLength(topic, strlen(topic));
+    if (length <= 0) return String();
 
-    String magnitude = String(topic);
-    if (magnitude.startsWith(start) && magnitude.endsWith(end)) {
-        magnitude.replace(start, "");
-        magnitude.replace(end, "");
-    } else {
-        magnitude = String();
-    }
+    char buffer[length + 1];
+    memcpy(buffer, topic + _mqtt_magnitude_prefix.length(), length);
+    buffer[length] = '\0';
 
-    return magnitude;
+    return String(buffer);
 
 }
 
@@ -686,9 +821,9 @@ String mqttTopic(const char * magnitude, unsigned int index, bool is_set) {
 
 // -----------------------------------------------------------------------------
 
-bool mqttSendRaw(const char * topic, const char * message, bool retain) {
+uint16_t _mqttPublish(const char * topic, const char * message, bool retain) {
 
-    if (!_mqtt.connected()) return false;
+    if (!_mqtt.connected()) return 0;
 
     const unsigned int packetId(
         #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
@@ -707,7 +842,73 @@ bool mqttSendRaw(const char * topic, const char * message, bool retain) {
         DEBUG_MSG_P(PSTR("[MQTT] Sending %s => %s (PID %u)\n"), topic, message, packetId);
     }
 
-    return (packetId > 0);
+    return packetId;
+
+}
+
+void _mqttPipelineFlush() {
+
+    if (!_mqtt.connected()) return;
+
+    size_t sent = 0;
+    mqtt::Pipeline::entry_t entry;
+    while (_mqtt_pipeline.front(entry)) {
+        if (!_mqttPublish(entry.topic, entry.message, entry.retain)) break;
+        _mqtt_pipeline.pop();
+        ++sent;
+    }
+
+    if (_mqtt_pipeline.size()) {
+        if (!sent) ++_mqtt_pipeline_retries;
+        espurnaTaskSchedule(_mqtt_pipeline_task, sent ? 0 : MQTT_PIPELINE_RETRY);
+    }
+
+}
+
+// Whatever was not sent yet is kept in the outbox
+void _mqttPipelineOnDisconnect() {
+    #if MQTT_OUTBOX_SUPPORT
+        mqtt::Pipeline::entry_t entry;
+        while (_mqtt_pipeline.front(entry)) {
+            _mqttOutboxPush(entry.topic, entry.message, entry.retain);
+            _mqtt_pipeline.pop();
+        }
+    #endif
+    _mqtt_pipeline.clear();
+    espurnaTaskCancel(_mqtt_pipeline_task);
+}
+
+void _mqttPipelineInfo() {
+    DEBUG_MSG_P(PSTR("[MQTT] Pipeline: %u / %u message(s), %u / %u bytes, %u coalesced, %u retries\n"),
+        _mqtt_pipeline.size(), _mqtt_pipeline.capacity(),
+        _mqtt_pipeline.bytes(), MQTT_PIPELINE_BYTES,
+        _mqtt_pipeline.coalesced(), _mqtt_pipeline_retries);
+}
+
+// Returns `false` when message could not be queued, e.g. when the pipeline is still full after trying to send something.
+bool mqttSendRaw(const char * topic, const char * message, bool retain) {
+
+    if (!_mqtt.connected()) return false;
+
+    #if MQTT_OUTBOX_SUPPORT
+        _mqttOutboxLive(topic);
+    #endif
+
+    if (!_mqtt_pipeline.push(topic, message, retain)) {
+        _mqttPipelineFlush();
+
+        // Message is too big for the pipeline, send it directly
+        if (!_mqtt_pipeline.size()) {
+            return _mqttPublish(topic, message, retain) > 0;
+        }
+
+        if (!_mqtt_pipeline.push(topic, message, retain)) {
+            return false;
+        }
+    }
+
+    espurnaTaskSchedule(_mqtt_pipeline_task);
+    return true;
 
 }
 
@@ -723,15 +924,28 @@ void mqttSend(const char * topic, const char * message, bool force, bool retain)
     // Equeue message
     if (useJson) {
 
+        // Nothing to group while disconnected, keep it in the outbox instead
+        #if MQTT_OUTBOX_SUPPORT
+            if (!_mqtt.connected()) {
+                _mqttOutboxPush(mqttTopic(topic, false).c_str(), message, retain);
+                return;
+            }
+        #endif
+
         // Enqueue new message
         mqttEnqueue(topic, message);
 
         // Reset flush timer
-        _mqtt_flush_ticker.once_ms(MQTT_USE_JSON_DELAY, mqttFlush);
+        espurnaTaskSchedule(_mqtt_flush_task, MQTT_USE_JSON_DELAY);
 
     // Send it right away
     } else {
-        mqttSendRaw(mqttTopic(topic, false).c_str(), message, retain);
+        const String full_topic = mqttTopic(topic, false);
+        if (!mqttSendRaw(full_topic.c_str(), message, retain)) {
+            #if MQTT_OUTBOX_SUPPORT
+                _mqttOutboxPush(full_topic.c_str(), message, retain);
+            #endif
+        }
 
     }
 
@@ -761,80 +975,220 @@ void mqttSend(const char * topic, unsigned int index, const char * message) {
 
 // -----------------------------------------------------------------------------
 
-unsigned char _mqttBuildTree(JsonObject& root, char parent) {
-
-    unsigned char count = 0;
-
-    // Add enqueued messages
-    for (unsigned char i=0; i<_mqtt_queue.size(); i++) {
-        mqtt_message_t element = _mqtt_queue[i];
-        if (element.parent == parent) {
-            ++count;
-            JsonObject& elements = root.createNestedObject(element.topic);
-            unsigned char num = _mqttBuildTree(elements, i);
-            if (0 == num) {
-                if (isNumber(element.message)) {
-                    double value = atof(element.message);
-                    if (value == int(value)) {
-                        root.set(element.topic, int(value));
-                    } else {
-                        root.set(element.topic, value);
-                    }
+// Writes JSON into the buffer, or only counts the number of bytes when there is none
+
+class MqttJsonWriter {
+    public:
+        MqttJsonWriter(char* buffer, size_t size) :
+            _buffer(buffer),
+            _size(size)
+        {}
+
+        MqttJsonWriter() :
+            MqttJsonWriter(nullptr, 0)
+        {}
+
+        size_t length() const {
+            return _length;
+        }
+
+        void raw(char c) {
+            if (_length < _size) {
+                _buffer[_length] = c;
+            }
+            ++_length;
+        }
+
+        void raw(const char* value) {
+            while (*value) {
+                raw(*value++);
+            }
+        }
+
+        void string(const char* value) {
+            raw('"');
+            for (; *value; ++value) {
+                const auto c = *value;
+                if (('"' == c) || ('\\' == c)) {
+                    raw('\\');
+                    raw(c);
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[7];
+                    snprintf_P(buffer, sizeof(buffer), PSTR("\\u%04x"), c);
+                    raw(buffer);
                 } else {
-                    root.set(element.topic, element.message);
+                    raw(c);
                 }
             }
+            raw('"');
+        }
+
+        // Same rules as the isNumber(), but JSON does not allow leading '+' and zeroes
+        void number(const char* value) {
+            const double parsed = atof(value);
+            if (parsed == int(parsed)) {
+                char buffer[16];
+                snprintf_P(buffer, sizeof(buffer), PSTR("%d"), int(parsed));
+                raw(buffer);
+                return;
+            }
+
+            if ('+' == *value) {
+                ++value;
+            } else if ('-' == *value) {
+                raw(*value++);
+            }
+
+            while (('0' == value[0]) && isdigit(value[1])) {
+                ++value;
+            }
+
+            raw(value);
+        }
+
+        void key(const char* value) {
+            separator();
+            string(value);
+            raw(':');
+        }
+
+        void begin() {
+            raw('{');
+            _first = true;
+        }
+
+        void end() {
+            raw('}');
+            _first = false;
+        }
+
+    private:
+        void separator() {
+            if (!_first) {
+                raw(',');
+            }
+            _first = false;
+        }
+
+        char* _buffer;
+        size_t _size;
+        size_t _length { 0 };
+        bool _first { true };
+};
+
+const char* _mqttArena(uint16_t offset) {
+    return &_mqtt_queue_arena[offset];
+}
+
+void _mqttWriteQueue(MqttJsonWriter& writer, unsigned char index) {
+    for (; index != mqtt_message_t::END; index = _mqtt_queue[index].next) {
+        const auto& element = _mqtt_queue[index];
+        writer.key(_mqttArena(element.topic));
+        if (element.child != mqtt_message_t::END) {
+            writer.begin();
+            _mqttWriteQueue(writer, element.child);
+            writer.end();
+        } else if (element.message == mqtt_message_t::NONE) {
+            writer.raw("null");
+        } else {
+            const char* message = _mqttArena(element.message);
+            if (isNumber(message)) {
+                writer.number(message);
+            } else {
+                writer.string(message);
+            }
         }
     }
+}
+
+struct mqtt_json_extra_t {
+    const char* key;
+    String value;
+};
+
+void _mqttWritePayload(MqttJsonWriter& writer, const std::vector<mqtt_json_extra_t>& extra, unsigned long message_id) {
+    writer.begin();
+    _mqttWriteQueue(writer, _mqtt_queue_first);
+
+    for (const auto& property : extra) {
+        writer.key(property.key);
+        writer.string(property.value.c_str());
+    }
+
+    #if MQTT_ENQUEUE_MESSAGE_ID
+        char buffer[16];
+        snprintf_P(buffer, sizeof(buffer), PSTR("%lu"), message_id);
+        writer.key(MQTT_TOPIC_MESSAGE_ID);
+        writer.raw(buffer);
+    #endif
 
-    return count;
+    writer.end();
+}
 
+void _mqttClearQueue() {
+    _mqtt_queue_size = 0;
+    _mqtt_queue_first = mqtt_message_t::END;
+    _mqtt_queue_last = mqtt_message_t::END;
+    _mqtt_queue_arena_used = 0;
 }
 
 void mqttFlush() {
 
     if (!_mqtt.connected()) return;
-    if (_mqtt_queue.size() == 0) return;
-
-    // Build tree recursively
-    DynamicJsonBuffer jsonBuffer(1024);
-    JsonObject& root = jsonBuffer.createObject();
-    _mqttBuildTree(root, mqtt_message_t::END);
+    if (_mqtt_queue_size == 0) return;
 
     // Add extra propeties
+    std::vector<mqtt_json_extra_t> extra;
     #if NTP_SUPPORT && MQTT_ENQUEUE_DATETIME
-        if (ntpSynced()) root[MQTT_TOPIC_TIME] = ntpDateTime();
+        if (ntpSynced()) extra.push_back({MQTT_TOPIC_TIME, ntpDateTime()});
     #endif
     #if MQTT_ENQUEUE_MAC
-        root[MQTT_TOPIC_MAC] = WiFi.macAddress();
+        extra.push_back({MQTT_TOPIC_MAC, WiFi.macAddress()});
     #endif
     #if MQTT_ENQUEUE_HOSTNAME
-        root[MQTT_TOPIC_HOSTNAME] = getSetting("hostname");
+        extra.push_back({MQTT_TOPIC_HOSTNAME, getSetting("hostname")});
     #endif
     #if MQTT_ENQUEUE_IP
-        root[MQTT_TOPIC_IP] = getIP();
+        extra.push_back({MQTT_TOPIC_IP, getIP()});
     #endif
+
+    unsigned long message_id = 0;
     #if MQTT_ENQUEUE_MESSAGE_ID
-        root[MQTT_TOPIC_MESSAGE_ID] = (Rtcmem->mqtt)++;
+        message_id = (Rtcmem->mqtt)++;
     #endif
 
-    // Send
-    String output;
-    root.printTo(output);
-    jsonBuffer.clear();
+    // Measure the payload first, then write it into the buffer of the exact size
+    MqttJsonWriter counter;
+    _mqttWritePayload(counter, extra, message_id);
 
-    mqttSendRaw(_mqtt_topic_json.c_str(), output.c_str(), false);
+    std::unique_ptr<char[]> output(new (std::nothrow) char[counter.length() + 1]);
+    if (output) {
+        MqttJsonWriter writer(output.get(), counter.length());
+        _mqttWritePayload(writer, extra, message_id);
+        output[writer.length()] = '\0';
 
-    // Clear queue
-    for (unsigned char i = 0; i < _mqtt_queue.size(); i++) {
-        mqtt_message_t element = _mqtt_queue[i];
-        free(element.topic);
-        if (element.message) {
-            free(element.message);
-        }
+        mqttSendRaw(_mqtt_topic_json.c_str(), output.get(), false);
+    }
+
+    _mqttClearQueue();
+
+}
+
+uint16_t _mqttArenaStore(const char* value) {
+    const size_t size = strlen(value) + 1;
+    if (_mqtt_queue_arena_used + size > MQTT_QUEUE_ARENA_SIZE) {
+        return mqtt_message_t::NONE;
     }
-    _mqtt_queue.clear();
 
+    const auto offset = _mqtt_queue_arena_used;
+    memcpy(&_mqtt_queue_arena[offset], value, size);
+    _mqtt_queue_arena_used += size;
+
+    return offset;
+}
+
+bool _mqttArenaFits(const char* topic, const char* message) {
+    return (_mqtt_queue_arena_used + strlen(topic) + 1 + (message ? strlen(message) + 1 : 0)) <= MQTT_QUEUE_ARENA_SIZE;
 }
 
 int8_t mqttEnqueue(const char * topic, const char * message, unsigned char parent) {
@@ -843,19 +1197,51 @@ int8_t mqttEnqueue(const char * topic, const char * message, unsigned char paren
     // We must prevent the queue does not get full while offline
     if (!_mqtt.connected()) return -1;
 
-    // Force flusing the queue if the MQTT_QUEUE_MAX_SIZE has been reached
-    if (_mqtt_queue.size() >= MQTT_QUEUE_MAX_SIZE) mqttFlush();
+    if (!_mqtt_queue_arena) {
+        _mqtt_queue_arena.reset(new (std::nothrow) char[MQTT_QUEUE_ARENA_SIZE]);
+        if (!_mqtt_queue_arena) return -1;
+    }
 
-    int8_t index = _mqtt_queue.size();
+    // Force flusing the queue if the MQTT_QUEUE_MAX_SIZE has been reached or there is no more space for the strings
+    if ((_mqtt_queue_size >= MQTT_QUEUE_MAX_SIZE) || !_mqttArenaFits(topic, message)) {
+        mqttFlush();
+        if (!_mqttArenaFits(topic, message)) return -1;
+    }
+
+    if ((parent != mqtt_message_t::END) && (parent >= _mqtt_queue_size)) {
+        parent = mqtt_message_t::END;
+    }
+
+    // Same topic is only sent once, using the latest message
+    unsigned char index = (parent == mqtt_message_t::END) ? _mqtt_queue_first : _mqtt_queue[parent].child;
+    for (; index != mqtt_message_t::END; index = _mqtt_queue[index].next) {
+        auto& element = _mqtt_queue[index];
+        if (strcmp(_mqttArena(element.topic), topic) == 0) {
+            element.message = message ? _mqttArenaStore(message) : mqtt_message_t::NONE;
+            return index;
+        }
+    }
 
     // Enqueue new message
+    index = _mqtt_queue_size++;
+
     mqtt_message_t element;
     element.parent = parent;
-    element.topic = strdup(topic);
+    element.topic = _mqttArenaStore(topic);
     if (NULL != message) {
-        element.message = strdup(message);
+        element.message = _mqttArenaStore(message);
     }
-    _mqtt_queue.push_back(element);
+    _mqtt_queue[index] = element;
+
+    // Append to the parent list of children, or to the root list
+    unsigned char& first = (parent == mqtt_message_t::END) ? _mqtt_queue_first : _mqtt_queue[parent].child;
+    unsigned char& last = (parent == mqtt_message_t::END) ? _mqtt_queue_last : _mqtt_queue[parent].last;
+    if (last != mqtt_message_t::END) {
+        _mqtt_queue[last].next = index;
+    } else {
+        first = index;
+    }
+    last = index;
 
     return index;
 
@@ -865,6 +1251,335 @@ int8_t mqttEnqueue(const char * topic, const char * message) {
     return mqttEnqueue(topic, message, mqtt_message_t::END);
 }
 
+// -----------------------------------------------------------------------------
+// Outbox
+// -----------------------------------------------------------------------------
+
+#if MQTT_OUTBOX_SUPPORT
+
+uint32_t _mqttOutboxTimestamp() {
+    #if NTP_SUPPORT
+        return ntpSynced() ? static_cast<uint32_t>(now()) : 0;
+    #else
+        return 0;
+    #endif
+}
+
+// FNV-1a
+uint32_t _mqttOutboxHash(const char* topic) {
+    uint32_t hash = 2166136261ul;
+    while (*topic) {
+        hash = (hash ^ static_cast<uint8_t>(*topic++)) * 16777619ul;
+    }
+    return hash;
+}
+
+bool _mqttOutboxStale(const char* topic) {
+    const auto hash = _mqttOutboxHash(topic);
+    return std::find(_mqtt_outbox_live.begin(), _mqtt_outbox_live.end(), hash) != _mqtt_outbox_live.end();
+}
+
+void _mqttOutboxLive(const char* topic) {
+    if (!_mqttOutboxPending()) return;
+    if (_mqttOutboxStale(topic)) return;
+    _mqtt_outbox_live.push_back(_mqttOutboxHash(topic));
+}
+
+bool _mqttOutboxPush(const char* topic, const char* message, bool retain) {
+    // Nowhere to send them later
+    if (!_mqtt_enabled) return false;
+    if (!_mqtt_outbox.push(_mqttOutboxTimestamp(), topic, message, retain)) return false;
+
+    // This one is newer than what was sent directly, it should be replayed
+    const auto hash = _mqttOutboxHash(topic);
+    _mqtt_outbox_live.erase(std::remove(_mqtt_outbox_live.begin(), _mqtt_outbox_live.end(), hash), _mqtt_outbox_live.end());
+
+    // Client was not able to keep up while connected, start replaying right away
+    if (_mqtt.connected()) {
+        espurnaTaskInterval(_mqtt_outbox_task, _mqtt_outbox_interval);
+    }
+
+    return true;
+}
+
+#if MQTT_OUTBOX_SPIFFS
+
+// File uses the same record format as the RAM outbox, new records are appended to the end
+
+std::unique_ptr<char[]> _mqtt_outbox_file_record;
+size_t _mqtt_outbox_file_record_size = 0;
+
+void _mqttOutboxSpill(const mqtt::Outbox::entry_t& entry) {
+    // Entry was already sent and is waiting for the ack, moving it to the file would send it twice
+    if (_mqtt_outbox_waiting && !_mqtt_outbox_from_file && (_mqtt_outbox.removed() == _mqtt_outbox_removed)) {
+        return;
+    }
+
+    const size_t topic_length = strlen(entry.topic) + 1;
+    const size_t message_length = strlen(entry.message) + 1;
+    const size_t size = mqtt::Outbox::HeaderSize + topic_length + message_length;
+
+    if (_mqtt_outbox_file_size + size > MQTT_OUTBOX_SPIFFS_SIZE) {
+        ++_mqtt_outbox_file_dropped;
+        return;
+    }
+
+    File file = SPIFFS.open(_mqtt_outbox_file_name, "a");
+    if (!file) {
+        ++_mqtt_outbox_file_dropped;
+        return;
+    }
+
+    uint8_t header[mqtt::Outbox::HeaderSize];
+    const uint16_t topic_length16 = topic_length;
+    const uint16_t message_length16 = message_length;
+    memcpy(header, &entry.timestamp, 4);
+    header[4] = entry.retain ? 1 : 0;
+    memcpy(header + 5, &topic_length16, 2);
+    memcpy(header + 7, &message_length16, 2);
+
+    size_t written = file.write(header, sizeof(header));
+    written += file.write(reinterpret_cast<const uint8_t*>(entry.topic), topic_length);
+    written += file.write(reinterpret_cast<const uint8_t*>(entry.message), message_length);
+    file.close();
+
+    _mqtt_outbox_file_size += written;
+}
+
+bool _mqttOutboxFileFront(mqtt::Outbox::entry_t& entry) {
+    if (_mqtt_outbox_file_offset >= _mqtt_outbox_file_size) return false;
+
+    File file = SPIFFS.open(_mqtt_outbox_file_name, "r");
+    if (!file || !file.seek(_mqtt_outbox_file_offset, SeekSet)) {
+        _mqtt_outbox_file_size = 0;
+        _mqtt_outbox_file_offset = 0;
+        return false;
+    }
+
+    uint8_t header[mqtt::Outbox::HeaderSize];
+    uint16_t topic_length = 0;
+    uint16_t message_length = 0;
+    bool result = (file.read(header, sizeof(header)) == sizeof(header));
+    if (result) {
+        memcpy(&entry.timestamp, header, 4);
+        entry.retain = header[4];
+        memcpy(&topic_length, header + 5, 2);
+        memcpy(&message_length, header + 7, 2);
+
+        const size_t length = topic_length + message_length;
+        _mqtt_outbox_file_record.reset(new (std::nothrow) char[length]);
+        result = _mqtt_outbox_file_record
+            && (file.read(reinterpret_cast<uint8_t*>(_mqtt_outbox_file_record.get()), length) == length)
+            && (_mqtt_outbox_file_record[topic_length - 1] == '\0')
+            && (_mqtt_outbox_file_record[length - 1] == '\0');
+    }
+    file.close();
+
+    // Something is wrong with the file, throw it away
+    if (!result) {
+        SPIFFS.remove(_mqtt_outbox_file_name);
+        _mqtt_outbox_file_size = 0;
+        _mqtt_outbox_file_offset = 0;
+        return false;
+    }
+
+    entry.topic = _mqtt_outbox_file_record.get();
+    entry.message = _mqtt_outbox_file_record.get() + topic_length;
+    _mqtt_outbox_file_record_size = sizeof(header) + topic_length + message_length;
+
+    return true;
+}
+
+void _mqttOutboxFilePop() {
+    _mqtt_outbox_file_record.reset();
+    _mqtt_outbox_file_offset += _mqtt_outbox_file_record_size;
+    if (_mqtt_outbox_file_offset >= _mqtt_outbox_file_size) {
+        SPIFFS.remove(_mqtt_outbox_file_name);
+        _mqtt_outbox_file_size = 0;
+        _mqtt_outbox_file_offset = 0;
+    }
+}
+
+void _mqttOutboxFileSetup() {
+    File file = SPIFFS.open(_mqtt_outbox_file_name, "r");
+    if (file) {
+        _mqtt_outbox_file_size = file.size();
+        file.close();
+    }
+}
+
+#endif // MQTT_OUTBOX_SPIFFS
+
+// Messages in the file are always older than the ones in RAM
+
+bool _mqttOutboxFront(mqtt::Outbox::entry_t& entry) {
+    #if MQTT_OUTBOX_SPIFFS
+        _mqtt_outbox_from_file = _mqttOutboxFileFront(entry);
+        if (_mqtt_outbox_from_file) return true;
+    #endif
+    _mqtt_outbox_removed = _mqtt_outbox.removed();
+    return _mqtt_outbox.front(entry);
+}
+
+void _mqttOutboxPop() {
+    #if MQTT_OUTBOX_SPIFFS
+        if (_mqtt_outbox_from_file) {
+            _mqttOutboxFilePop();
+            return;
+        }
+    #endif
+
+    // Entry might have been evicted while waiting for the ack
+    if (_mqtt_outbox.removed() == _mqtt_outbox_removed) {
+        _mqtt_outbox.pop();
+    }
+}
+
+size_t _mqttOutboxPending() {
+    size_t result = _mqtt_outbox.count();
+    #if MQTT_OUTBOX_SPIFFS
+        result += (_mqtt_outbox_file_size - _mqtt_outbox_file_offset) ? 1 : 0;
+    #endif
+    return result;
+}
+
+// {"value":<message>,"timestamp":<unix time>} is sent to the <topic><MQTT_OUTBOX_TIMESTAMP_SUFFIX>, original topic payload is not changed
+uint16_t _mqttOutboxPublishTimestamp(const mqtt::Outbox::entry_t& entry) {
+    auto write = [&](MqttJsonWriter& writer) {
+        char buffer[16];
+        snprintf_P(buffer, sizeof(buffer), PSTR("%u"), entry.timestamp);
+        writer.begin();
+        writer.key("value");
+        if (isNumber(entry.message)) {
+            writer.number(entry.message);
+        } else {
+            writer.string(entry.message);
+        }
+        writer.key("timestamp");
+        writer.raw(buffer);
+        writer.end();
+    };
+
+    MqttJsonWriter counter;
+    write(counter);
+
+    std::unique_ptr<char[]> payload(new (std::nothrow) char[counter.length() + 1]);
+    if (!payload) return 0;
+
+    MqttJsonWriter writer(payload.get(), counter.length());
+    write(writer);
+    payload[writer.length()] = '\0';
+
+    String topic(entry.topic);
+    topic += F(MQTT_OUTBOX_TIMESTAMP_SUFFIX);
+
+    return _mqttPublish(topic.c_str(), payload.get(), false);
+}
+
+void _mqttOutboxReplay() {
+
+    if (!_mqtt.connected()) {
+        espurnaTaskCancel(_mqtt_outbox_task);
+        return;
+    }
+
+    if (_mqtt_outbox_waiting) {
+        if (!_mqtt_outbox_acked) return;
+        _mqtt_outbox_waiting = false;
+        _mqttOutboxPop();
+    }
+
+    mqtt::Outbox::entry_t entry;
+    if (!_mqttOutboxFront(entry)) {
+        DEBUG_MSG_P(PSTR("[MQTT] Outbox replay finished\n"));
+        espurnaTaskCancel(_mqtt_outbox_task);
+        _mqtt_outbox_live.clear();
+        _mqtt_outbox_live.shrink_to_fit();
+        return;
+    }
+
+    // Newer value was already sent directly, only the timestamped copy is still useful
+    const bool stale = _mqttOutboxStale(entry.topic);
+    const bool timestamp = _mqtt_outbox_timestamp && entry.timestamp;
+
+    // Try again on the next run
+    uint16_t packet = 0;
+    if (!stale) {
+        packet = _mqttPublish(entry.topic, entry.message, entry.retain);
+        if (!packet) return;
+    }
+
+    if (timestamp) {
+        const auto timestamp_packet = _mqttOutboxPublishTimestamp(entry);
+        if (stale) {
+            if (!timestamp_packet) return;
+            packet = timestamp_packet;
+        }
+    }
+
+    if (!packet) {
+        DEBUG_MSG_P(PSTR("[MQTT] Outbox skipped %s, newer message was already sent\n"), entry.topic);
+        _mqttOutboxPop();
+        return;
+    }
+
+    #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+        if (_mqtt_qos) {
+            _mqtt_outbox_packet = packet;
+            _mqtt_outbox_acked = false;
+            _mqtt_outbox_waiting = true;
+            return;
+        }
+    #endif
+
+    _mqttOutboxPop();
+
+}
+
+void _mqttOutboxOnPublish(uint16_t packet) {
+    if (_mqtt_outbox_waiting && (packet == _mqtt_outbox_packet)) {
+        _mqtt_outbox_acked = true;
+    }
+}
+
+void _mqttOutboxOnConnect() {
+    if (_mqttOutboxPending()) {
+        DEBUG_MSG_P(PSTR("[MQTT] Replaying outbox, %u message(s) in RAM\n"), _mqtt_outbox.count());
+        espurnaTaskInterval(_mqtt_outbox_task, _mqtt_outbox_interval);
+    }
+}
+
+// Anything not acknowledged yet will be sent again after reconnecting
+void _mqttOutboxOnDisconnect() {
+    _mqtt_outbox_waiting = false;
+    _mqtt_outbox_live.clear();
+    espurnaTaskCancel(_mqtt_outbox_task);
+}
+
+void _mqttOutboxConfigure() {
+    const auto rate = constrain(getSetting("mqttOutboxRate", MQTT_OUTBOX_REPLAY_RATE), 1, 100);
+    _mqtt_outbox_interval = 1000 / rate;
+    _mqtt_outbox_timestamp = getSetting("mqttOutboxTs", 1 == MQTT_OUTBOX_TIMESTAMP);
+}
+
+void _mqttOutboxInfo() {
+    DEBUG_MSG_P(PSTR("[MQTT] Outbox: %u message(s), %u / %u bytes, %u dropped\n"),
+        _mqtt_outbox.count(), _mqtt_outbox.used(), _mqtt_outbox.capacity(), _mqtt_outbox.dropped());
+    #if MQTT_OUTBOX_SPIFFS
+        DEBUG_MSG_P(PSTR("[MQTT] Outbox file: %u / %u bytes, %u dropped\n"),
+            _mqtt_outbox_file_size - _mqtt_outbox_file_offset, MQTT_OUTBOX_SPIFFS_SIZE, _mqtt_outbox_file_dropped);
+    #endif
+}
+
+void _mqttOutboxSetup() {
+    #if MQTT_OUTBOX_SPIFFS
+        _mqttOutboxFileSetup();
+    #endif
+    _mqtt_outbox_task = espurnaRegisterTask(_mqttOutboxReplay, PSTR("mqtt outbox"));
+}
+
+#endif // MQTT_OUTBOX_SUPPORT
+
 // -----------------------------------------------------------------------------
 
 void mqttSubscribeRaw(const char * topic) {
@@ -928,6 +1643,19 @@ void mqttRegister(mqtt_callback_f callback) {
     _mqtt_callbacks.push_back(callback);
 }
 
+void mqttRegisterTopic(const char * pattern, mqtt_topic_callback_f callback, unsigned char id) {
+    _mqtt_topics.add(pattern, callback, id);
+}
+
+void mqttRegisterRawTopic(const char * pattern, mqtt_topic_callback_f callback, unsigned char id) {
+    _mqtt_raw_topics.add(pattern, callback, id);
+}
+
+void mqttUnregisterTopics(mqtt_topic_callback_f callback) {
+    _mqtt_topics.remove(callback);
+    _mqtt_raw_topics.remove(callback);
+}
+
 void mqttSetBroker(IPAddress ip, uint16_t port) {
     setSetting("mqttServer", ip.toString());
     _mqtt_server = ip.toString();
@@ -1075,6 +1803,9 @@ void mqttSetup() {
         });
         _mqtt.onPublish([](uint16_t packetId) {
             DEBUG_MSG_P(PSTR("[MQTT] Publish ACK for PID %u\n"), packetId);
+            #if MQTT_OUTBOX_SUPPORT
+                _mqttOutboxOnPublish(packetId);
+            #endif
         });
 
         _mqtt.onDisconnect([](AsyncMqttClientDisconnectReason reason) {
@@ -1140,6 +1871,15 @@ void mqttSetup() {
     _mqttConfigure();
     mqttRegister(_mqttCallback);
 
+    _mqtt_pipeline_task = espurnaRegisterTask(_mqttPipelineFlush, PSTR("mqtt pipeline"));
+    _mqtt_flush_task = espurnaRegisterTask(mqttFlush, PSTR("mqtt json"));
+
+    #if MQTT_OUTBOX_SUPPORT
+        _mqttOutboxConfigure();
+        _mqttOutboxSetup();
+        espurnaRegisterReload(_mqttOutboxConfigure);
+    #endif
+
     #if WEB_SUPPORT
         wsRegister()
             .onVisible(_mqttWebSocketOnVisible)
@@ -1159,7 +1899,7 @@ void mqttSetup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(mqttLoop);
+    espurnaRegisterLoop(mqttLoop, PSTR("mqtt"));
     espurnaRegisterReload(_mqttConfigure);
 
 }
@@ -21,6 +21,10 @@ using mqtt_msg_t = std::pair<String, String>; // topic, payload
 
 #if MQTT_SUPPORT
 
+#include "mqtt_trie.h"
+
+using mqtt_topic_callback_f = mqtt::topic_callback_f;
+
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
     #include <ESPAsyncTCP.h>
     #include <AsyncMqttClient.h>
@@ -32,6 +36,14 @@ using mqtt_msg_t = std::pair<String, String>; // topic, payload
 
 void mqttRegister(mqtt_callback_f callback);
 
+// Only called for the matching incoming messages, using MQTT wildcards ('+' and '#')
+// mqttRegisterTopic pattern is the magnitude part of the topic, e.g. "relay/+" for the "<root>/relay/0/set"
+// mqttRegisterRawTopic pattern is the full topic
+// `id` is passed back to the callback as-is
+void mqttRegisterTopic(const char * pattern, mqtt_topic_callback_f callback, unsigned char id = 0);
+void mqttRegisterRawTopic(const char * pattern, mqtt_topic_callback_f callback, unsigned char id = 0);
+void mqttUnregisterTopics(mqtt_topic_callback_f callback);
+
 String mqttTopic(const char * magnitude, bool is_set);
 String mqttTopic(const char * magnitude, unsigned int index, bool is_set);
 
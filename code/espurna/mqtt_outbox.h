@@ -0,0 +1,178 @@
+/*
+
+MQTT MODULE
+
+Outbox for the messages that could not be sent while the broker was unavailable
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace mqtt {
+
+// Messages are stored as variable-length records in a single buffer, oldest first:
+//
+// | timestamp:4 | retain:1 | topic length:2 | message length:2 | topic\0 | message\0 |
+//
+// Buffer is only allocated when the first message is stored. When there is no more space,
+// the oldest records are evicted (and handed to the `evict` callback, when there is one)
+
+class Outbox {
+    public:
+
+    struct entry_t {
+        uint32_t timestamp;
+        bool retain;
+        const char* topic;
+        const char* message;
+    };
+
+    using evict_f = void(*)(const entry_t& entry);
+
+    static constexpr size_t HeaderSize = 9;
+
+    explicit Outbox(size_t size, evict_f evict = nullptr) :
+        _size(size),
+        _evict(evict)
+    {}
+
+    size_t count() const {
+        return _count;
+    }
+
+    size_t used() const {
+        return _tail - _head;
+    }
+
+    size_t capacity() const {
+        return _size;
+    }
+
+    size_t dropped() const {
+        return _dropped;
+    }
+
+    // Total number of records removed from the front, including evicted ones
+    size_t removed() const {
+        return _removed;
+    }
+
+    bool push(uint32_t timestamp, const char* topic, const char* message, bool retain) {
+        const size_t topic_length = strlen(topic) + 1;
+        const size_t message_length = strlen(message) + 1;
+        const size_t size = HeaderSize + topic_length + message_length;
+
+        if (size > _size) {
+            ++_dropped;
+            return false;
+        }
+
+        if (!_buffer) {
+            _buffer.reset(new (std::nothrow) uint8_t[_size]);
+            if (!_buffer) {
+                ++_dropped;
+                return false;
+            }
+        }
+
+        while ((_size - used()) < size) {
+            entry_t entry;
+            front(entry);
+            if (_evict) {
+                _evict(entry);
+            } else {
+                ++_dropped;
+            }
+            pop();
+        }
+
+        if ((_size - _tail) < size) {
+            _compact();
+        }
+
+        uint8_t* ptr = &_buffer[_tail];
+        const uint16_t topic_length16 = topic_length;
+        const uint16_t message_length16 = message_length;
+        memcpy(ptr, &timestamp, 4);
+        ptr[4] = retain ? 1 : 0;
+        memcpy(ptr + 5, &topic_length16, 2);
+        memcpy(ptr + 7, &message_length16, 2);
+        memcpy(ptr + HeaderSize, topic, topic_length);
+        memcpy(ptr + HeaderSize + topic_length, message, message_length);
+
+        _tail += size;
+        ++_count;
+
+        return true;
+    }
+
+    // Pointers are valid until the next push() or pop()
+    bool front(entry_t& entry) const {
+        if (!_count) {
+            return false;
+        }
+
+        const uint8_t* ptr = &_buffer[_head];
+        uint16_t topic_length;
+        memcpy(&entry.timestamp, ptr, 4);
+        entry.retain = ptr[4];
+        memcpy(&topic_length, ptr + 5, 2);
+        entry.topic = reinterpret_cast<const char*>(ptr + HeaderSize);
+        entry.message = reinterpret_cast<const char*>(ptr + HeaderSize + topic_length);
+
+        return true;
+    }
+
+    void pop() {
+        if (!_count) {
+            return;
+        }
+
+        const uint8_t* ptr = &_buffer[_head];
+        uint16_t topic_length;
+        uint16_t message_length;
+        memcpy(&topic_length, ptr + 5, 2);
+        memcpy(&message_length, ptr + 7, 2);
+
+        _head += HeaderSize + topic_length + message_length;
+        ++_removed;
+        if (!--_count) {
+            _head = 0;
+            _tail = 0;
+        }
+    }
+
+    void clear() {
+        _removed += _count;
+        _head = 0;
+        _tail = 0;
+        _count = 0;
+    }
+
+    private:
+
+    void _compact() {
+        memmove(&_buffer[0], &_buffer[_head], used());
+        _tail -= _head;
+        _head = 0;
+    }
+
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t _size;
+    evict_f _evict;
+
+    size_t _head { 0 };
+    size_t _tail { 0 };
+    size_t _count { 0 };
+    size_t _dropped { 0 };
+    size_t _removed { 0 };
+
+};
+
+} // namespace mqtt
@@ -0,0 +1,174 @@
+/*
+
+MQTT MODULE
+
+Publish pipeline, holding outgoing messages until the client is able to send them
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace mqtt {
+
+// Fixed number of slots, sent in the FIFO order. Every slot is a single allocation of `topic\0message\0`.
+// Pushing the topic that is already queued replaces its message in-place, so burst of updates for
+// the same topic (e.g. relay toggled several times while the TCP window is full) only sends the last value.
+
+class Pipeline {
+    public:
+
+    struct entry_t {
+        const char* topic;
+        const char* message;
+        bool retain;
+    };
+
+    Pipeline(size_t capacity, size_t bytes) :
+        _slots(new (std::nothrow) slot_t[capacity]),
+        _capacity(_slots ? capacity : 0),
+        _bytes_max(bytes)
+    {}
+
+    size_t size() const {
+        return _count;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t bytes() const {
+        return _bytes;
+    }
+
+    size_t coalesced() const {
+        return _coalesced;
+    }
+
+    bool push(const char* topic, const char* message, bool retain) {
+        const size_t topic_length = strlen(topic) + 1;
+        const size_t message_length = strlen(message) + 1;
+
+        for (size_t n = 0; n < _count; ++n) {
+            auto& slot = _slots[(_head + n) % _capacity];
+            if ((slot.retain != retain) || (0 != strcmp(slot.data.get(), topic))) {
+                continue;
+            }
+
+            const size_t current = slot.length - slot.topic;
+            if ((_bytes - current + message_length) > _bytes_max) {
+                return false;
+            }
+
+            if (current != message_length) {
+                if (!_store(slot, topic, topic_length, message, message_length)) {
+                    return false;
+                }
+            } else {
+                memcpy(slot.data.get() + slot.topic, message, message_length);
+            }
+
+            _bytes = _bytes - current + message_length;
+            ++_coalesced;
+            return true;
+        }
+
+        if ((_count >= _capacity) || ((_bytes + topic_length + message_length) > _bytes_max)) {
+            return false;
+        }
+
+        auto& slot = _slots[(_head + _count) % _capacity];
+        if (!_store(slot, topic, topic_length, message, message_length)) {
+            return false;
+        }
+        slot.retain = retain;
+
+        _bytes += topic_length + message_length;
+        ++_count;
+
+        return true;
+    }
+
+    // Pointers are valid until the next push() or pop()
+    bool front(entry_t& entry) const {
+        if (!_count) {
+            return false;
+        }
+
+        const auto& slot = _slots[_head];
+        entry.topic = slot.data.get();
+        entry.message = slot.data.get() + slot.topic;
+        entry.retain = slot.retain;
+
+        return true;
+    }
+
+    void pop() {
+        if (!_count) {
+            return;
+        }
+
+        auto& slot = _slots[_head];
+        _bytes -= slot.length;
+        slot.data.reset();
+        slot.length = 0;
+
+        _head = (_head + 1) % _capacity;
+        --_count;
+    }
+
+    void clear() {
+        while (_count) {
+            pop();
+        }
+        _head = 0;
+    }
+
+    private:
+
+    struct slot_t {
+        std::unique_ptr<char[]> data;
+        uint16_t topic { 0 };
+        uint16_t length { 0 };
+        bool retain { false };
+    };
+
+    bool _store(slot_t& slot, const char* topic, size_t topic_length, const char* message, size_t message_length) {
+        const size_t length = topic_length + message_length;
+        if (length > UINT16_MAX) {
+            return false;
+        }
+
+        std::unique_ptr<char[]> data(new (std::nothrow) char[length]);
+        if (!data) {
+            return false;
+        }
+
+        memcpy(data.get(), topic, topic_length);
+        memcpy(data.get() + topic_length, message, message_length);
+
+        slot.data = std::move(data);
+        slot.topic = topic_length;
+        slot.length = length;
+
+        return true;
+    }
+
+    std::unique_ptr<slot_t[]> _slots;
+    size_t _capacity;
+    size_t _bytes_max;
+
+    size_t _head { 0 };
+    size_t _count { 0 };
+    size_t _bytes { 0 };
+    size_t _coalesced { 0 };
+
+};
+
+} // namespace mqtt
@@ -0,0 +1,277 @@
+/*
+
+MQTT MODULE
+
+Topic patterns of the incoming messages, stored as a trie of topic levels
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace mqtt {
+
+// Values of the single-level wildcards ('+') of the matched pattern, left to right
+
+struct match_t {
+    static constexpr size_t Captures = 4;
+
+    struct capture_t {
+        const char* data;
+        size_t length;
+    };
+
+    const char* topic;
+    unsigned char id;
+    size_t count;
+    capture_t captures[Captures];
+
+    // Only accepts non-empty numeric captures
+    bool number(size_t index, unsigned int& value) const {
+        if ((index >= count) || (index >= Captures) || !captures[index].length) {
+            return false;
+        }
+
+        unsigned int result = 0;
+        for (size_t n = 0; n < captures[index].length; ++n) {
+            const char c = captures[index].data[n];
+            if ((c < '0') || (c > '9')) {
+                return false;
+            }
+            result = (result * 10) + (c - '0');
+        }
+
+        value = result;
+        return true;
+    }
+};
+
+using topic_callback_f = void(*)(const match_t& match, const char* payload);
+
+// Every topic level is a node, children are linked through the `next` sibling:
+//
+// (root) -> relay -> +
+//        -> pulse -> +
+//        -> color -> rgb
+//                 -> hsv
+//
+// Matching the topic only visits nodes of the same level as the current topic level,
+// instead of comparing the whole topic string with every pattern.
+// Wildcards follow the MQTT rules: '+' matches exactly one level, '#' matches the rest of the topic
+// (including the parent level, e.g. "relay/#" also matches the "relay")
+//
+// Note: callbacks must not add or remove patterns
+
+class TopicTrie {
+    public:
+
+    static constexpr uint16_t None = 0xFFFF;
+
+    TopicTrie() {
+        _nodes.push_back(node_t{});
+    }
+
+    bool add(const char* pattern, topic_callback_f callback, unsigned char id = 0) {
+        if (!pattern || !callback) {
+            return false;
+        }
+
+        uint16_t node = 0;
+        const char* level = pattern;
+        for (;;) {
+            const char* end = strchr(level, '/');
+            const size_t length = end ? (end - level) : strlen(level);
+            node = _child(node, level, length);
+            if (node == None) {
+                return false;
+            }
+            if (!end) {
+                break;
+            }
+            level = end + 1;
+        }
+
+        auto& target = _nodes[node];
+        for (auto index = target.handlers; index != None; index = _handlers[index].next) {
+            if ((_handlers[index].callback == callback) && (_handlers[index].id == id)) {
+                return true;
+            }
+        }
+
+        // Reuse removed slots first, patterns are re-registered on every reconnect
+        uint16_t index = _free;
+        if (index != None) {
+            _free = _handlers[index].next;
+            _handlers[index] = handler_t{callback, id, target.handlers};
+        } else {
+            if (_handlers.size() >= None) {
+                return false;
+            }
+            _handlers.push_back(handler_t{callback, id, target.handlers});
+            index = _handlers.size() - 1;
+        }
+
+        target.handlers = index;
+        ++_count;
+
+        return true;
+    }
+
+    // Nodes are kept around, handlers are unlinked and their slots are put on the free list
+    void remove(topic_callback_f callback) {
+        for (auto& node : _nodes) {
+            uint16_t* link = &node.handlers;
+            while (*link != None) {
+                const uint16_t index = *link;
+                auto& handler = _handlers[index];
+                if (handler.callback != callback) {
+                    link = &handler.next;
+                    continue;
+                }
+
+                *link = handler.next;
+                handler.callback = nullptr;
+                handler.next = _free;
+                _free = index;
+                --_count;
+            }
+        }
+    }
+
+    size_t match(const char* topic, const char* payload) const {
+        match_t match {};
+        match.topic = topic;
+
+        size_t result = 0;
+        _match(0, topic, false, match, payload, result);
+
+        return result;
+    }
+
+    size_t nodes() const {
+        return _nodes.size();
+    }
+
+    // Registered handlers
+    size_t handlers() const {
+        return _count;
+    }
+
+    // Allocated handler slots, including the free ones
+    size_t capacity() const {
+        return _handlers.size();
+    }
+
+    private:
+
+    struct node_t {
+        uint16_t name { 0 };
+        uint16_t length { 0 };
+        uint16_t child { None };
+        uint16_t next { None };
+        uint16_t handlers { None };
+    };
+
+    struct handler_t {
+        topic_callback_f callback;
+        unsigned char id;
+        uint16_t next;
+    };
+
+    bool _equals(const node_t& node, const char* level, size_t length) const {
+        return (node.length == length) && (!length || (0 == memcmp(&_names[node.name], level, length)));
+    }
+
+    // Find existing or create the new child node
+    uint16_t _child(uint16_t parent, const char* level, size_t length) {
+        uint16_t last = None;
+        for (auto index = _nodes[parent].child; index != None; index = _nodes[index].next) {
+            if (_equals(_nodes[index], level, length)) {
+                return index;
+            }
+            last = index;
+        }
+
+        if ((_nodes.size() >= None) || ((_names.size() + length) >= None)) {
+            return None;
+        }
+
+        node_t node;
+        node.name = _names.size();
+        node.length = length;
+        _names.insert(_names.end(), level, level + length);
+        _nodes.push_back(node);
+
+        const uint16_t index = _nodes.size() - 1;
+        if (last == None) {
+            _nodes[parent].child = index;
+        } else {
+            _nodes[last].next = index;
+        }
+
+        return index;
+    }
+
+    void _call(const node_t& node, const match_t& match, const char* payload, size_t& result) const {
+        for (auto index = node.handlers; index != None; index = _handlers[index].next) {
+            const auto& handler = _handlers[index];
+
+            match_t copy(match);
+            copy.id = handler.id;
+            handler.callback(copy, payload);
+            ++result;
+        }
+    }
+
+    // `done` is set after the last level of the topic was consumed
+    void _match(uint16_t index, const char* level, bool done, match_t& match, const char* payload, size_t& result) const {
+        const auto& node = _nodes[index];
+
+        if (done) {
+            _call(node, match, payload, result);
+        }
+
+        const char* end = done ? nullptr : strchr(level, '/');
+        const size_t length = done ? 0 : (end ? (end - level) : strlen(level));
+        const char* next = end ? (end + 1) : nullptr;
+
+        for (auto child = node.child; child != None; child = _nodes[child].next) {
+            const auto& current = _nodes[child];
+
+            if (_equals(current, "#", 1)) {
+                _call(current, match, payload, result);
+                continue;
+            }
+
+            if (done) continue;
+
+            if (_equals(current, "+", 1)) {
+                const auto count = match.count;
+                if (count < match_t::Captures) {
+                    match.captures[count] = match_t::capture_t{level, length};
+                }
+                ++match.count;
+                _match(child, next, !next, match, payload, result);
+                match.count = count;
+                continue;
+            }
+
+            if (_equals(current, level, length)) {
+                _match(child, next, !next, match, payload, result);
+            }
+        }
+    }
+
+    std::vector<node_t> _nodes;
+    std::vector<char> _names;
+    std::vector<handler_t> _handlers;
+    uint16_t _free { None };
+    size_t _count { 0 };
+
+};
+
+} // namespace mqtt
@@ -191,7 +191,7 @@ void nofussSetup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(_nofussLoop);
+    espurnaRegisterLoop(_nofussLoop, PSTR("nofuss"));
     espurnaRegisterReload(_nofussConfigure);
 
 }
@@ -298,7 +298,7 @@ void ntpSetup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(_ntpLoop);
+    espurnaRegisterLoop(_ntpLoop, PSTR("ntp"));
     espurnaRegisterReload([]() { _ntp_configure = true; });
 
     // Sets up NTP instance, installs ours sync provider
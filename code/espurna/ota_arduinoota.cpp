@@ -96,7 +96,7 @@ void _arduinoOtaOnError(ota_error_t error) {
 
 void arduinoOtaSetup() {
 
-    espurnaRegisterLoop(_arduinoOtaLoop);
+    espurnaRegisterLoop(_arduinoOtaLoop, PSTR("ota"));
     espurnaRegisterReload(_arduinoOtaConfigure);
 
     ArduinoOTA.onStart(_arduinoOtaOnStart);
@@ -0,0 +1,266 @@
+/*
+
+LOOP PROFILER MODULE
+
+*/
+
+#include "espurna.h"
+#include "profiler.h"
+
+#if PROFILER_SUPPORT
+
+#include "mqtt.h"
+#include "ws.h"
+
+#include <vector>
+
+std::vector<profiler::stats_t*> _profiler_stats;
+
+#if MQTT_SUPPORT
+unsigned long _profiler_mqtt_interval = 0;
+espurna_task_t _profiler_mqtt_task = EspurnaTaskNone;
+#endif
+
+#if WEB_SUPPORT
+espurna_task_t _profiler_ws_task = EspurnaTaskNone;
+constexpr unsigned long ProfilerWebSocketInterval = 10000;
+#endif
+
+// -----------------------------------------------------------------------------
+
+namespace profiler {
+
+void stats_t::add(uint32_t cycles) {
+    ++count;
+    total += cycles;
+    if (cycles > max) {
+        max = cycles;
+    }
+
+    const uint32_t value = cycles >> HistogramOffset;
+    size_t bucket = value ? (32 - __builtin_clz(value)) : 0;
+    if (bucket >= HistogramSize) {
+        bucket = HistogramSize - 1;
+    }
+
+    if (histogram[bucket] == UINT16_MAX) {
+        for (auto& counter : histogram) {
+            counter /= 2;
+        }
+    }
+    ++histogram[bucket];
+}
+
+void stats_t::reset() {
+    count = 0;
+    total = 0;
+    max = 0;
+    for (auto& counter : histogram) {
+        counter = 0;
+    }
+}
+
+uint32_t stats_t::average() const {
+    return count ? static_cast<uint32_t>(total / count) : 0;
+}
+
+// Upper bound of the bucket containing the requested percentile, but never more than the max
+uint32_t stats_t::percentile(unsigned char value) const {
+    uint32_t samples = 0;
+    for (auto counter : histogram) {
+        samples += counter;
+    }
+
+    if (!samples) {
+        return 0;
+    }
+
+    const uint32_t threshold = (samples * value + 99) / 100;
+
+    uint32_t current = 0;
+    size_t bucket = 0;
+    for (; bucket < HistogramSize; ++bucket) {
+        current += histogram[bucket];
+        if (current >= threshold) {
+            break;
+        }
+    }
+
+    // The last bucket is unbounded
+    if (bucket >= (HistogramSize - 1)) {
+        return max;
+    }
+
+    return std::min(max, static_cast<uint32_t>(1ul << (bucket + HistogramOffset)));
+}
+
+stats_t* add(const char* kind, const char* name, const void* id, unsigned char index) {
+    auto* stats = new stats_t(kind, name, id, index);
+    _profiler_stats.push_back(stats);
+    return stats;
+}
+
+void describe(const stats_t& stats, char* buffer, size_t size) {
+    if (stats.name) {
+        strncpy_P(buffer, stats.name, size - 1);
+        buffer[size - 1] = '\0';
+    } else if (stats.id) {
+        snprintf_P(buffer, size, PSTR("%p"), stats.id);
+    } else {
+        snprintf_P(buffer, size, PSTR("#%u"), stats.index);
+    }
+}
+
+} // namespace profiler
+
+// -----------------------------------------------------------------------------
+
+void _profilerReset() {
+    for (auto* stats : _profiler_stats) {
+        stats->reset();
+    }
+}
+
+#if WEB_SUPPORT
+
+void _profilerWebSocketOnVisible(JsonObject& root) {
+    root["profVisible"] = 1;
+}
+
+void _profilerWebSocketOnConnected(JsonObject& root) {
+    #if MQTT_SUPPORT
+        root["profMqtt"] = _profiler_mqtt_interval / 1000;
+    #endif
+}
+
+bool _profilerWebSocketOnKeyCheck(const char * key, JsonVariant& value) {
+    return (strncmp(key, "prof", 4) == 0);
+}
+
+void _profilerWebSocketSendData(JsonObject& root) {
+    JsonObject& profiler = root.createNestedObject("profiler");
+    profiler["mhz"] = ESP.getCpuFreqMHz();
+
+    JsonArray& kind = profiler.createNestedArray("kind");
+    JsonArray& id = profiler.createNestedArray("id");
+    JsonArray& count = profiler.createNestedArray("count");
+    JsonArray& average = profiler.createNestedArray("avg");
+    JsonArray& max = profiler.createNestedArray("max");
+    JsonArray& p99 = profiler.createNestedArray("p99");
+
+    char buffer[24];
+    for (const auto* stats : _profiler_stats) {
+        kind.add(stats->kind);
+        profiler::describe(*stats, buffer, sizeof(buffer));
+        id.add(String(buffer));
+        count.add(stats->count);
+        average.add(stats->average());
+        max.add(stats->max);
+        p99.add(stats->percentile(99));
+    }
+}
+
+void _profilerWebSocketUpdate() {
+    if (wsConnected()) {
+        wsPost(_profilerWebSocketSendData);
+    }
+}
+
+#endif // WEB_SUPPORT
+
+#if MQTT_SUPPORT
+
+// <root>/profiler/<index> => {"kind":"loop","id":"sensor","count":1000,"avg":123,"max":456,"p99":256}
+void _profilerMqttSend() {
+    char buffer[128];
+    for (size_t index = 0; index < _profiler_stats.size(); ++index) {
+        const auto* stats = _profiler_stats[index];
+
+        char id[24];
+        profiler::describe(*stats, id, sizeof(id));
+
+        snprintf_P(buffer, sizeof(buffer),
+            PSTR("{\"kind\":\"%s\",\"id\":\"%s\",\"count\":%u,\"avg\":%u,\"max\":%u,\"p99\":%u}"),
+            stats->kind, id, stats->count, stats->average(), stats->max, stats->percentile(99)
+        );
+        mqttSend(MQTT_TOPIC_PROFILER, index, buffer);
+    }
+}
+
+void _profilerMqttTask() {
+    if (mqttConnected()) {
+        _profilerMqttSend();
+    }
+}
+
+#endif // MQTT_SUPPORT
+
+void _profilerConfigure() {
+    #if MQTT_SUPPORT
+        const unsigned long interval = 1000 * getSetting("profMqtt", PROFILER_MQTT_INTERVAL);
+        if (interval != _profiler_mqtt_interval) {
+            _profiler_mqtt_interval = interval;
+            if (interval) {
+                espurnaTaskInterval(_profiler_mqtt_task, interval);
+            } else {
+                espurnaTaskCancel(_profiler_mqtt_task);
+            }
+        }
+    #endif
+}
+
+#if TERMINAL_SUPPORT
+
+void _profilerInitCommands() {
+
+    terminalRegisterCommand(F("LOOP.STATS"), [](const terminal::CommandContext& ctx) {
+        if ((ctx.argc == 2) && ctx.argv[1].equalsIgnoreCase(F("reset"))) {
+            _profilerReset();
+            terminalOK(ctx);
+            return;
+        }
+
+        ctx.output.printf_P(PSTR("CPU %u MHz, values are in cycles\n"), ESP.getCpuFreqMHz());
+        ctx.output.printf_P(PSTR("%-12s %-16s %10s %10s %10s %10s\n"), "kind", "id", "count", "avg", "max", "p99");
+
+        char id[24];
+        for (const auto* stats : _profiler_stats) {
+            profiler::describe(*stats, id, sizeof(id));
+            ctx.output.printf_P(PSTR("%-12s %-16s %10u %10u %10u %10u\n"),
+                stats->kind, id, stats->count, stats->average(), stats->max, stats->percentile(99)
+            );
+        }
+
+        terminalOK(ctx);
+    });
+
+}
+
+#endif // TERMINAL_SUPPORT
+
+void profilerSetup() {
+
+    #if MQTT_SUPPORT
+        _profiler_mqtt_task = espurnaRegisterTask(_profilerMqttTask, PSTR("profiler mqtt"));
+    #endif
+
+    _profilerConfigure();
+
+    #if WEB_SUPPORT
+        wsRegister()
+            .onVisible(_profilerWebSocketOnVisible)
+            .onConnected(_profilerWebSocketOnConnected)
+            .onData(_profilerWebSocketSendData)
+            .onKeyCheck(_profilerWebSocketOnKeyCheck);
+        _profiler_ws_task = espurnaRegisterTask(_profilerWebSocketUpdate, PSTR("profiler ws"), ProfilerWebSocketInterval);
+    #endif
+
+    #if TERMINAL_SUPPORT
+        _profilerInitCommands();
+    #endif
+
+    espurnaRegisterReload(_profilerConfigure);
+
+}
+
+#endif // PROFILER_SUPPORT
@@ -0,0 +1,77 @@
+/*
+
+LOOP PROFILER MODULE
+
+*/
+
+#pragma once
+
+// Note: also included by the broker.h, keep dependencies to the minimum
+#include <Arduino.h>
+
+#include <cstdint>
+
+namespace profiler {
+
+// Durations are sorted into power-of-two buckets, starting with the [0, 2^HistogramOffset) cycles one.
+// Counters are halved when any of them is about to overflow, so the distribution still favours recent calls.
+constexpr size_t HistogramSize = 16;
+constexpr uint32_t HistogramOffset = 8;
+
+struct stats_t {
+    stats_t(const char* kind, const char* name, const void* id, unsigned char index) :
+        kind(kind),
+        name(name),
+        id(id),
+        index(index)
+    {
+        reset();
+    }
+
+    void add(uint32_t cycles);
+    void reset();
+
+    uint32_t average() const;
+    uint32_t percentile(unsigned char value) const;
+
+    const char* kind;
+    const char* name;
+    const void* id;
+    unsigned char index;
+
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+    uint16_t histogram[HistogramSize];
+};
+
+// Allocate stats for the callback. `kind` is expected to be a string literal, `name` a PSTR() or nullptr.
+// Callback is shown as the `name`, then the `id` address and then the `index`, whichever is set first
+stats_t* add(const char* kind, const char* name, const void* id, unsigned char index = 0);
+
+// Writes the callback identifier into the buffer
+void describe(const stats_t& stats, char* buffer, size_t size);
+
+// Measures cycles spent in the current scope
+class Measure {
+    public:
+        explicit Measure(stats_t* stats) :
+            _stats(stats),
+            _start(ESP.getCycleCount())
+        {}
+
+        ~Measure() {
+            _stats->add(ESP.getCycleCount() - _start);
+        }
+
+        Measure(const Measure&) = delete;
+        Measure& operator=(const Measure&) = delete;
+
+    private:
+        stats_t* _stats;
+        uint32_t _start;
+};
+
+} // namespace profiler
+
+void profilerSetup();
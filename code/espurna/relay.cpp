@@ -65,6 +65,7 @@ struct relay_t {
         fw_count(0),
         change_start(0),
         change_delay(0),
+        boot_mode(RELAY_BOOT_MODE),
         report(false),
         group_report(false)
     {}
@@ -91,6 +92,7 @@ struct relay_t {
     unsigned char fw_count;      // Number of changes within the current flood window
     unsigned long change_start;  // Time when relay was scheduled to change
     unsigned long change_delay;  // Delay until the next change
+    unsigned char boot_mode;     // Cached relayBoot<N> setting, RELAY_BOOT_...
     bool report;                 // Whether to report to own topic
     bool group_report;           // Whether to report to group topic
 
@@ -114,6 +116,20 @@ bool _relay_sync_locked = false;
 Ticker _relay_save_timer;
 Ticker _relay_sync_timer;
 
+// Relays with target status different from the current one. Loop does nothing until the earliest
+// of them is due (`_relay_pending_delay` ms after the `_relay_pending_start`)
+uint32_t _relay_pending = 0;
+unsigned long _relay_pending_start = 0;
+unsigned long _relay_pending_delay = 0;
+
+// Provider writes of the relays changed in the same loop, see _relayProviderCommit()
+uint32_t _relay_batch_mask = 0;
+uint32_t _relay_batch_status = 0;
+bool _relay_batch_update = false;
+
+// Relays changed through the relayStatusMask(), reported together when all of them are done
+uint32_t _relay_report_mask = 0;
+
 #if WEB_SUPPORT
 
 bool _relay_report_ws = false;
@@ -132,6 +148,127 @@ String _relay_rpc_payload_toggle;
 // UTILITY
 // -----------------------------------------------------------------------------
 
+unsigned long _relayRemaining(const relay_t& relay, unsigned long timestamp) {
+    const auto elapsed = timestamp - relay.change_start;
+    return (relay.change_delay > elapsed) ? (relay.change_delay - elapsed) : 0;
+}
+
+// Must be called after every change of the relay target status or delay.
+// Cancelled changes are only removed here, next wakeup time is updated by the _relayProcess()
+void _relaySchedule(unsigned char id) {
+    const auto& relay = _relays[id];
+    const uint32_t bit = (1ul << id);
+
+    if (relay.target_status == relay.current_status) {
+        _relay_pending &= ~bit;
+        return;
+    }
+
+    const auto timestamp = millis();
+    const auto remaining = _relayRemaining(relay, timestamp);
+
+    const auto elapsed = timestamp - _relay_pending_start;
+    const auto earliest = (_relay_pending_delay > elapsed) ? (_relay_pending_delay - elapsed) : 0;
+
+    if (!_relay_pending || (remaining < earliest)) {
+        _relay_pending_start = timestamp;
+        _relay_pending_delay = remaining;
+    }
+
+    _relay_pending |= bit;
+}
+
+bool _relayBootSaves(unsigned char boot_mode) {
+    return (RELAY_BOOT_SAME == boot_mode) || (RELAY_BOOT_TOGGLE == boot_mode);
+}
+
+uint32_t _relayMaskAll() {
+    return (_relays.size() >= RelaysMax)
+        ? 0xffffffffu
+        : ((1ul << _relays.size()) - 1);
+}
+
+// Array element per relay, starting from #0: 0 / 1 / 2 (toggle), boolean, relay payload string or null to keep the current status
+bool _relayParseMask(JsonArray& values, uint32_t& mask, uint32_t& status) {
+    mask = 0;
+    status = 0;
+
+    unsigned char id = 0;
+    for (auto& value : values) {
+        if (id >= _relays.size()) return false;
+
+        PayloadStatus parsed = PayloadStatus::Unknown;
+        if (value.is<bool>()) {
+            parsed = value.as<bool>() ? PayloadStatus::On : PayloadStatus::Off;
+        } else if (value.is<int>()) {
+            const int number = value.as<int>();
+            parsed = (number == 0) ? PayloadStatus::Off
+                : (number == 1) ? PayloadStatus::On
+                : (number == 2) ? PayloadStatus::Toggle
+                : PayloadStatus::Unknown;
+        } else {
+            const char* payload = value.as<const char*>();
+            if (!payload) {
+                ++id;
+                continue;
+            }
+            parsed = relayParsePayload(payload);
+        }
+
+        const uint32_t bit = (1ul << id);
+        switch (parsed) {
+            case PayloadStatus::On:
+                status |= bit;
+                break;
+            case PayloadStatus::Toggle:
+                if (!_relays[id].target_status) status |= bit;
+                break;
+            case PayloadStatus::Off:
+                break;
+            case PayloadStatus::Unknown:
+            default:
+                return false;
+        }
+
+        mask |= bit;
+        ++id;
+    }
+
+    return true;
+}
+
+// Status of every relay as the number, "0b1011" / "0x0b" / "11", or the JSON array described above
+bool _relayParseMask(const char* payload, uint32_t& mask, uint32_t& status) {
+    if (!payload) return false;
+    while (isspace(*payload)) ++payload;
+
+    if (*payload == '[') {
+        DynamicJsonBuffer jsonBuffer;
+        JsonArray& values = jsonBuffer.parseArray(payload);
+        if (!values.success()) return false;
+        return _relayParseMask(values, mask, status);
+    }
+
+    int base = 10;
+    if ((payload[0] == '0') && (payload[1] == 'b')) {
+        base = 2;
+        payload += 2;
+    } else if ((payload[0] == '0') && (payload[1] == 'x')) {
+        base = 16;
+        payload += 2;
+    }
+
+    char* endptr = nullptr;
+    const auto value = strtoul(payload, &endptr, base);
+    if ((endptr == payload) || (*endptr != '\0')) return false;
+
+    mask = _relayMaskAll();
+    if (value & ~mask) return false;
+
+    status = value;
+    return true;
+}
+
 bool _relayHandlePayload(unsigned char relayID, const char* payload) {
     auto value = relayParsePayload(payload);
     if (value == PayloadStatus::Unknown) return false;
@@ -178,6 +315,7 @@ bool _relayStatusLock(unsigned char id, bool status) {
         if ((lock != status) || (lock != _relays[id].target_status)) {
             _relays[id].target_status = lock;
             _relays[id].change_delay = 0;
+            _relaySchedule(id);
             return false;
         }
     }
@@ -196,6 +334,7 @@ void _relaySyncRelaysDelay(unsigned char first, unsigned char second) {
         _relays[first].change_delay,
         _relays[second].change_delay
     });
+    _relaySchedule(second);
 }
 
 void _relaySyncUnlock() {
@@ -239,24 +378,9 @@ void _relayProviderStatus(unsigned char id, bool status) {
         rfbStatus(id, status);
     #endif
 
+    // Mask of all relays is sent once, when the batch is committed
     #if RELAY_PROVIDER == RELAY_PROVIDER_DUAL
-
-        // Calculate mask
-        unsigned char mask=0;
-        for (unsigned char i=0; i<_relays.size(); i++) {
-            if (_relays[i].current_status) mask = mask + (1 << i);
-        }
-
-        DEBUG_MSG_P(PSTR("[RELAY] [DUAL] Sending relay mask: %d\n"), mask);
-
-        // Send it to F330
-        Serial.flush();
-        Serial.write(0xA0);
-        Serial.write(0x04);
-        Serial.write(mask);
-        Serial.write(0xA1);
-        Serial.flush();
-
+        _relay_batch_update = true;
     #endif
 
     #if RELAY_PROVIDER == RELAY_PROVIDER_STM
@@ -301,7 +425,7 @@ void _relayProviderStatus(unsigned char id, bool status) {
                 lightState(status);
             }
 
-            lightUpdate(true, true);
+            _relay_batch_update = true;
             return;
 
         }
@@ -315,6 +439,21 @@ void _relayProviderStatus(unsigned char id, bool status) {
         // If this is a light, all dummy relays have already been processed above
         // we reach here if the user has toggled a physical relay
 
+        #if RELAY_PROVIDER == RELAY_PROVIDER_MCP23S08
+            // Expander pins share the OLAT register, write them all at once
+            if ((_relays[id].type == RELAY_TYPE_NORMAL) || (_relays[id].type == RELAY_TYPE_INVERSE)) {
+                const uint32_t bit = (1ul << _relays[id].pin->pin);
+                const bool level = (_relays[id].type == RELAY_TYPE_NORMAL) ? status : !status;
+                _relay_batch_mask |= bit;
+                if (level) {
+                    _relay_batch_status |= bit;
+                } else {
+                    _relay_batch_status &= ~bit;
+                }
+                return;
+            }
+        #endif
+
         if (_relays[id].type == RELAY_TYPE_NORMAL) {
             _relays[id].pin->digitalWrite(status);
         } else if (_relays[id].type == RELAY_TYPE_INVERSE) {
@@ -341,71 +480,167 @@ void _relayProviderStatus(unsigned char id, bool status) {
 
 }
 
-/**
- * Walks the relay vector processing only those relays
- * that have to change to the requested mode
- * @bool mode Requested mode
- */
-void _relayProcess(bool mode) {
+void _relayMaskReport();
 
-    bool changed = false;
+// Write everything that was deferred by the _relayProviderStatus()
+void _relayProviderCommit() {
 
-    for (unsigned char id = 0; id < _relays.size(); id++) {
+    #if RELAY_PROVIDER == RELAY_PROVIDER_DUAL
+        if (_relay_batch_update) {
 
-        bool target = _relays[id].target_status;
+            // Calculate mask
+            unsigned char mask=0;
+            for (unsigned char i=0; i<_relays.size(); i++) {
+                if (_relays[i].current_status) mask = mask + (1 << i);
+            }
 
-        // Only process the relays we have to change
-        if (target == _relays[id].current_status) continue;
+            DEBUG_MSG_P(PSTR("[RELAY] [DUAL] Sending relay mask: %d\n"), mask);
 
-        // Only process the relays we have to change to the requested mode
-        if (target != mode) continue;
+            // Send it to F330
+            Serial.flush();
+            Serial.write(0xA0);
+            Serial.write(0x04);
+            Serial.write(mask);
+            Serial.write(0xA1);
+            Serial.flush();
 
-        // Only process if the change delay has expired
-        if (_relays[id].change_delay && (millis() - _relays[id].change_start < _relays[id].change_delay)) continue;
+        }
+    #endif
 
-        // Purge existing delay in case of cancelation
-        _relays[id].change_delay = 0;
-        changed = true;
+    #if RELAY_PROVIDER == RELAY_PROVIDER_LIGHT
+        if (_relay_batch_update) {
+            lightUpdate(true, true);
+        }
+    #endif
 
-        DEBUG_MSG_P(PSTR("[RELAY] #%d set to %s\n"), id, target ? "ON" : "OFF");
+    #if RELAY_PROVIDER == RELAY_PROVIDER_MCP23S08
+        if (_relay_batch_mask) {
+            MCP23S08SetPins(_relay_batch_mask, _relay_batch_status);
+        }
+    #endif
 
-        // Call the provider to perform the action
-        _relayProviderStatus(id, target);
+    _relay_batch_mask = 0;
+    _relay_batch_status = 0;
+    _relay_batch_update = false;
 
-        // Send to Broker
-        #if BROKER_SUPPORT
-            StatusBroker::Publish(MQTT_TOPIC_RELAY, id, target);
-        #endif
+}
 
-        // Send MQTT
-        #if MQTT_SUPPORT
-            relayMQTT(id);
-        #endif
+void _relayApply(unsigned char id) {
 
-        #if WEB_SUPPORT
-            _relay_report_ws = true;
-        #endif
+    const bool target = _relays[id].target_status;
+
+    // Purge existing delay in case of cancelation
+    _relays[id].change_delay = 0;
 
-        if (!_relayRecursive) {
+    DEBUG_MSG_P(PSTR("[RELAY] #%d set to %s\n"), id, target ? "ON" : "OFF");
 
-            relayPulse(id);
+    // Call the provider to perform the action
+    _relayProviderStatus(id, target);
+    _relay_pending &= ~(1ul << id);
+
+}
 
-            // We will trigger a eeprom save only if
-            // we care about current relay status on boot
-            const auto boot_mode = getSetting({"relayBoot", id}, RELAY_BOOT_MODE);
-            const bool save_eeprom = ((RELAY_BOOT_SAME == boot_mode) || (RELAY_BOOT_TOGGLE == boot_mode));
-            _relay_save_timer.once_ms(RELAY_SAVE_DELAY, relaySave, save_eeprom);
+void _relayReport(unsigned char id, bool& save_eeprom) {
 
+    // Send to Broker
+    #if BROKER_SUPPORT
+        StatusBroker::Publish(MQTT_TOPIC_RELAY, id, _relays[id].target_status);
+    #endif
+
+    // Send MQTT
+    #if MQTT_SUPPORT
+        relayMQTT(id);
+    #endif
+
+    #if WEB_SUPPORT
+        _relay_report_ws = true;
+    #endif
+
+    if (!_relayRecursive) {
+
+        relayPulse(id);
+
+        // We will trigger a eeprom save only if
+        // we care about current relay status on boot
+        save_eeprom = save_eeprom || _relayBootSaves(_relays[id].boot_mode);
+
+    }
+
+    _relays[id].report = false;
+    _relays[id].group_report = false;
+
+}
+
+/**
+ * Applies every pending change that is due, relays turning OFF first.
+ * Provider writes are committed once for the whole batch
+ */
+void _relayProcess() {
+
+    if (!_relay_pending) return;
+
+    const auto timestamp = millis();
+    if (timestamp - _relay_pending_start < _relay_pending_delay) return;
+
+    uint32_t due_off = 0;
+    uint32_t due_on = 0;
+    unsigned long next = 0;
+    bool waiting = false;
+
+    uint32_t pending = _relay_pending;
+    while (pending) {
+        const unsigned char id = __builtin_ctz(pending);
+        const uint32_t bit = (1ul << id);
+        pending &= ~bit;
+
+        const auto& relay = _relays[id];
+        if (relay.target_status == relay.current_status) {
+            _relay_pending &= ~bit;
+            continue;
         }
 
-        _relays[id].report = false;
-        _relays[id].group_report = false;
+        const auto remaining = _relayRemaining(relay, timestamp);
+        if (remaining) {
+            next = waiting ? std::min(next, remaining) : remaining;
+            waiting = true;
+        } else if (relay.target_status) {
+            due_on |= bit;
+        } else {
+            due_off |= bit;
+        }
+    }
+
+    _relay_pending_start = timestamp;
+    _relay_pending_delay = next;
+
+    const uint32_t due = due_off | due_on;
+    if (!due) return;
+
+    for (uint32_t mask = due_off; mask; mask &= mask - 1) {
+        _relayApply(__builtin_ctz(mask));
+    }
+    for (uint32_t mask = due_on; mask; mask &= mask - 1) {
+        _relayApply(__builtin_ctz(mask));
+    }
+
+    _relayProviderCommit();
 
+    bool save_eeprom = false;
+    for (uint32_t mask = due; mask; mask &= mask - 1) {
+        _relayReport(__builtin_ctz(mask), save_eeprom);
+    }
+
+    if (!_relayRecursive) {
+        _relay_save_timer.once_ms(RELAY_SAVE_DELAY, relaySave, save_eeprom);
+    }
+
+    if (_relay_report_mask) {
+        _relayMaskReport();
     }
 
     // Whenever we are using sync modes and any relay had changed the state, check if we can unlock
     const bool needs_unlock = ((_relay_sync_mode == RELAY_SYNC_NONE_OR_ONE) || (_relay_sync_mode == RELAY_SYNC_ONE));
-    if (_relay_sync_locked && needs_unlock && changed) {
+    if (_relay_sync_locked && needs_unlock) {
         _relaySyncUnlock();
     }
 }
@@ -557,6 +792,7 @@ bool relayStatus(unsigned char id, bool status, bool report, bool group_report)
             _relays[id].report = false;
             _relays[id].group_report = false;
             _relays[id].change_delay = 0;
+            _relaySchedule(id);
             changed = true;
         }
 
@@ -601,6 +837,7 @@ bool relayStatus(unsigned char id, bool status, bool report, bool group_report)
         if (report) _relays[id].report = true;
         if (group_report) _relays[id].group_report = true;
 
+        _relaySchedule(id);
         relaySync(id);
 
         DEBUG_MSG_P(PSTR("[RELAY] #%d scheduled %s in %u ms\n"),
@@ -638,6 +875,57 @@ bool relayStatusTarget(unsigned char id) {
     return _relays[id].target_status;
 }
 
+// Bit N is the relay #N. Relays outside of the `mask` are not changed.
+// Changes with the same delay are applied by the same _relayProcess() call. Every changed relay
+// still reports its own (retained) relay/<N> state, batched by the MQTT JSON mode or the pipeline,
+// followed by the relay/mask message once all of them are applied
+bool relayStatusMask(uint32_t mask, uint32_t status, bool report) {
+
+    mask &= _relayMaskAll();
+
+    bool changed = false;
+    for (uint32_t bits = mask; bits; bits &= bits - 1) {
+        const unsigned char id = __builtin_ctz(bits);
+        changed = relayStatus(id, status & (1ul << id), report, true) || changed;
+    }
+
+    if (report && mask) {
+        _relay_report_mask |= mask;
+        _relayMaskReport();
+    }
+
+    return changed;
+
+}
+
+bool relayStatusMask(uint32_t mask, uint32_t status) {
+    #if MQTT_SUPPORT
+        return relayStatusMask(mask, status, mqttForward());
+    #else
+        return relayStatusMask(mask, status, false);
+    #endif
+}
+
+uint32_t relayStatusMask() {
+    uint32_t status = 0;
+    for (unsigned char id = 0; id < _relays.size(); ++id) {
+        if (_relays[id].current_status) status |= (1ul << id);
+    }
+    return status;
+}
+
+// Relay status bits of every relay at once, once all of the requested changes are applied
+void _relayMaskReport() {
+
+    if (_relay_report_mask & _relay_pending) return;
+    _relay_report_mask = 0;
+
+    #if MQTT_SUPPORT
+        mqttSend(MQTT_TOPIC_RELAY "/" MQTT_TOPIC_RELAY_MASK, u32toString(relayStatusMask(), 2).c_str());
+    #endif
+
+}
+
 void relaySync(unsigned char id) {
 
     // No sync if none or only one relay
@@ -798,7 +1086,7 @@ void _relayBoot() {
     bool status;
     for (unsigned char i=0; i<relayCount(); ++i) {
 
-        const auto boot_mode = getSetting({"relayBoot", i}, RELAY_BOOT_MODE);
+        const auto boot_mode = _relays[i].boot_mode;
         DEBUG_MSG_P(PSTR("[RELAY] Relay #%u boot mode %d\n"), i, boot_mode);
 
         status = false;
@@ -841,6 +1129,7 @@ void _relayBoot() {
         #endif
 
         _relays[i].lock = lock;
+        _relaySchedule(i);
 
     }
 
@@ -859,6 +1148,7 @@ void _relayConfigure() {
 
         _relays[i].delay_on = getSetting({"relayDelayOn", i}, _relayDelayOn(i));
         _relays[i].delay_off = getSetting({"relayDelayOff", i}, _relayDelayOff(i));
+        _relays[i].boot_mode = getSetting({"relayBoot", i}, RELAY_BOOT_MODE);
 
         // make sure pin is valid before continuing with writes
         if (!static_cast<bool>(*_relays[i].pin)) continue;
@@ -970,7 +1260,7 @@ void _relayWebSocketSendRelays(JsonObject& root) {
 
         type.add(_relays[i].type);
         reset.add(_relays[i].reset_pin->pin);
-        boot.add(getSetting({"relayBoot", i}, RELAY_BOOT_MODE));
+        boot.add(_relays[i].boot_mode);
 
         pulse.add(_relays[i].pulse);
         pulse_time.add(_relays[i].pulse_ms / 1000.0);
@@ -1011,7 +1301,22 @@ void _relayWebSocketOnAction(uint32_t client_id, const char * action, JsonObject
 
     if (strcmp(action, "relay") != 0) return;
 
-    if (data.containsKey("status")) {
+    if (data.containsKey("mask")) {
+
+        // Anything else but the array or the string is ignored
+        uint32_t mask, status;
+        bool parsed = false;
+        if (data.is<JsonArray&>("mask")) {
+            parsed = _relayParseMask(data["mask"].as<JsonArray&>(), mask, status);
+        } else if (data.is<const char*>("mask")) {
+            parsed = _relayParseMask(data["mask"].as<const char*>(), mask, status);
+        }
+
+        if (parsed) {
+            relayStatusMask(mask, status);
+        }
+
+    } else if (data.containsKey("status")) {
 
         unsigned int relayID = 0;
         if (data.containsKey("id") && data.is<int>("id")) {
@@ -1045,6 +1350,21 @@ void relaySetupAPI() {
 
     char key[20];
 
+    // All relays at once
+    apiRegister(MQTT_TOPIC_RELAY "/" MQTT_TOPIC_RELAY_MASK,
+        [](char * buffer, size_t len) {
+            snprintf_P(buffer, len, PSTR("%s"), u32toString(relayStatusMask(), 2).c_str());
+        },
+        [](const char * payload) {
+            uint32_t mask, status;
+            if (!_relayParseMask(payload, mask, status)) {
+                DEBUG_MSG_P(PSTR("[RELAY] Wrong mask payload (%s)\n"), payload);
+                return;
+            }
+            relayStatusMask(mask, status);
+        }
+    );
+
     // API entry points (protected with apikey)
     for (unsigned int relayID=0; relayID<relayCount(); relayID++) {
 
@@ -1206,114 +1526,125 @@ void relayStatusWrap(unsigned char id, PayloadStatus value, bool is_group_topic)
     }
 }
 
-void relayMQTTCallback(unsigned int type, const char * topic, const char * payload) {
+// magnitude is pulse/<relay id>
+void _relayMQTTPulse(const mqtt::match_t& match, const char * payload) {
 
-    if (type == MQTT_CONNECT_EVENT) {
+    unsigned int id;
+    if (!match.number(0, id) || (id >= relayCount())) {
+        DEBUG_MSG_P(PSTR("[RELAY] Wrong relayID (%s)\n"), match.topic);
+        return;
+    }
 
-        // Send status on connect
-        #if (HEARTBEAT_MODE == HEARTBEAT_NONE) or (not HEARTBEAT_REPORT_RELAY)
-            relayMQTT();
-        #endif
+    unsigned long pulse = 1000 * atof(payload);
+    if (0 == pulse) return;
 
-        // Subscribe to own /set topic
-        char relay_topic[strlen(MQTT_TOPIC_RELAY) + 3];
-        snprintf_P(relay_topic, sizeof(relay_topic), PSTR("%s/+"), MQTT_TOPIC_RELAY);
-        mqttSubscribe(relay_topic);
+    if (RELAY_PULSE_NONE != _relays[id].pulse) {
+        DEBUG_MSG_P(PSTR("[RELAY] Overriding relay #%d pulse settings\n"), id);
+    }
 
-        // Subscribe to pulse topic
-        char pulse_topic[strlen(MQTT_TOPIC_PULSE) + 3];
-        snprintf_P(pulse_topic, sizeof(pulse_topic), PSTR("%s/+"), MQTT_TOPIC_PULSE);
-        mqttSubscribe(pulse_topic);
+    _relays[id].pulse_ms = pulse;
+    _relays[id].pulse = relayStatus(id) ? RELAY_PULSE_ON : RELAY_PULSE_OFF;
+    relayToggle(id, true, false);
 
-        #if defined(ITEAD_SONOFF_IFAN02)
-            mqttSubscribe(MQTT_TOPIC_SPEED);
-        #endif
+}
 
-        // Subscribe to group topics
-        for (unsigned char i=0; i < _relays.size(); i++) {
-            const auto t = getSetting({"mqttGroup", i});
-            if (t.length() > 0) mqttSubscribeRaw(t.c_str());
-        }
+// magnitude is relay/mask
+void _relayMQTTMask(const mqtt::match_t& match, const char * payload) {
 
+    uint32_t mask, status;
+    if (!_relayParseMask(payload, mask, status)) {
+        DEBUG_MSG_P(PSTR("[RELAY] Wrong mask payload (%s)\n"), payload);
+        return;
     }
 
-    if (type == MQTT_MESSAGE_EVENT) {
+    relayStatusMask(mask, status, true);
 
-        String t = mqttMagnitude((char *) topic);
+}
 
-        // magnitude is relay/#/pulse
-        if (t.startsWith(MQTT_TOPIC_PULSE)) {
+// magnitude is relay/<relay id>
+void _relayMQTTStatus(const mqtt::match_t& match, const char * payload) {
 
-            unsigned int id = t.substring(strlen(MQTT_TOPIC_PULSE)+1).toInt();
+    // relay/mask is handled above
+    if (match.count
+        && (match.captures[0].length == (sizeof(MQTT_TOPIC_RELAY_MASK) - 1))
+        && (strncmp_P(match.captures[0].data, PSTR(MQTT_TOPIC_RELAY_MASK), match.captures[0].length) == 0)) {
+        return;
+    }
 
-            if (id >= relayCount()) {
-                DEBUG_MSG_P(PSTR("[RELAY] Wrong relayID (%d)\n"), id);
-                return;
-            }
+    unsigned int id;
+    if (!match.number(0, id) || (id >= relayCount())) {
+        DEBUG_MSG_P(PSTR("[RELAY] Wrong relayID (%s)\n"), match.topic);
+        return;
+    }
 
-            unsigned long pulse = 1000 * atof(payload);
-            if (0 == pulse) return;
+    auto value = relayParsePayload(payload);
+    if (value == PayloadStatus::Unknown) return;
 
-            if (RELAY_PULSE_NONE != _relays[id].pulse) {
-                DEBUG_MSG_P(PSTR("[RELAY] Overriding relay #%d pulse settings\n"), id);
-            }
+    relayStatusWrap(id, value, false);
 
-            _relays[id].pulse_ms = pulse;
-            _relays[id].pulse = relayStatus(id) ? RELAY_PULSE_ON : RELAY_PULSE_OFF;
-            relayToggle(id, true, false);
+}
 
-            return;
+// Group topic of the relay `match.id`
+void _relayMQTTGroup(const mqtt::match_t& match, const char * payload) {
 
-        }
+    const unsigned char id = match.id;
+    if (id >= relayCount()) return;
 
-        // magnitude is relay/#
-        if (t.startsWith(MQTT_TOPIC_RELAY)) {
+    auto value = relayParsePayload(payload);
+    if (value == PayloadStatus::Unknown) return;
 
-            // Get relay ID
-            unsigned int id = t.substring(strlen(MQTT_TOPIC_RELAY)+1).toInt();
-            if (id >= relayCount()) {
-                DEBUG_MSG_P(PSTR("[RELAY] Wrong relayID (%d)\n"), id);
-                return;
-            }
+    if ((value == PayloadStatus::On) || (value == PayloadStatus::Off)) {
+        if (getSetting({"mqttGroupSync", id}, RELAY_GROUP_SYNC_NORMAL) == RELAY_GROUP_SYNC_INVERSE) {
+            value = _relayStatusInvert(value);
+        }
+    }
 
-            // Get value
-            auto value = relayParsePayload(payload);
-            if (value == PayloadStatus::Unknown) return;
+    DEBUG_MSG_P(PSTR("[RELAY] Matched group topic for relayID %d\n"), id);
+    relayStatusWrap(id, value, true);
 
-            relayStatusWrap(id, value, false);
+}
 
-            return;
-        }
+#if defined (ITEAD_SONOFF_IFAN02)
 
+// Itead Sonoff IFAN02
+void _relayMQTTSpeed(const mqtt::match_t&, const char * payload) {
+    setSpeed(atoi(payload));
+}
 
-        // Check group topics
-        for (unsigned char i=0; i < _relays.size(); i++) {
+#endif
 
-            const String t = getSetting({"mqttGroup", i});
+void relayMQTTCallback(unsigned int type, const char * topic, const char * payload) {
 
-            if ((t.length() > 0) && t.equals(topic)) {
+    if (type == MQTT_CONNECT_EVENT) {
 
-                auto value = relayParsePayload(payload);
-                if (value == PayloadStatus::Unknown) return;
+        // Send status on connect
+        #if (HEARTBEAT_MODE == HEARTBEAT_NONE) or (not HEARTBEAT_REPORT_RELAY)
+            relayMQTT();
+        #endif
 
-                if ((value == PayloadStatus::On) || (value == PayloadStatus::Off)) {
-                    if (getSetting({"mqttGroupSync", i}, RELAY_GROUP_SYNC_NORMAL) == RELAY_GROUP_SYNC_INVERSE) {
-                        value = _relayStatusInvert(value);
-                    }
-                }
+        // Subscribe to own /set topic
+        char relay_topic[strlen(MQTT_TOPIC_RELAY) + 3];
+        snprintf_P(relay_topic, sizeof(relay_topic), PSTR("%s/+"), MQTT_TOPIC_RELAY);
+        mqttSubscribe(relay_topic);
 
-                DEBUG_MSG_P(PSTR("[RELAY] Matched group topic for relayID %d\n"), i);
-                relayStatusWrap(i, value, true);
+        // Subscribe to pulse topic
+        char pulse_topic[strlen(MQTT_TOPIC_PULSE) + 3];
+        snprintf_P(pulse_topic, sizeof(pulse_topic), PSTR("%s/+"), MQTT_TOPIC_PULSE);
+        mqttSubscribe(pulse_topic);
 
-            }
-        }
+        #if defined(ITEAD_SONOFF_IFAN02)
+            mqttSubscribe(MQTT_TOPIC_SPEED);
+        #endif
 
-        // Itead Sonoff IFAN02
-        #if defined (ITEAD_SONOFF_IFAN02)
-            if (t.startsWith(MQTT_TOPIC_SPEED)) {
-                setSpeed(atoi(payload));
+        // Subscribe to group topics, which could have changed since the last time
+        mqttUnregisterTopics(_relayMQTTGroup);
+        for (unsigned char i=0; i < _relays.size(); i++) {
+            const auto t = getSetting({"mqttGroup", i});
+            if (t.length() > 0) {
+                mqttSubscribeRaw(t.c_str());
+                mqttRegisterRawTopic(t.c_str(), _relayMQTTGroup, i);
             }
-        #endif
+        }
 
     }
 
@@ -1335,6 +1666,12 @@ void relayMQTTCallback(unsigned int type, const char * topic, const char * paylo
 
 void relaySetupMQTT() {
     mqttRegister(relayMQTTCallback);
+    mqttRegisterTopic(MQTT_TOPIC_RELAY "/+", _relayMQTTStatus);
+    mqttRegisterTopic(MQTT_TOPIC_RELAY "/" MQTT_TOPIC_RELAY_MASK, _relayMQTTMask);
+    mqttRegisterTopic(MQTT_TOPIC_PULSE "/+", _relayMQTTPulse);
+    #if defined (ITEAD_SONOFF_IFAN02)
+        mqttRegisterTopic(MQTT_TOPIC_SPEED, _relayMQTTSpeed);
+    #endif
 }
 
 #endif
@@ -1384,6 +1721,19 @@ void _relayInitCommands() {
         terminalOK();
     });
 
+    terminalRegisterCommand(F("RELAY.MASK"), [](const terminal::CommandContext& ctx) {
+        if (ctx.argc > 1) {
+            uint32_t mask, status;
+            if (!_relayParseMask(ctx.argv[1].c_str(), mask, status)) {
+                terminalError(F("Wrong mask"));
+                return;
+            }
+            relayStatusMask(mask, status);
+        }
+        DEBUG_MSG_P(PSTR("Status: %s\n"), u32toString(relayStatusMask(), 2).c_str());
+        terminalOK();
+    });
+
     #if 0
     terminalRegisterCommand(F("RELAY.INFO"), [](const terminal::CommandContext&) {
         DEBUG_MSG_P(PSTR("    cur tgt pin type reset lock  delay_on   delay_off  pulse  pulse_ms\n"));
@@ -1412,8 +1762,7 @@ void _relayInitCommands() {
 //------------------------------------------------------------------------------
 
 void _relayLoop() {
-    _relayProcess(false);
-    _relayProcess(true);
+    _relayProcess();
     #if WEB_SUPPORT
         if (_relay_report_ws) {
             wsPost(_relayWebSocketUpdate);
@@ -1433,6 +1782,11 @@ void relaySetupDummy(size_t size, bool reconfigure) {
     _relayDummy = size;
     _relays.resize(new_size);
 
+    // Forget about the removed relays
+    if (new_size < RelaysMax) {
+        _relay_pending &= (1ul << new_size) - 1;
+    }
+
     if (reconfigure) {
         _relayConfigure();
     }
@@ -1529,7 +1883,7 @@ void relaySetup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(_relayLoop);
+    espurnaRegisterLoop(_relayLoop, PSTR("relay"));
     espurnaRegisterReload(_relayConfigure);
 
     DEBUG_MSG_P(PSTR("[RELAY] Number of relays: %d\n"), _relays.size());
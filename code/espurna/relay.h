@@ -26,6 +26,11 @@ bool relayStatus(unsigned char id, bool status);
 bool relayStatus(unsigned char id);
 bool relayStatusTarget(unsigned char id);
 
+// bit N is the status of the relay #N, only relays set in the `mask` are changed
+bool relayStatusMask(uint32_t mask, uint32_t status, bool report);
+bool relayStatusMask(uint32_t mask, uint32_t status);
+uint32_t relayStatusMask();
+
 void relayToggle(unsigned char id, bool report, bool group_report);
 void relayToggle(unsigned char id);
 
@@ -63,6 +63,9 @@ struct rfb_message_t {
 };
 static std::queue<rfb_message_t> _rfb_message_queue;
 
+espurna_task_t _rfb_send_task = EspurnaTaskNone;
+unsigned long _rfb_send_last = 0;
+
 #if RFB_DIRECT
     RCSwitch * _rfModem;
     bool _learning = false;
@@ -467,6 +470,10 @@ void _rfbEnqueue(uint8_t * code, unsigned char times) {
     message.times = times;
     _rfb_message_queue.push(message);
 
+    // Keep at least RF_SEND_DELAY between the sendings
+    const auto elapsed = millis() - _rfb_send_last;
+    espurnaTaskSchedule(_rfb_send_task, (elapsed < RF_SEND_DELAY) ? (RF_SEND_DELAY - elapsed) : 0);
+
 }
 
 void _rfbSendQueued() {
@@ -476,14 +483,11 @@ void _rfbSendQueued() {
     // Check if there is something in the queue
     if (_rfb_message_queue.empty()) return;
 
-    static unsigned long last = 0;
-    if (millis() - last < RF_SEND_DELAY) return;
-    last = millis();
-
     // Pop the first message and send it
     rfb_message_t message = _rfb_message_queue.front();
     _rfb_message_queue.pop();
     _rfbSendImpl(message.code);
+    _rfb_send_last = millis();
 
     // Push it to the stack again if we need to send it more than once
     if (message.times > 1) {
@@ -491,6 +495,10 @@ void _rfbSendQueued() {
         _rfb_message_queue.push(message);
     }
 
+    if (!_rfb_message_queue.empty()) {
+        espurnaTaskSchedule(_rfb_send_task, RF_SEND_DELAY);
+    }
+
     yield();
 
 }
@@ -816,10 +824,13 @@ void rfbSetup() {
     #endif
 
     // Register loop only when properly configured
-    espurnaRegisterLoop([]() -> void {
-        _rfbReceiveImpl();
-        _rfbSendQueued();
-    });
+    espurnaRegisterLoop(_rfbReceiveImpl, PSTR("rfbridge"));
+
+    // Queued messages are only sent when scheduled by the _rfbEnqueue()
+    _rfb_send_task = espurnaRegisterTask(_rfbSendQueued, PSTR("rfbridge send"));
+    if (!_rfb_message_queue.empty()) {
+        espurnaTaskSchedule(_rfb_send_task);
+    }
 
 }
 
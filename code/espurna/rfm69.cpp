@@ -329,7 +329,7 @@ void rfm69Setup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(_rfm69Loop);
+    espurnaRegisterLoop(_rfm69Loop, PSTR("rfm69"));
     espurnaRegisterReload(_rfm69Configure);
 
 }
@@ -19,14 +19,69 @@ Copyright (C) 2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "terminal.h"
 #include "ws.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 // -----------------------------------------------------------------------------
 // Custom commands
 // -----------------------------------------------------------------------------
 
 rpn_context _rpn_ctxt;
 bool _rpn_run = false;
+bool _rpn_periodic = false;
+bool _rpn_sticky = (1 == RPN_STICKY);
 unsigned long _rpn_delay = RPN_DELAY;
-unsigned long _rpn_last = 0;
+
+// Rules are loaded once on configure. Every `$variable` of the rule is registered as its dependency,
+// so the variable update only schedules the rules that are actually reading it.
+// Rules without any variables (e.g. using only time operators) are scheduled on every update.
+//
+// Each rule is triggered separately:
+// - `rpnRuleDelay<N>` ms after the last update of its variables (debounce, `rpnDelay` by default)
+// - every `rpnRuleEvery<N>` seconds, when set
+// Stateful operators (`changed`, `rising`, `falling`, `hysteresis`) keep their values in the `state`,
+// in the order they appear in the expression. The state is preserved while the expression stays the same.
+
+struct rpn_rule_t {
+    String expression;
+    bool independent;
+    bool pending;
+    unsigned long delay;
+    unsigned long every;
+    unsigned long updated;
+    unsigned long last;
+    std::vector<float> state;
+};
+
+rpn_rule_t* _rpn_current = nullptr;
+size_t _rpn_current_state = 0;
+
+struct rpn_variable_t {
+    String name;
+    std::vector<unsigned char> rules;
+};
+
+std::vector<rpn_rule_t> _rpn_rules;
+std::vector<rpn_variable_t> _rpn_variables;
+
+#if SENSOR_SUPPORT
+
+// Variable of the sensor magnitude, so the name is only formatted once
+struct rpn_magnitude_t {
+    unsigned char type;
+    unsigned char index;
+    size_t variable;
+};
+
+std::vector<rpn_magnitude_t> _rpn_magnitudes;
+
+#endif
+
+#if MQTT_SUPPORT
+settings::CachedList<String, SETTINGS_MAX_LIST_COUNT> _rpn_topics("rpnTopic", String());
+settings::CachedList<String, SETTINGS_MAX_LIST_COUNT> _rpn_names("rpnName", String());
+#endif
 
 // -----------------------------------------------------------------------------
 
@@ -64,12 +119,24 @@ void _rpnWebSocketOnConnected(JsonObject& root) {
 
 #if MQTT_SUPPORT
 
+void _rpnVariableSet(size_t index, float value);
+size_t _rpnVariableIndex(const char* name);
+
+// Topic of the variable `match.id`
+void _rpnMQTTVariable(const mqtt::match_t& match, const char * payload) {
+    const auto& rpn_name = _rpn_names.get(match.id);
+    if (rpn_name.length()) {
+        _rpnVariableSet(_rpnVariableIndex(rpn_name.c_str()), atof(payload));
+    }
+}
+
 void _rpnMQTTSubscribe() {
-    unsigned char i = 0;
-    String rpn_topic = getSetting({"rpnTopic", i});
-    while (rpn_topic.length()) {
+    mqttUnregisterTopics(_rpnMQTTVariable);
+    for (unsigned char i = 0; i < _rpn_topics.capacity(); ++i) {
+        const auto& rpn_topic = _rpn_topics.get(i);
+        if (!rpn_topic.length()) break;
         mqttSubscribeRaw(rpn_topic.c_str());
-        rpn_topic = getSetting({"rpnTopic", ++i});
+        mqttRegisterRawTopic(rpn_topic.c_str(), _rpnMQTTVariable, i);
     }
 }
 
@@ -79,49 +146,154 @@ void _rpnMQTTCallback(unsigned int type, const char * topic, const char * payloa
         _rpnMQTTSubscribe();
     }
 
-    if (type == MQTT_MESSAGE_EVENT) {
-        unsigned char i = 0;
-        String rpn_topic = getSetting({"rpnTopic", i});
-        while (rpn_topic.length()) {
-            if (rpn_topic.equals(topic)) {
-                String rpn_name = getSetting({"rpnName", i});
-                if (rpn_name.length()) {
-                    rpn_variable_set(_rpn_ctxt, rpn_name.c_str(), atof(payload));
-                    _rpn_last = millis();
-                    _rpn_run = true;
-                    break;
-                }
-            }
-            rpn_topic = getSetting({"rpnTopic", ++i});
+}
+#endif // MQTT_SUPPORT
+
+// Variables are never removed, so the index stays valid across the reloads
+size_t _rpnVariableIndex(const char* name) {
+    for (size_t index = 0; index < _rpn_variables.size(); ++index) {
+        if (_rpn_variables[index].name.equals(name)) {
+            return index;
         }
     }
 
+    _rpn_variables.push_back({name, {}});
+    return _rpn_variables.size() - 1;
+}
+
+void _rpnRuleSchedule(rpn_rule_t& rule, unsigned long timestamp) {
+    rule.pending = true;
+    rule.updated = timestamp;
+}
+
+void _rpnVariableSet(size_t index, float value) {
+
+    auto& variable = _rpn_variables[index];
+    rpn_variable_set(_rpn_ctxt, variable.name.c_str(), value);
+
+    const auto timestamp = millis();
+    for (auto rule : variable.rules) {
+        _rpnRuleSchedule(_rpn_rules[rule], timestamp);
+    }
+
+    for (auto& rule : _rpn_rules) {
+        if (rule.independent) {
+            _rpnRuleSchedule(rule, timestamp);
+        }
+    }
+
+    _rpn_run = true;
+
+}
+
+// Same tokens as the RPNLib parser, anything starting with `$` is the variable
+void _rpnRuleDependencies(unsigned char rule, const String& expression) {
+
+    const char* ptr = expression.c_str();
+    bool independent = true;
+
+    while (*ptr) {
+        while (*ptr == ' ') ++ptr;
+        const char* start = ptr;
+        while (*ptr && (*ptr != ' ')) ++ptr;
+
+        if ((*start != '$') || (ptr - start < 2)) continue;
+
+        const String name = expression.substring(start - expression.c_str() + 1, ptr - expression.c_str());
+        auto& rules = _rpn_variables[_rpnVariableIndex(name.c_str())].rules;
+        if (std::find(rules.begin(), rules.end(), rule) == rules.end()) {
+            rules.push_back(rule);
+        }
+        independent = false;
+    }
+
+    _rpn_rules[rule].independent = independent;
+
+}
+
+void _rpnRulesLoad() {
+
+    for (auto& variable : _rpn_variables) {
+        variable.rules.clear();
+    }
+
+    // Settings are reloaded on every save, keep the state of the rules that did not change.
+    // Otherwise, `rising` and `falling` would be re-armed and trigger again
+    auto previous = std::move(_rpn_rules);
+
+    _rpn_current = nullptr;
+    _rpn_rules.clear();
+    _rpn_periodic = false;
+
+    const auto timestamp = millis();
+
+    unsigned char i = 0;
+    String rule = getSetting({"rpnRule", i});
+    while (rule.length()) {
+        const unsigned long delay = getSetting({"rpnRuleDelay", i}, _rpn_delay);
+        const unsigned long every = 1000ul * getSetting({"rpnRuleEvery", i}, 0ul);
+        _rpn_periodic = _rpn_periodic || every;
+
+        rpn_rule_t entry {rule, true, false, delay, every, timestamp, timestamp, {}};
+
+        auto it = std::find_if(previous.begin(), previous.end(), [&](const rpn_rule_t& old) {
+            return old.expression.equals(rule);
+        });
+        if (it != previous.end()) {
+            entry.pending = it->pending;
+            entry.updated = it->updated;
+            entry.last = it->last;
+            entry.state = std::move(it->state);
+            previous.erase(it);
+        }
+
+        _rpn_rules.push_back(std::move(entry));
+        _rpnRuleDependencies(i, _rpn_rules.back().expression);
+        rule = getSetting({"rpnRule", ++i});
+    }
+
 }
-#endif // MQTT_SUPPORT
 
 void _rpnConfigure() {
     #if MQTT_SUPPORT
         if (mqttConnected()) _rpnMQTTSubscribe();
     #endif
     _rpn_delay = getSetting("rpnDelay", RPN_DELAY);
+    _rpn_sticky = getSetting("rpnSticky", 1 == RPN_STICKY);
+    _rpnRulesLoad();
 }
 
-void _rpnBrokerCallback(const String& topic, unsigned char id, double value, const char*) {
+void _rpnBrokerStatus(const String& topic, unsigned char id, unsigned int value) {
 
     char name[32] = {0};
-
     snprintf(name, sizeof(name), "%s%u", topic.c_str(), id);
-    rpn_variable_set(_rpn_ctxt, name, value);
 
-    _rpn_last = millis();
-    _rpn_run = true;
+    _rpnVariableSet(_rpnVariableIndex(name), value);
 
 }
 
-void _rpnBrokerStatus(const String& topic, unsigned char id, unsigned int value) {
-    _rpnBrokerCallback(topic, id, double(value), nullptr);
+#if SENSOR_SUPPORT
+
+void _rpnBrokerSensor(unsigned char type, unsigned char index, double value, unsigned char) {
+
+    for (const auto& magnitude : _rpn_magnitudes) {
+        if ((magnitude.type == type) && (magnitude.index == index)) {
+            _rpnVariableSet(magnitude.variable, value);
+            return;
+        }
+    }
+
+    char name[32] = {0};
+    snprintf(name, sizeof(name), "%s%u", magnitudeTopic(type).c_str(), index);
+
+    const auto variable = _rpnVariableIndex(name);
+    _rpn_magnitudes.push_back({type, index, variable});
+    _rpnVariableSet(variable, value);
+
 }
 
+#endif
+
 #if NTP_SUPPORT
 
 bool _rpnNtpNow(rpn_context & ctxt) {
@@ -170,6 +342,76 @@ void _rpnDump() {
     }
 }
 
+// State of the current rule, allocated on the first evaluation of the operator.
+// Without the rule (e.g. RPN.TEST), operator sees `initial` value every time.
+float& _rpnState(float initial) {
+    static float dummy;
+    if (!_rpn_current) {
+        dummy = initial;
+        return dummy;
+    }
+
+    auto& state = _rpn_current->state;
+    if (_rpn_current_state >= state.size()) {
+        state.push_back(initial);
+    }
+
+    return state[_rpn_current_state++];
+}
+
+// value -> 1 when value differs from the previous evaluation of the rule
+bool _rpnChanged(rpn_context & ctxt) {
+    float value;
+    rpn_stack_pop(ctxt, value);
+
+    float& previous = _rpnState(NAN);
+    const bool changed = !isnan(previous) && (previous != value);
+    previous = value;
+
+    rpn_stack_push(ctxt, changed ? 1 : 0);
+    return true;
+}
+
+// value threshold hysteresis -> 1 once value crosses the threshold,
+// re-armed after it returns `hysteresis` below (rising) or above (falling) the threshold
+bool _rpnEdge(rpn_context & ctxt, bool rising) {
+    float value, threshold, hysteresis;
+    rpn_stack_pop(ctxt, hysteresis);
+    rpn_stack_pop(ctxt, threshold);
+    rpn_stack_pop(ctxt, value);
+
+    const float distance = rising ? (value - threshold) : (threshold - value);
+
+    float& armed = _rpnState(1);
+    bool fired = false;
+    if ((armed > 0) && (distance > 0)) {
+        armed = 0;
+        fired = true;
+    } else if (distance < -hysteresis) {
+        armed = 1;
+    }
+
+    rpn_stack_push(ctxt, fired ? 1 : 0);
+    return true;
+}
+
+// value low high -> 1 above `high`, 0 below `low`, previous output in-between
+bool _rpnHysteresis(rpn_context & ctxt) {
+    float value, low, high;
+    rpn_stack_pop(ctxt, high);
+    rpn_stack_pop(ctxt, low);
+    rpn_stack_pop(ctxt, value);
+
+    float& output = _rpnState(0);
+    if (value > high) {
+        output = 1;
+    } else if (value < low) {
+        output = 0;
+    }
+
+    rpn_stack_push(ctxt, output);
+    return true;
+}
 
 void _rpnInit() {
 
@@ -253,6 +495,16 @@ void _rpnInit() {
         return true;
     });
 
+    // Edge detection, state is kept per rule
+    rpn_operator_set(_rpn_ctxt, "changed", 1, _rpnChanged);
+    rpn_operator_set(_rpn_ctxt, "rising", 3, [](rpn_context & ctxt) {
+        return _rpnEdge(ctxt, true);
+    });
+    rpn_operator_set(_rpn_ctxt, "falling", 3, [](rpn_context & ctxt) {
+        return _rpnEdge(ctxt, false);
+    });
+    rpn_operator_set(_rpn_ctxt, "hysteresis", 3, _rpnHysteresis);
+
     // Accept relay number and numeric API status value (0, 1 and 2)
     #if RELAY_SUPPORT
 
@@ -337,29 +589,51 @@ void _rpnInitCommands() {
 }
 #endif
 
-void _rpnRun() {
+void _rpnRun(rpn_rule_t& rule, unsigned long timestamp) {
 
-    unsigned char i = 0;
-    String rule = getSetting({"rpnRule", i});
-    while (rule.length()) {
-        //DEBUG_MSG_P(PSTR("[RPN] Running \"%s\"\n"), rule.c_str());
-        rpn_process(_rpn_ctxt, rule.c_str(), true);
-        //_rpnDump();
-        rule = getSetting({"rpnRule", ++i});
-        rpn_stack_clear(_rpn_ctxt);
-    }
+    rule.pending = false;
+    rule.last = timestamp;
 
-    if (!getSetting("rpnSticky", 1 == RPN_STICKY)) {
-        rpn_variables_clear(_rpn_ctxt);
-    }
+    _rpn_current = &rule;
+    _rpn_current_state = 0;
+
+    //DEBUG_MSG_P(PSTR("[RPN] Running \"%s\"\n"), rule.expression.c_str());
+    rpn_process(_rpn_ctxt, rule.expression.c_str(), true);
+    //_rpnDump();
+    rpn_stack_clear(_rpn_ctxt);
+
+    _rpn_current = nullptr;
 
 }
 
 void _rpnLoop() {
 
-    if (_rpn_run && (millis() - _rpn_last > _rpn_delay)) {
-        _rpnRun();
-        _rpn_run = false;
+    if (!_rpn_run && !_rpn_periodic) return;
+
+    const auto timestamp = millis();
+    bool pending = false;
+    bool executed = false;
+
+    for (auto& rule : _rpn_rules) {
+        bool run = false;
+        if (rule.pending) {
+            run = (timestamp - rule.updated >= rule.delay);
+            pending = pending || !run;
+        }
+        if (rule.every && (timestamp - rule.last >= rule.every)) {
+            run = true;
+        }
+        if (run) {
+            _rpnRun(rule, timestamp);
+            executed = true;
+        }
+    }
+
+    _rpn_run = pending;
+
+    // Rules still waiting for their delay need the same variables, only clear them when every rule is done
+    if (executed && !pending && !_rpn_sticky) {
+        rpn_variables_clear(_rpn_ctxt);
     }
 
 }
@@ -400,9 +674,7 @@ void rpnSetup() {
                 (tick == NtpTick::EveryHour) ? tick_every_hour.c_str() : nullptr;
 
             if (ptr != nullptr) {
-                rpn_variable_set(_rpn_ctxt, ptr, timestamp);
-                _rpn_last = millis();
-                _rpn_run = true;
+                _rpnVariableSet(_rpnVariableIndex(ptr), timestamp);
             }
         });
     #endif
@@ -410,11 +682,11 @@ void rpnSetup() {
     StatusBroker::Register(_rpnBrokerStatus);
 
     #if SENSOR_SUPPORT
-        SensorReadBroker::Register(_rpnBrokerCallback);
+        SensorReadBroker::Register(_rpnBrokerSensor);
     #endif
 
     espurnaRegisterReload(_rpnConfigure);
-    espurnaRegisterLoop(_rpnLoop);
+    espurnaRegisterLoop(_rpnLoop, PSTR("rpn"));
 
 }
 
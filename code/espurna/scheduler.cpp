@@ -22,6 +22,16 @@ constexpr const int SchedulerDummySwitchId = 0xff;
 
 int _sch_restore = 0;
 
+// Parsed once and refreshed only when settings change, since _schCheck() reads every schedule each minute
+settings::CachedList<int, SCHEDULER_MAX_SCHEDULES> _sch_switch("schSwitch", SchedulerDummySwitchId);
+settings::CachedList<bool, SCHEDULER_MAX_SCHEDULES> _sch_enabled("schEnabled", false);
+settings::CachedList<bool, SCHEDULER_MAX_SCHEDULES> _sch_utc("schUTC", false);
+settings::CachedList<String, SCHEDULER_MAX_SCHEDULES> _sch_weekdays("schWDs", SCHEDULER_WEEKDAYS);
+settings::CachedList<int, SCHEDULER_MAX_SCHEDULES> _sch_hour("schHour", 0);
+settings::CachedList<int, SCHEDULER_MAX_SCHEDULES> _sch_minute("schMinute", 0);
+settings::CachedList<int, SCHEDULER_MAX_SCHEDULES> _sch_action("schAction", 0);
+settings::CachedList<int, SCHEDULER_MAX_SCHEDULES> _sch_type("schType", SCHEDULER_TYPE_SWITCH);
+
 unsigned char schedulableCount() {
     return relayCount()
 #ifdef CURTAIN_SUPPORT
@@ -159,7 +169,7 @@ int _schMinutesLeft(int current_hour, int current_minute, int schedule_hour, int
 }
 
 void _schAction(unsigned char sch_id, int sch_action, int sch_switch) {
-    const auto sch_type = getSetting({"schType", sch_id}, SCHEDULER_TYPE_SWITCH);
+    const auto sch_type = _sch_type.get(sch_id);
 
     if (SCHEDULER_TYPE_SWITCH == sch_type) {
         DEBUG_MSG_P(PSTR("[SCH] Switching switch %d to %d\n"), sch_switch, sch_action);
@@ -239,22 +249,21 @@ void _schCheck(int relay, int daybefore) {
     // Check schedules
     for (unsigned char i = 0; i < SCHEDULER_MAX_SCHEDULES; i++) {
 
-        int sch_switch = getSetting({"schSwitch", i}, SchedulerDummySwitchId);
+        int sch_switch = _sch_switch.get(i);
         if (sch_switch == SchedulerDummySwitchId) break;
 
         // Skip disabled schedules
-        if (!getSetting({"schEnabled", i}, false)) continue;
+        if (!_sch_enabled.get(i)) continue;
 
         // Get the datetime used for the calculation
-        const bool sch_utc = getSetting({"schUTC", i}, false);
+        const bool sch_utc = _sch_utc.get(i);
 
-        String sch_weekdays = getSetting({"schWDs", i}, SCHEDULER_WEEKDAYS);
-        if (_schIsThisWeekday(sch_utc ? calendar_weekday.utc_wday : calendar_weekday.local_wday, sch_weekdays)) {
+        if (_schIsThisWeekday(sch_utc ? calendar_weekday.utc_wday : calendar_weekday.local_wday, _sch_weekdays.get(i))) {
 
-            int sch_hour = getSetting({"schHour", i}, 0);
-            int sch_minute = getSetting({"schMinute", i}, 0);
-            int sch_action = getSetting({"schAction", i}, 0);
-            int sch_type = getSetting({"schType", i}, SCHEDULER_TYPE_SWITCH);
+            int sch_hour = _sch_hour.get(i);
+            int sch_minute = _sch_minute.get(i);
+            int sch_action = _sch_action.get(i);
+            int sch_type = _sch_type.get(i);
 
             int minutes_to_trigger = _schMinutesLeft(
                 sch_utc ? calendar_weekday.utc_hour : calendar_weekday.local_hour,
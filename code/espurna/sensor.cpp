@@ -10,6 +10,7 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 #if SENSOR_SUPPORT
 
+#include <algorithm>
 #include <vector>
 #include <float.h>
 
@@ -25,15 +26,21 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "rtcmem.h"
 #include "ws.h"
 
+#include "sensor_report.h"
+
+#if SENSOR_HISTORY_SUPPORT
+#include "sensor_history.h"
+#endif
+
+#if SENSOR_HISTORY_SPIFFS
+#include <FS.h>
+#endif
+
 //--------------------------------------------------------------------------------
 
 // TODO: namespace { ... } ? sensor ctors need to work though
 
-#include "filters/LastFilter.h"
-#include "filters/MaxFilter.h"
-#include "filters/MedianFilter.h"
-#include "filters/MovingAverageFilter.h"
-#include "filters/SumFilter.h"
+#include "filters/SensorFilter.h"
 
 #include "sensors/BaseSensor.h"
 #include "sensors/BaseEmonSensor.h"
@@ -213,11 +220,17 @@ struct sensor_magnitude_t {
         return _counts[type];
     }
 
+    // Filter storage is allocated in-place for every magnitude. report_every can be larger,
+    // median only uses the last SENSOR_FILTER_CAPACITY values and moving average groups them
+    using sensor_filter_t = SensorFilter<SENSOR_FILTER_CAPACITY>;
+    static_assert((SENSOR_FILTER_CAPACITY >= SENSOR_REPORT_MIN_EVERY) && (SENSOR_FILTER_CAPACITY <= SENSOR_REPORT_MAX_EVERY),
+        "SENSOR_FILTER_CAPACITY must be between SENSOR_REPORT_MIN_EVERY and SENSOR_REPORT_MAX_EVERY");
+
     sensor_magnitude_t();
     sensor_magnitude_t(unsigned char slot, unsigned char index_local, unsigned char type, sensor::Unit units, BaseSensor* sensor);
 
     BaseSensor * sensor;        // Sensor object
-    BaseFilter * filter;        // Filter object
+    sensor_filter_t filter;     // Filter object, stored in-place
 
     unsigned char slot;         // Sensor slot # taken by the magnitude, used to access the measurement
     unsigned char type;         // Type of measurement, returned by the BaseSensor::type(slot)
@@ -228,6 +241,19 @@ struct sensor_magnitude_t {
     sensor::Unit units;         // Units of measurement
     unsigned char decimals;     // Number of decimals in textual representation
 
+    unsigned char report_every; // Report every this many readings of the sensor
+    unsigned char report_count; // ... and the number of readings since the last report
+
+    uint16_t topic_string;      // Topic (with index, when needed) and units, as offsets in the _magnitude_strings
+    uint16_t units_string;
+
+};
+
+// Values that are used for every reading are kept apart from the magnitude description above,
+// in the table with the same index as the _magnitudes
+
+struct sensor_magnitude_value_t {
+
     double last;                // Last raw value from sensor (unfiltered)
     double reported;            // Last reported value
     double min_change;          // Minimum value change to report
@@ -465,71 +491,104 @@ BrokerBind(SensorReportBroker);
 
 std::vector<BaseSensor *> _sensors;
 std::vector<sensor_magnitude_t> _magnitudes;
+std::vector<sensor_magnitude_value_t> _magnitude_values;
 bool _sensors_ready = false;
 
+// Topics and units of every magnitude, as `\0`-terminated strings. Built once by the _sensorConfigure(),
+// so reports don't need to construct them every time
+
+std::vector<char> _magnitude_strings;
+espurna_task_t _sensor_read_task = EspurnaTaskNone;
+
 bool _sensor_realtime = API_REAL_TIME_VALUES;
-unsigned long _sensor_read_interval = 1000 * SENSOR_READ_INTERVAL;
+unsigned long _sensor_read_interval = 0;
 unsigned char _sensor_report_every = SENSOR_REPORT_EVERY;
 
+// Every sensor is read on it's own schedule ("snsRead<sensor #>", defaults to the "snsRead").
+// Entries are kept as a min-heap ordered by the next read time, the read task only wakes up for the earliest one.
+
+struct sensor_read_t {
+    unsigned long due;
+    unsigned long interval;
+    unsigned char sensor;
+};
+
+std::vector<sensor_read_t> _sensor_reads;
+
+// Asynchronous sensors that were started, but did not finish reading yet
+
+struct sensor_async_t {
+    unsigned long started;
+    unsigned char sensor;
+};
+
+std::vector<sensor_async_t> _sensor_async;
+
+// Heap comparator, reversed to keep the earliest entry at the front. Handles millis() overflow.
+bool _sensorReadLater(const sensor_read_t& lhs, const sensor_read_t& rhs) {
+    return static_cast<long>(lhs.due - rhs.due) > 0;
+}
+
+void _sensorReadConfigure();
+bool _sensorReadSensor(BaseSensor* sensor, bool relay_off, bool force = false);
+void _sensorReadDone(bool reported);
+bool _sensorRelayOff();
+
 // -----------------------------------------------------------------------------
 // Private
 // -----------------------------------------------------------------------------
 
+// Default filter for each magnitude, can be changed with the snsFilter setting
+
+FilterType _magnitudeFilterType(unsigned char type) {
+    switch (type) {
+        case MAGNITUDE_ENERGY:
+            return FilterType::Last;
+        case MAGNITUDE_ENERGY_DELTA:
+            return FilterType::Sum;
+        case MAGNITUDE_DIGITAL:
+            return FilterType::Max;
+        // For geiger counting moving average filter is the most appropriate if needed at all.
+        case MAGNITUDE_COUNT:
+        case MAGNITUDE_GEIGER_CPM:
+        case MAGNITUDE_GEIGER_SIEVERT:
+            return FilterType::MovingAverage;
+        default:
+            return FilterType::Median;
+    }
+}
+
 sensor_magnitude_t::sensor_magnitude_t() :
     sensor(nullptr),
-    filter(nullptr),
     slot(0),
     type(0),
     index_local(0),
     index_global(0),
     units(sensor::Unit::None),
     decimals(0),
-    last(0.0),
-    reported(0.0),
-    min_change(0.0),
-    max_change(0.0),
-    correction(0.0)
+    report_every(SENSOR_REPORT_EVERY),
+    report_count(0),
+    topic_string(0),
+    units_string(0)
 {}
 
 sensor_magnitude_t::sensor_magnitude_t(unsigned char slot, unsigned char index_local, unsigned char type, sensor::Unit units, BaseSensor* sensor) :
     sensor(sensor),
-    filter(nullptr),
     slot(slot),
     type(type),
     index_local(index_local),
     index_global(_counts[type]),
     units(units),
     decimals(0),
-    last(0.0),
-    reported(0.0),
-    min_change(0.0),
-    max_change(0.0),
-    correction(0.0)
+    report_every(_sensor_report_every),
+    report_count(0),
+    topic_string(0),
+    units_string(0)
 {
     ++_counts[type];
 
-    switch (type) {
-        case MAGNITUDE_ENERGY:
-            filter = new LastFilter();
-            break;
-        case MAGNITUDE_ENERGY_DELTA:
-            filter = new SumFilter();
-            break;
-        case MAGNITUDE_DIGITAL:
-            filter = new MaxFilter();
-            break;
-        // For geiger counting moving average filter is the most appropriate if needed at all.
-        case MAGNITUDE_COUNT:
-        case MAGNITUDE_GEIGER_CPM:
-        case MAGNITUDE_GEIGER_SIEVERT:
-            filter = new MovingAverageFilter();
-            break;
-        default:
-            filter = new MedianFilter();
-            break;
-    }
-
-    filter->resize(_sensor_report_every);
+    filter.setType(_magnitudeFilterType(type));
+    filter.resize(report_every);
 }
 
 // Hardcoded decimals for each magnitude
@@ -768,7 +827,7 @@ String _magnitudeUnits(const sensor_magnitude_t& magnitude) {
 
 String magnitudeUnits(unsigned char index) {
     if (index >= magnitudeCount()) return String();
-    return _magnitudeUnits(_magnitudes[index]);
+    return String(_magnitudeString(_magnitudes[index].units_string));
 }
 
 // Choose unit based on type of magnitude we use
@@ -816,7 +875,9 @@ sensor::Unit _magnitudeUnitFilter(const sensor_magnitude_t& magnitude, sensor::U
     return result;
 };
 
-double _magnitudeProcess(const sensor_magnitude_t& magnitude, double value) {
+double _magnitudeProcess(unsigned char index, double value) {
+
+    const auto& magnitude = _magnitudes[index];
 
     // Process input (sensor) units and convert to the ones that magnitude specifies as output
     switch (magnitude.sensor->units(magnitude.slot)) {
@@ -849,7 +910,7 @@ double _magnitudeProcess(const sensor_magnitude_t& magnitude, double value) {
             break;
     }
 
-    value = value + magnitude.correction;
+    value = value + _magnitude_values[index].correction;
 
     return roundTo(value, magnitude.decimals);
 
@@ -859,6 +920,33 @@ String _magnitudeDescription(const sensor_magnitude_t& magnitude) {
     return magnitude.sensor->description(magnitude.slot);
 }
 
+const char* _magnitudeString(uint16_t offset) {
+    return _magnitude_strings.empty() ? "" : &_magnitude_strings[offset];
+}
+
+uint16_t _magnitudeStringAdd(const char* string) {
+    const uint16_t offset = _magnitude_strings.size();
+    _magnitude_strings.insert(_magnitude_strings.end(), string, string + strlen(string) + 1);
+    return offset;
+}
+
+void _magnitudeStringsConfigure() {
+    _magnitude_strings.clear();
+
+    char topic[32];
+    for (auto& magnitude : _magnitudes) {
+        if (SENSOR_USE_INDEX || (sensor_magnitude_t::counts(magnitude.type) > 1)) {
+            snprintf(topic, sizeof(topic), "%s/%u", magnitudeTopic(magnitude.type).c_str(), magnitude.index_global);
+        } else {
+            snprintf(topic, sizeof(topic), "%s", magnitudeTopic(magnitude.type).c_str());
+        }
+        magnitude.topic_string = _magnitudeStringAdd(topic);
+        magnitude.units_string = _magnitudeStringAdd(_magnitudeUnits(magnitude).c_str());
+    }
+
+    _magnitude_strings.shrink_to_fit();
+}
+
 // -----------------------------------------------------------------------------
 
 // do `callback(type)` for each present magnitude
@@ -1228,7 +1316,7 @@ void _sensorWebSocketMagnitudesConfig(JsonObject& root) {
 
         index.add<uint8_t>(magnitude.index_global);
         type.add<uint8_t>(magnitude.type);
-        units.add(_magnitudeUnits(magnitude));
+        units.add(_magnitudeString(magnitude.units_string));
         description.add(_magnitudeDescription(magnitude));
 
     }
@@ -1250,11 +1338,12 @@ void _sensorWebSocketSendData(JsonObject& root) {
         JsonArray& info = magnitudes.createNestedArray("info");
     #endif
 
-    for (auto& magnitude : _magnitudes) {
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
+        const auto& magnitude = _magnitudes[index];
         if (magnitude.type == MAGNITUDE_EVENT) continue;
         ++size;
 
-        dtostrf(_magnitudeProcess(magnitude, magnitude.last), 1, magnitude.decimals, buffer);
+        dtostrf(_magnitudeProcess(index, _magnitude_values[index].last), 1, magnitude.decimals, buffer);
 
         value.add(buffer);
         error.add(magnitude.sensor->error());
@@ -1354,24 +1443,22 @@ void _sensorWebSocketOnConnected(JsonObject& root) {
 
 void _sensorAPISetup() {
 
-    for (auto& magnitude : _magnitudes) {
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
 
-        String topic = magnitudeTopic(magnitude.type);
-        if (SENSOR_USE_INDEX || (sensor_magnitude_t::counts(magnitude.type) > 1)) topic = topic + "/" + String(magnitude.index_global);
+        const auto& magnitude = _magnitudes[index];
 
-        api_get_callback_f get_cb = [&magnitude](char * buffer, size_t len) {
-            double value = _sensor_realtime ? magnitude.last : magnitude.reported;
-            dtostrf(value, 1, magnitude.decimals, buffer);
+        api_get_callback_f get_cb = [index](char * buffer, size_t len) {
+            dtostrf(magnitudeValue(index), 1, _magnitudes[index].decimals, buffer);
         };
         api_put_callback_f put_cb = nullptr;
 
         if (magnitude.type == MAGNITUDE_ENERGY) {
-            put_cb = [&magnitude](const char* payload) {
-                _sensorApiResetEnergy(magnitude, payload);
+            put_cb = [index](const char* payload) {
+                _sensorApiResetEnergy(_magnitudes[index], payload);
             };
         }
 
-        apiRegister(topic.c_str(), get_cb, put_cb);
+        apiRegister(_magnitudeString(magnitude.topic_string), get_cb, put_cb);
 
     }
 
@@ -1415,6 +1502,302 @@ void _sensorMqttCallback(unsigned int type, const char* topic, char* payload) {
 
 #endif // MQTT_SUPPORT == 1
 
+#if SENSOR_HISTORY_SUPPORT
+
+// Values are stored as integers, so they need to be scaled back with the decimals of the magnitude
+
+double _sensorHistoryPow10(unsigned char decimals) {
+    double result = 1.0;
+    while (decimals--) result *= 10.0;
+    return result;
+}
+
+int32_t _sensorHistoryScale(double value, unsigned char decimals) {
+    value = round(value * _sensorHistoryPow10(decimals));
+    if (value > INT32_MAX) return INT32_MAX;
+    if (value < INT32_MIN) return INT32_MIN;
+    return static_cast<int32_t>(value);
+}
+
+double _sensorHistoryUnscale(int32_t value, unsigned char decimals) {
+    return value / _sensorHistoryPow10(decimals);
+}
+
+#if SENSOR_HISTORY_SPIFFS
+
+// Every magnitude has it's own file with SENSOR_HISTORY_SPIFFS_SIZE of the fixed-size records, overwritten in a circle:
+// | timestamp:4 | min:4 | avg:4 | max:4 |
+// Records without the timestamp are unused. The next one to write is found by the latest timestamp after reboot
+
+struct sensor_history_record_t {
+    uint32_t timestamp;
+    float min;
+    float avg;
+    float max;
+};
+
+String _sensorHistoryFileName(unsigned char index) {
+    char buffer[32];
+    snprintf_P(buffer, sizeof(buffer), PSTR("/sns_history_%u"), index);
+    return String(buffer);
+}
+
+uint16_t _sensorHistoryFileNext(unsigned char index) {
+    File file = SPIFFS.open(_sensorHistoryFileName(index), "r");
+    if (!file) return 0;
+
+    sensor_history_record_t record;
+    uint32_t latest = 0;
+    uint16_t next = 0;
+    for (uint16_t position = 0; position < SENSOR_HISTORY_SPIFFS_SIZE; ++position) {
+        if (file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) break;
+        if (record.timestamp && (record.timestamp >= latest)) {
+            latest = record.timestamp;
+            next = (position + 1) % SENSOR_HISTORY_SPIFFS_SIZE;
+        }
+    }
+    file.close();
+
+    return next;
+}
+
+bool _sensorHistoryFileStore(unsigned char index, uint16_t position, const sensor_history_record_t& record) {
+    const auto name = _sensorHistoryFileName(index);
+    const size_t offset = position * sizeof(record);
+
+    File file = SPIFFS.open(name, "r");
+    const size_t size = file ? file.size() : 0;
+    if (file) file.close();
+
+    file = SPIFFS.open(name, (offset < size) ? "r+" : "a");
+    if (!file) return false;
+
+    bool result = (offset >= size) || file.seek(offset, SeekSet);
+    if (result) {
+        result = (file.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record));
+    }
+    file.close();
+
+    return result;
+}
+
+// Oldest record first
+template <typename T>
+void _sensorHistoryFileForEach(unsigned char index, uint16_t next, T&& callback) {
+    File file = SPIFFS.open(_sensorHistoryFileName(index), "r");
+    if (!file) return;
+
+    const size_t size = file.size();
+    sensor_history_record_t record;
+    for (uint16_t n = 0; n < SENSOR_HISTORY_SPIFFS_SIZE; ++n) {
+        const size_t offset = ((next + n) % SENSOR_HISTORY_SPIFFS_SIZE) * sizeof(record);
+        if (offset >= size) continue;
+        if (!file.seek(offset, SeekSet)) break;
+        if (file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) break;
+        if (!record.timestamp) continue;
+        callback(record);
+    }
+    file.close();
+}
+
+#endif // SENSOR_HISTORY_SPIFFS
+
+struct sensor_history_t {
+
+    explicit sensor_history_t(unsigned char decimals) :
+        values(SENSOR_HISTORY_SIZE),
+        decimals(decimals)
+    {}
+
+    sensor::History values;
+    unsigned char decimals;
+
+    #if SENSOR_HISTORY_SPIFFS
+        // Stats of the values stored since the last file record
+        double sum { 0.0 };
+        float min { 0.0 };
+        float max { 0.0 };
+        uint16_t count { 0 };
+        uint16_t next { 0 };
+    #endif
+
+};
+
+std::vector<sensor_history_t> _sensor_history;
+
+// (Re)create the history when magnitude precision changes, since the stored values are no longer valid
+void _sensorHistoryConfigure() {
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
+        const auto decimals = _magnitudes[index].decimals;
+        if (index >= _sensor_history.size()) {
+            _sensor_history.emplace_back(decimals);
+            #if SENSOR_HISTORY_SPIFFS
+                _sensor_history.back().next = _sensorHistoryFileNext(index);
+            #endif
+        } else if (_sensor_history[index].decimals != decimals) {
+            _sensor_history[index].values.clear();
+            _sensor_history[index].decimals = decimals;
+        }
+    }
+}
+
+#if WEB_SUPPORT
+
+void _sensorHistoryWebSocketSend(unsigned char index, JsonObject& root) {
+    JsonObject& history = root.createNestedObject("magnitudesHistory");
+    history["index"] = index;
+    history["interval"] = SENSOR_HISTORY_INTERVAL;
+
+    const auto decimals = _sensor_history[index].decimals;
+    JsonArray& values = history.createNestedArray("values");
+    _sensor_history[index].values.forEach([&values, decimals](int32_t value) {
+        values.add(_sensorHistoryUnscale(value, decimals));
+    });
+}
+
+// Every magnitude is sent as a separate message, only when the client requests them with the "history" action.
+// Nothing is broadcasted periodically, the client asks again when it needs the newer values
+void _sensorHistoryWebSocketOnAction(uint32_t client_id, const char* action, JsonObject&) {
+    if (strcmp(action, "history") != 0) return;
+
+    ws_on_send_callback_list_t callbacks;
+    callbacks.reserve(_magnitudes.size());
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
+        if (_magnitudes[index].type == MAGNITUDE_EVENT) continue;
+        callbacks.push_back([index](JsonObject& root) {
+            _sensorHistoryWebSocketSend(index, root);
+        });
+    }
+
+    if (callbacks.size()) wsPostSequence(client_id, std::move(callbacks));
+}
+
+#endif // WEB_SUPPORT
+
+#if WEB_SUPPORT && API_SUPPORT
+
+// /api/<magnitude topic>/history =>
+// {"topic":"temperature","units":"°C","interval":60,"values":[21.5,...],"records":{"interval":300,"values":[[<timestamp>,<min>,<avg>,<max>],...]}}
+void _sensorHistoryPrint(Print& out, unsigned char index) {
+    const auto& magnitude = _magnitudes[index];
+    const auto& history = _sensor_history[index];
+
+    char buffer[64];
+
+    out.print(F("{\"topic\":\""));
+    out.print(_magnitudeString(magnitude.topic_string));
+    out.print(F("\",\"units\":\""));
+    out.print(_magnitudeString(magnitude.units_string));
+    out.print(F("\",\"interval\":"));
+    out.print(SENSOR_HISTORY_INTERVAL);
+    out.print(F(",\"values\":["));
+
+    bool first = true;
+    history.values.forEach([&](int32_t value) {
+        if (!first) out.print(',');
+        first = false;
+        dtostrf(_sensorHistoryUnscale(value, history.decimals), 1, history.decimals, buffer);
+        out.print(buffer);
+    });
+
+    out.print(']');
+
+    #if SENSOR_HISTORY_SPIFFS
+        out.print(F(",\"records\":{\"interval\":"));
+        out.print(SENSOR_HISTORY_SPIFFS_INTERVAL);
+        out.print(F(",\"values\":["));
+        first = true;
+        _sensorHistoryFileForEach(index, history.next, [&](const sensor_history_record_t& record) {
+            if (!first) out.print(',');
+            first = false;
+            out.print('[');
+            out.print(record.timestamp);
+            for (auto value : {record.min, record.avg, record.max}) {
+                out.print(',');
+                dtostrf(value, 1, magnitude.decimals, buffer);
+                out.print(buffer);
+            }
+            out.print(']');
+        });
+        out.print(F("]}"));
+    #endif
+
+    out.print('}');
+}
+
+bool _sensorHistoryRequestCallback(AsyncWebServerRequest* request) {
+
+    const String url = request->url();
+    if (!url.startsWith("/api/") || !url.endsWith("/history")) return false;
+
+    const String topic = url.substring(5, url.length() - 8);
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
+        if (!topic.equals(_magnitudeString(_magnitudes[index].topic_string))) continue;
+
+        webLog(request);
+        if (!apiAuthenticate(request)) return true;
+
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        _sensorHistoryPrint(*response, index);
+        request->send(response);
+
+        return true;
+    }
+
+    return false;
+
+}
+
+#endif // WEB_SUPPORT && API_SUPPORT
+
+void _sensorHistoryStore() {
+
+    for (unsigned char index = 0; index < _magnitudes.size(); ++index) {
+        const auto& magnitude = _magnitudes[index];
+        if (magnitude.type == MAGNITUDE_EVENT) continue;
+        if (!magnitude.sensor->ready()) continue;
+
+        auto& history = _sensor_history[index];
+        const double value = _magnitudeProcess(index, _magnitude_values[index].last);
+        history.values.push(_sensorHistoryScale(value, history.decimals));
+
+        #if SENSOR_HISTORY_SPIFFS
+            if (!history.count || (value < history.min)) history.min = value;
+            if (!history.count || (value > history.max)) history.max = value;
+            history.sum += value;
+            ++history.count;
+        #endif
+    }
+
+    #if SENSOR_HISTORY_SPIFFS
+    {
+        static unsigned long last = millis();
+        if (millis() - last >= (SENSOR_HISTORY_SPIFFS_INTERVAL * 1000ul)) {
+            last = millis();
+
+            // Stats are discarded until we know the time
+            const uint32_t timestamp = ntpSynced() ? static_cast<uint32_t>(now()) : 0;
+            for (unsigned char index = 0; index < _sensor_history.size(); ++index) {
+                auto& history = _sensor_history[index];
+                if (timestamp && history.count) {
+                    const sensor_history_record_t record {
+                        timestamp, history.min, static_cast<float>(history.sum / history.count), history.max
+                    };
+                    if (_sensorHistoryFileStore(index, history.next, record)) {
+                        history.next = (history.next + 1) % SENSOR_HISTORY_SPIFFS_SIZE;
+                    }
+                }
+                history.sum = 0.0;
+                history.count = 0;
+            }
+        }
+    }
+    #endif
+
+}
+
+#endif // SENSOR_HISTORY_SUPPORT
+
 #if TERMINAL_SUPPORT
 
 void _sensorInitCommands() {
@@ -1423,8 +1806,8 @@ void _sensorInitCommands() {
         char reported[64];
         for (size_t index = 0; index < _magnitudes.size(); ++index) {
             auto& magnitude = _magnitudes.at(index);
-            dtostrf(magnitude.last, 1, magnitude.decimals, last);
-            dtostrf(magnitude.reported, 1, magnitude.decimals, reported);
+            dtostrf(_magnitude_values[index].last, 1, magnitude.decimals, last);
+            dtostrf(_magnitude_values[index].reported, 1, magnitude.decimals, reported);
             DEBUG_MSG_P(PSTR("[SENSOR] %2u * %s/%u @ %s (last:%s, reported:%s)\n"),
                 index,
                 magnitudeTopic(magnitude.type).c_str(),
@@ -1439,27 +1822,32 @@ void _sensorInitCommands() {
 
 #endif // TERMINAL_SUPPORT == 1
 
+// Sensors that detect changes by themselves are only read when something changed
 void _sensorTick() {
+    bool reported = false;
+    bool read = false;
+
     for (auto* sensor : _sensors) {
         sensor->tick();
+        if (sensor->changed() && sensor->ready()) {
+            sensor->clearChanged();
+            reported = _sensorReadSensor(sensor, _sensorRelayOff(), true) || reported;
+            read = true;
+        }
     }
-}
 
-void _sensorPre() {
-    for (auto* sensor : _sensors) {
-        sensor->pre();
-        if (!sensor->status()) {
-            DEBUG_MSG_P(PSTR("[SENSOR] Error reading data from %s (error: %d)\n"),
-                sensor->description().c_str(),
-                sensor->error()
-            );
-        }
+    if (read) {
+        _sensorReadDone(reported);
     }
 }
 
-void _sensorPost() {
-    for (auto* sensor : _sensors) {
-        sensor->post();
+void _sensorPre(BaseSensor* sensor) {
+    sensor->pre();
+    if (!sensor->status()) {
+        DEBUG_MSG_P(PSTR("[SENSOR] Error reading data from %s (error: %d)\n"),
+            sensor->description().c_str(),
+            sensor->error()
+        );
     }
 }
 
@@ -1630,6 +2018,7 @@ void _sensorLoad() {
             sensor->setGPIO(pin);
             sensor->setMode(getMode(index));
             sensor->setDefault(getDefaultState(index));
+            sensor->setDebounce(DIGITAL_DEBOUNCE);
 
             _sensors.push_back(sensor);
         }
@@ -2072,12 +2461,12 @@ void _sensorReport(unsigned char index, double value) {
     dtostrf(value, 1, magnitude.decimals, buffer);
 
     #if BROKER_SUPPORT
-        SensorReportBroker::Publish(magnitudeTopic(magnitude.type), magnitude.index_global, value, buffer);
+        SensorReportBroker::Publish(magnitude.type, magnitude.index_global, value, magnitude.decimals);
     #endif
 
     #if MQTT_SUPPORT
 
-        mqttSend(magnitudeTopicIndex(index).c_str(), buffer);
+        mqttSend(_magnitudeString(magnitude.topic_string), buffer);
 
         #if SENSOR_PUBLISH_ADDRESSES
             char topic[32];
@@ -2145,6 +2534,7 @@ void _sensorInit() {
                 sensor::Unit::None,  // set up later, in configuration
                 _sensors[i]          // bind the sensor to allow us to reference it later
             );
+            _magnitude_values.push_back(sensor_magnitude_value_t{0.0, 0.0, 0.0, 0.0, 0.0});
 
             if (_sensorIsEmon(_sensors[i]) && (MAGNITUDE_ENERGY == magnitude_type)) {
                 const auto index_global = _magnitudes.back().index_global;
@@ -2368,7 +2758,7 @@ void _sensorConfigure() {
             {
                 if (_magnitudeCanUseCorrection(magnitude.type)) {
                     auto key = String(_magnitudeSettingsPrefix(magnitude.type)) + F("Correction");
-                    magnitude.correction = getSetting({key, magnitude.index_global}, getSetting(key, _magnitudeCorrection(magnitude.type)));
+                    _magnitude_values[index].correction = getSetting({key, magnitude.index_global}, getSetting(key, _magnitudeCorrection(magnitude.type)));
                 }
             }
 
@@ -2400,10 +2790,29 @@ void _sensorConfigure() {
                         break;
                 }
 
-                magnitude.min_change = getSetting({"snsMinDelta", index}, min_default);
-                magnitude.max_change = getSetting({"snsMaxDelta", index}, max_default);
+                _magnitude_values[index].min_change = getSetting({"snsMinDelta", index}, min_default);
+                _magnitude_values[index].max_change = getSetting({"snsMaxDelta", index}, max_default);
+            }
+
+            // changing the filter type discards the collected values
+            {
+                const auto filter_default = static_cast<unsigned char>(_magnitudeFilterType(magnitude.type));
+                auto filter_type = getSetting({"snsFilter", index}, filter_default);
+                if (filter_type > static_cast<unsigned char>(FilterType::Kalman)) {
+                    filter_type = filter_default;
+                }
+                if (static_cast<FilterType>(filter_type) != magnitude.filter.type()) {
+                    magnitude.filter.setType(static_cast<FilterType>(filter_type));
+                    magnitude.filter.resize(magnitude.report_every);
+                }
             }
 
+            // filter is resized after the next report, so the currently collected values are not lost
+            magnitude.report_every = constrain(
+                getSetting({"snsReport", index}, _sensor_report_every),
+                SENSOR_REPORT_MIN_EVERY, SENSOR_REPORT_MAX_EVERY
+            );
+
             // in case we don't save energy periodically, purge existing value in ram & settings
             if ((MAGNITUDE_ENERGY == magnitude.type) && (0 == _sensor_save_every)) {
                 _sensorResetEnergyTotal(magnitude.index_global);
@@ -2412,6 +2821,13 @@ void _sensorConfigure() {
         }
     }
 
+    _magnitudeStringsConfigure();
+    _sensorReadConfigure();
+
+    #if SENSOR_HISTORY_SUPPORT
+        _sensorHistoryConfigure();
+    #endif
+
     saveSettings();
 
 }
@@ -2437,7 +2853,7 @@ unsigned char magnitudeType(unsigned char index) {
 
 double magnitudeValue(unsigned char index) {
     if (index < _magnitudes.size()) {
-        return _sensor_realtime ? _magnitudes[index].last : _magnitudes[index].reported;
+        return _sensor_realtime ? _magnitude_values[index].last : _magnitude_values[index].reported;
     }
     return DBL_MIN;
 }
@@ -2457,16 +2873,10 @@ String magnitudeDescription(unsigned char index) {
 }
 
 String magnitudeTopicIndex(unsigned char index) {
-    char topic[32] = {0};
     if (index < _magnitudes.size()) {
-        sensor_magnitude_t magnitude = _magnitudes[index];
-        if (SENSOR_USE_INDEX || (sensor_magnitude_t::counts(magnitude.type) > 1)) {
-            snprintf(topic, sizeof(topic), "%s/%u", magnitudeTopic(magnitude.type).c_str(), magnitude.index_global);
-        } else {
-            snprintf(topic, sizeof(topic), "%s", magnitudeTopic(magnitude.type).c_str());
-        }
+        return String(_magnitudeString(_magnitudes[index].topic_string));
     }
-    return String(topic);
+    return String();
 }
 
 // -----------------------------------------------------------------------------
@@ -2497,6 +2907,287 @@ void _sensorBackwards() {
 
 }
 
+// Returns `true` when the value was reported. `force` reports the value regardless of the report_every and the change thresholds
+bool _sensorReadMagnitude(unsigned char index, bool relay_off, bool force) {
+
+    sensor_magnitude_t& magnitude = _magnitudes[index];
+    sensor_magnitude_value_t& values = _magnitude_values[index];
+
+    double value_raw;       // holds the raw value as the sensor returns it
+    double value_show;      // holds the processed value applying units and decimals
+    double value_filtered;  // holds the processed value applying filters, and the units and decimals
+
+    magnitude.report_count = sensor::report::next(magnitude.report_count, magnitude.report_every);
+
+    // -------------------------------------------------------------
+    // Instant value
+    // -------------------------------------------------------------
+
+    value_raw = magnitude.sensor->value(magnitude.slot);
+
+    // Completely remove spurious values if relay is OFF
+    #if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
+        switch (magnitude.type) {
+            case MAGNITUDE_POWER_ACTIVE:
+            case MAGNITUDE_POWER_REACTIVE:
+            case MAGNITUDE_POWER_APPARENT:
+            case MAGNITUDE_POWER_FACTOR:
+            case MAGNITUDE_CURRENT:
+            case MAGNITUDE_ENERGY_DELTA:
+                if (relay_off) {
+                    value_raw = 0.0;
+                }
+                break;
+            default:
+                break;
+        }
+    #endif
+
+    values.last = value_raw;
+
+    // -------------------------------------------------------------
+    // Processing (filters)
+    // -------------------------------------------------------------
+
+    magnitude.filter.add(value_raw);
+
+    // Special case for MovingAverageFilter
+    switch (magnitude.type) {
+        case MAGNITUDE_COUNT:
+        case MAGNITUDE_GEIGER_CPM:
+        case MAGNITUDE_GEIGER_SIEVERT:
+            value_raw = magnitude.filter.result();
+            break;
+        default:
+            break;
+    }
+
+    // -------------------------------------------------------------
+    // Procesing (units and decimals)
+    // -------------------------------------------------------------
+
+    value_show = _magnitudeProcess(index, value_raw);
+    #if BROKER_SUPPORT
+        SensorReadBroker::Publish(magnitude.type, magnitude.index_global, value_show, magnitude.decimals);
+    #endif
+
+    // -------------------------------------------------------------
+    // Debug
+    // -------------------------------------------------------------
+
+    #if SENSOR_DEBUG
+    {
+        char buffer[64];
+        dtostrf(value_show, 1, magnitude.decimals, buffer);
+        DEBUG_MSG_P(PSTR("[SENSOR] %s - %s: %s%s\n"),
+            _magnitudeDescription(magnitude).c_str(),
+            _magnitudeString(magnitude.topic_string),
+            buffer,
+            _magnitudeString(magnitude.units_string)
+        );
+    }
+    #endif // SENSOR_DEBUG
+
+    // -------------------------------------------------------------------
+    // Report when
+    // - report_count overflows after reaching report_every
+    // - when magnitude specifies max_change and we greater or equal to it
+    // -------------------------------------------------------------------
+
+    const bool report = force || sensor::report::due(magnitude.report_count, value_show, values.reported, values.max_change);
+
+    // Special case for energy, save readings to RAM and EEPROM
+    if (MAGNITUDE_ENERGY == magnitude.type) {
+        _magnitudeSaveEnergyTotal(magnitude, report);
+    }
+
+    if (!report) return false;
+
+    value_filtered = magnitude.filter.result();
+    value_filtered = _magnitudeProcess(index, value_filtered);
+
+    sensor::report::restart(magnitude.filter, magnitude.report_every);
+
+    // Check if there is a minimum change threshold to report
+    if (!force && !sensor::report::changed(value_filtered, values.reported, values.min_change)) return false;
+
+    values.reported = value_filtered;
+    _sensorReport(index, value_filtered);
+
+    return true;
+
+}
+
+// Returns `true` when any of the sensor magnitudes was reported
+bool _sensorReadSensor(BaseSensor* sensor, bool relay_off, bool force) {
+
+    bool result = false;
+
+    // Pre-read hook, called every reading
+    _sensorPre(sensor);
+
+    // Get readings
+    if (sensor->status()) {
+        for (unsigned char i=0; i<_magnitudes.size(); i++) {
+            if (_magnitudes[i].sensor != sensor) continue;
+            result = _sensorReadMagnitude(i, relay_off, force) || result;
+        }
+    }
+
+    // Post-read hook, called every reading
+    sensor->post();
+
+    return result;
+
+}
+
+void _sensorReadSchedule() {
+    if (_sensor_reads.empty()) {
+        espurnaTaskCancel(_sensor_read_task);
+        return;
+    }
+
+    const long wait = _sensor_reads.front().due - millis();
+    espurnaTaskSchedule(_sensor_read_task, (wait > 0) ? wait : 0);
+}
+
+// Keep the current schedule of the sensor when the interval did not change
+void _sensorReadConfigure() {
+
+    const auto now = millis();
+
+    std::vector<sensor_read_t> reads;
+    reads.reserve(_sensors.size());
+
+    for (unsigned char index = 0; index < _sensors.size(); ++index) {
+        unsigned long interval = 1000 * constrain(
+            getSetting({"snsRead", index}, _sensor_read_interval / 1000),
+            SENSOR_READ_MIN_INTERVAL, SENSOR_READ_MAX_INTERVAL
+        );
+
+        // Changes are read as soon as they happen, scheduled reading is only a heartbeat
+        if (_sensors[index]->notifies()) {
+            interval = std::max(interval, 1000ul * SENSOR_CHANGE_HEARTBEAT);
+        }
+
+        auto it = std::find_if(_sensor_reads.begin(), _sensor_reads.end(), [index](const sensor_read_t& read) {
+            return read.sensor == index;
+        });
+
+        if ((it != _sensor_reads.end()) && (it->interval == interval)) {
+            reads.push_back(*it);
+        } else {
+            reads.push_back({now + interval, interval, index});
+        }
+    }
+
+    std::make_heap(reads.begin(), reads.end(), _sensorReadLater);
+    _sensor_reads = std::move(reads);
+
+    _sensorReadSchedule();
+
+}
+
+bool _sensorRelayOff() {
+    #if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
+        return (relayCount() == 1) && (relayStatus(0) == 0);
+    #else
+        return false;
+    #endif
+}
+
+// Report data to modules that don't specifically track them
+void _sensorReadDone(bool reported) {
+
+    #if WEB_SUPPORT
+        wsPost(_sensorWebSocketSendData);
+    #endif
+
+    #if THINGSPEAK_SUPPORT
+        if (reported) tspkFlush();
+    #endif
+
+}
+
+void _sensorRead() {
+
+    if (_magnitudes.size() == 0) return;
+
+    // Get the first relay state
+    const bool relay_off = _sensorRelayOff();
+
+    bool reported = false;
+    bool read = false;
+
+    const auto now = millis();
+    while (!_sensor_reads.empty() && (static_cast<long>(now - _sensor_reads.front().due) >= 0)) {
+        std::pop_heap(_sensor_reads.begin(), _sensor_reads.end(), _sensorReadLater);
+        auto& next = _sensor_reads.back();
+
+        // Asynchronous sensors are finished by the sensorLoop(). Skip this reading when the previous one is still in progress
+        auto* sensor = _sensors[next.sensor];
+        if (sensor->async() && sensor->ready()) {
+            const unsigned char index = next.sensor;
+            auto it = std::find_if(_sensor_async.begin(), _sensor_async.end(), [index](const sensor_async_t& async) {
+                return async.sensor == index;
+            });
+            if (it == _sensor_async.end()) {
+                sensor->start();
+                _sensor_async.push_back({now, index});
+            }
+        } else {
+            reported = _sensorReadSensor(sensor, relay_off, sensor->notifies()) || reported;
+            read = true;
+        }
+
+        // Keep the original cadence, unless we are already too late for the next read
+        next.due += next.interval;
+        if (static_cast<long>(now - next.due) >= 0) {
+            next.due = now + next.interval;
+        }
+
+        std::push_heap(_sensor_reads.begin(), _sensor_reads.end(), _sensorReadLater);
+    }
+
+    _sensorReadSchedule();
+
+    if (read) {
+        _sensorReadDone(reported);
+    }
+
+}
+
+void _sensorAsync() {
+
+    if (_sensor_async.empty()) return;
+
+    const bool relay_off = _sensorRelayOff();
+
+    bool reported = false;
+    bool read = false;
+
+    for (auto it = _sensor_async.begin(); it != _sensor_async.end();) {
+        auto* sensor = _sensors[(*it).sensor];
+        if (!sensor->poll()) {
+            if (millis() - (*it).started < SENSOR_ASYNC_TIMEOUT) {
+                ++it;
+                continue;
+            }
+            sensor->abort();
+        }
+
+        reported = _sensorReadSensor(sensor, relay_off) || reported;
+        read = true;
+
+        it = _sensor_async.erase(it);
+    }
+
+    if (read) {
+        _sensorReadDone(reported);
+    }
+
+}
+
 void sensorSetup() {
 
     // Settings backwards compatibility
@@ -2506,6 +3197,9 @@ void sensorSetup() {
     _sensorLoad();
     _sensorInit();
 
+    // Read data of every sensor on it's own schedule, updated by the _sensorConfigure()
+    _sensor_read_task = espurnaRegisterTask(_sensorRead, PSTR("sensor read"));
+
     // Configure based on settings
     _sensorConfigure();
 
@@ -2542,179 +3236,49 @@ void sensorSetup() {
         _sensorInitCommands();
     #endif
 
+    // Keep the magnitude values history, available through the websocket and the API
+    #if SENSOR_HISTORY_SUPPORT
+        espurnaRegisterTask(_sensorHistoryStore, PSTR("sensor history"), SENSOR_HISTORY_INTERVAL * 1000ul);
+        #if WEB_SUPPORT
+            wsRegister().onAction(_sensorHistoryWebSocketOnAction);
+        #endif
+        #if WEB_SUPPORT && API_SUPPORT
+            webRequestRegister(_sensorHistoryRequestCallback);
+        #endif
+    #endif
+
     // Main callbacks
-    espurnaRegisterLoop(sensorLoop);
+    espurnaRegisterLoop(sensorLoop, PSTR("sensor"));
     espurnaRegisterReload(_sensorConfigure);
 
-}
-
-void sensorLoop() {
-
     // Check if we still have uninitialized sensors
-    static unsigned long last_init = 0;
-    if (!_sensors_ready) {
-        if (millis() - last_init > SENSOR_INIT_INTERVAL) {
-            last_init = millis();
+    espurnaRegisterTask([]() {
+        if (!_sensors_ready) {
+            const auto count = _magnitudes.size();
             _sensorInit();
+            // New magnitudes need their units, topics and read schedule
+            if (count != _magnitudes.size()) {
+                _sensorConfigure();
+            }
         }
-    }
+    }, PSTR("sensor init"), SENSOR_INIT_INTERVAL);
+
+}
+
+void sensorLoop() {
 
     if (_magnitudes.size() == 0) return;
 
     // Tick hook, called every loop()
     _sensorTick();
 
-    // Check if we should read new data
-    static unsigned long last_update = 0;
-    static unsigned long report_count = 0;
-    if (millis() - last_update > _sensor_read_interval) {
-
-        last_update = millis();
-        report_count = (report_count + 1) % _sensor_report_every;
-
-        double value_raw;       // holds the raw value as the sensor returns it
-        double value_show;      // holds the processed value applying units and decimals
-        double value_filtered;  // holds the processed value applying filters, and the units and decimals
-
-        // Pre-read hook, called every reading
-        _sensorPre();
-
-        // Get the first relay state
-        #if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
-            const bool relay_off = (relayCount() == 1) && (relayStatus(0) == 0);
-        #endif
-
-        // Get readings
-        for (unsigned char i=0; i<_magnitudes.size(); i++) {
-
-            sensor_magnitude_t magnitude = _magnitudes[i];
-
-            if (magnitude.sensor->status()) {
-
-                // -------------------------------------------------------------
-                // Instant value
-                // -------------------------------------------------------------
-
-                value_raw = magnitude.sensor->value(magnitude.slot);
-
-                // Completely remove spurious values if relay is OFF
-                #if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
-                    switch (magnitude.type) {
-                        case MAGNITUDE_POWER_ACTIVE:
-                        case MAGNITUDE_POWER_REACTIVE:
-                        case MAGNITUDE_POWER_APPARENT:
-                        case MAGNITUDE_POWER_FACTOR:
-                        case MAGNITUDE_CURRENT:
-                        case MAGNITUDE_ENERGY_DELTA:
-                            if (relay_off) {
-                                value_raw = 0.0;
-                            }
-                            break;
-                        default:
-                            break;
-                    }
-                #endif
-
-                _magnitudes[i].last = value_raw;
-
-                // -------------------------------------------------------------
-                // Processing (filters)
-                // -------------------------------------------------------------
-
-                magnitude.filter->add(value_raw);
-
-                // Special case for MovingAverageFilter
-                switch (magnitude.type) {
-                    case MAGNITUDE_COUNT:
-                    case MAGNITUDE_GEIGER_CPM:
-                    case MAGNITUDE_GEIGER_SIEVERT:
-                        value_raw = magnitude.filter->result();
-                        break;
-                    default:
-                        break;
-                }
-
-                // -------------------------------------------------------------
-                // Procesing (units and decimals)
-                // -------------------------------------------------------------
-
-                value_show = _magnitudeProcess(magnitude, value_raw);
-                #if BROKER_SUPPORT
-                {
-                    char buffer[64];
-                    dtostrf(value_show, 1, magnitude.decimals, buffer);
-                    SensorReadBroker::Publish(magnitudeTopic(magnitude.type), magnitude.index_global, value_show, buffer);
-                }
-                #endif
-
-                // -------------------------------------------------------------
-                // Debug
-                // -------------------------------------------------------------
-
-                #if SENSOR_DEBUG
-                {
-                    char buffer[64];
-                    dtostrf(value_show, 1, magnitude.decimals, buffer);
-                    DEBUG_MSG_P(PSTR("[SENSOR] %s - %s: %s%s\n"),
-                        _magnitudeDescription(magnitude).c_str(),
-                        magnitudeTopic(magnitude.type).c_str(),
-                        buffer,
-                        _magnitudeUnits(magnitude).c_str()
-                    );
-                }
-                #endif // SENSOR_DEBUG
+    // Advance asynchronous readings
+    _sensorAsync();
 
-                // -------------------------------------------------------------------
-                // Report when
-                // - report_count overflows after reaching _sensor_report_every
-                // - when magnitude specifies max_change and we greater or equal to it
-                // -------------------------------------------------------------------
-
-                bool report = (0 == report_count);
-
-                if (magnitude.max_change > 0) {
-                    report = (fabs(value_show - magnitude.reported) >= magnitude.max_change);
-                }
-
-                // Special case for energy, save readings to RAM and EEPROM
-                if (MAGNITUDE_ENERGY == magnitude.type) {
-                    _magnitudeSaveEnergyTotal(magnitude, report);
-                }
-
-                if (report) {
-
-                    value_filtered = magnitude.filter->result();
-                    value_filtered = _magnitudeProcess(magnitude, value_filtered);
-
-                    magnitude.filter->reset();
-                    if (magnitude.filter->size() != _sensor_report_every) {
-                        magnitude.filter->resize(_sensor_report_every);
-                    }
-
-                    // Check if there is a minimum change threshold to report
-                    if (fabs(value_filtered - magnitude.reported) >= magnitude.min_change) {
-                        _magnitudes[i].reported = value_filtered;
-                        _sensorReport(i, value_filtered);
-                    } // if (fabs(value_filtered - magnitude.reported) >= magnitude.min_change)
-
-                } // if (report_count == 0)
-
-            } // if (magnitude.sensor->status())
-        } // for (unsigned char i=0; i<_magnitudes.size(); i++)
-
-        // Post-read hook, called every reading
-        _sensorPost();
-
-        // And report data to modules that don't specifically track them
-        #if WEB_SUPPORT
-            wsPost(_sensorWebSocketSendData);
-        #endif
-
-        #if THINGSPEAK_SUPPORT
-            if (report_count == 0) tspkFlush();
-        #endif
-
-    }
+    // Deliver reports queued by the last read
+    #if BROKER_SUPPORT
+        SensorReportBroker::Dispatch();
+    #endif
 
 }
 
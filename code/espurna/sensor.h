@@ -127,8 +127,11 @@ struct Energy {
 
 }
 
-BrokerDeclare(SensorReadBroker, void(const String&, unsigned char, double, const char*));
-BrokerDeclare(SensorReportBroker, void(const String&, unsigned char, double, const char*));
+// Subscribers receive magnitude type, global index, processed value and number of decimals.
+// Use magnitudeTopic(type) and dtostrf(value, 1, decimals, ...) when textual representation is needed.
+// Reports are delivered from the sensorLoop(), outside of the sensor reading code.
+BrokerDeclareStatic(SensorReadBroker, BROKER_SENSOR_SUBSCRIBERS, void(unsigned char type, unsigned char index, double value, unsigned char decimals));
+BrokerDeclareDeferred(SensorReportBroker, BROKER_SENSOR_SUBSCRIBERS, BROKER_SENSOR_QUEUE_SIZE, void(unsigned char type, unsigned char index, double value, unsigned char decimals));
 
 String magnitudeUnits(unsigned char index);
 String magnitudeDescription(unsigned char index);
@@ -0,0 +1,160 @@
+/*
+
+SENSOR MODULE
+
+History of the magnitude values, stored in a fixed-size RAM ring
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace sensor {
+
+// Values are integers (magnitude value scaled by the 10^decimals), stored as the difference with the previous value:
+//
+// | delta:2 | delta:2 | Escape:2 | value:4 | delta:2 | ...
+//
+// When the difference does not fit into the int16_t, `Escape` word is followed by the full value.
+// Value of the oldest record is kept separately, since there is nothing to apply its delta to.
+// Buffer is only allocated when the first value is stored. When there is no more space, the oldest records are removed.
+
+class History {
+    public:
+
+    static constexpr uint16_t Escape = 0x8000;
+    static constexpr size_t MinSize = 3;
+
+    explicit History(size_t words) :
+        _size((words < MinSize) ? MinSize : words)
+    {}
+
+    History(History&&) = default;
+    History& operator=(History&&) = default;
+
+    size_t count() const {
+        return _count;
+    }
+
+    size_t used() const {
+        return _used;
+    }
+
+    size_t capacity() const {
+        return _size;
+    }
+
+    bool push(int32_t value) {
+        if (!_buffer) {
+            _buffer.reset(new (std::nothrow) uint16_t[_size]);
+            if (!_buffer) {
+                return false;
+            }
+        }
+
+        const int64_t delta = _count ? (static_cast<int64_t>(value) - _last) : 0;
+        const bool escape = (delta < -32767) || (delta > 32767);
+        const size_t size = escape ? 3 : 1;
+
+        while ((_size - _used) < size) {
+            _pop();
+        }
+
+        if (escape) {
+            const uint32_t raw = static_cast<uint32_t>(value);
+            _put(Escape);
+            _put(raw & 0xffff);
+            _put(raw >> 16);
+        } else {
+            _put(static_cast<uint16_t>(static_cast<int16_t>(delta)));
+        }
+
+        if (!_count) {
+            _base = value;
+        }
+
+        _last = value;
+        ++_count;
+
+        return true;
+    }
+
+    // Oldest value first
+    template <typename T>
+    void forEach(T&& callback) const {
+        int32_t value = _base;
+        size_t offset = 0;
+        for (size_t n = 0; n < _count; ++n) {
+            if (n) {
+                value = _apply(offset, value);
+            }
+            callback(value);
+            offset += _recordSize(offset);
+        }
+    }
+
+    void clear() {
+        _head = 0;
+        _used = 0;
+        _count = 0;
+        _base = 0;
+        _last = 0;
+    }
+
+    private:
+
+    uint16_t _word(size_t offset) const {
+        return _buffer[(_head + offset) % _size];
+    }
+
+    void _put(uint16_t word) {
+        _buffer[(_head + _used) % _size] = word;
+        ++_used;
+    }
+
+    size_t _recordSize(size_t offset) const {
+        return (_word(offset) == Escape) ? 3 : 1;
+    }
+
+    int32_t _apply(size_t offset, int32_t previous) const {
+        const uint16_t word = _word(offset);
+        if (word == Escape) {
+            return static_cast<int32_t>(static_cast<uint32_t>(_word(offset + 1)) | (static_cast<uint32_t>(_word(offset + 2)) << 16));
+        }
+        return previous + static_cast<int16_t>(word);
+    }
+
+    // The next record becomes the oldest one, so its value is now the base
+    void _pop() {
+        if (!_count) {
+            return;
+        }
+
+        const size_t size = _recordSize(0);
+        _head = (_head + size) % _size;
+        _used -= size;
+
+        if (--_count) {
+            _base = _apply(0, _base);
+        } else {
+            clear();
+        }
+    }
+
+    std::unique_ptr<uint16_t[]> _buffer;
+    size_t _size;
+
+    size_t _head { 0 };
+    size_t _used { 0 };
+    size_t _count { 0 };
+
+    int32_t _base { 0 };
+    int32_t _last { 0 };
+
+};
+
+} // namespace sensor
@@ -0,0 +1,47 @@
+/*
+
+SENSOR MODULE
+
+Report decisions of the magnitude readings, shared with the host tests
+
+*/
+
+#pragma once
+
+#include <cmath>
+
+namespace sensor {
+namespace report {
+
+// Every reading is added to the magnitude filter. Filtered value is reported:
+// - every `every` readings, when the counter wraps around
+// - or, when `max_change` is set, as soon as the instant value moves that much from the last report
+// ...but only when it moved at least `min_change` from the last report.
+// After the report, filter starts over with the new window.
+
+inline unsigned char next(unsigned char count, unsigned char every) {
+    return (count + 1) % every;
+}
+
+inline bool due(unsigned char count, double value, double reported, double max_change) {
+    if (max_change > 0) {
+        return std::fabs(value - reported) >= max_change;
+    }
+
+    return (0 == count);
+}
+
+inline bool changed(double value, double reported, double min_change) {
+    return std::fabs(value - reported) >= min_change;
+}
+
+template <typename Filter>
+void restart(Filter& filter, unsigned char every) {
+    filter.reset();
+    if (filter.size() != every) {
+        filter.resize(every);
+    }
+}
+
+} // namespace report
+} // namespace sensor
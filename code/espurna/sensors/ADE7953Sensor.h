@@ -81,6 +81,19 @@ class ADE7953Sensor : public I2CSensor<BaseEmonSensor> {
 
         // Pre-read hook (usually to populate registers with up-to-date data)
         void pre() {
+            _sample();
+        }
+
+        // Energy is integrated at the fixed rate, between the reads as well
+        void tick() {
+            if (_ready && (millis() - _sample_last >= ADE7953_SAMPLE_INTERVAL)) {
+                _sample();
+            }
+        }
+
+        void _sample() {
+            _sample_last = millis();
+
             uint32_t active_power1 = 0;
             uint32_t active_power2 = 0;
             uint32_t current_rms1 = 0;
@@ -130,12 +143,7 @@ class ADE7953Sensor : public I2CSensor<BaseEmonSensor> {
             reading_ref.power = power;
 
             // TODO: chip already stores precise data about energy, see datasheet
-            static unsigned long last = 0;
-            if (last > 0) {
-                const uint32_t delta = (fabs(power) * (millis() - last) / 1000);
-                _energy[relay] += sensor::Ws { delta };
-            }
-            last = millis();
+            _integrate(relay, power, 0.0, _voltage * current);
         }
 
         // Current value for slot # index
@@ -255,6 +263,7 @@ class ADE7953Sensor : public I2CSensor<BaseEmonSensor> {
 
     float _voltage = 0;
     std::vector<reading_t> _readings;
+    unsigned long _sample_last = 0;
 
 };
 
@@ -113,25 +113,78 @@ class BMX280Sensor : public I2CSensor<> {
             }
         }
 
-        // Pre-read hook (usually to populate registers with up-to-date data)
-        virtual void pre() {
+        // Measurement is started by writing the control register, and the data registers are read after the conversion time.
+        // Both go through the I2C queue, so the loop is not blocked while the sensor is busy
+        bool async() {
+            return true;
+        }
+
+        void start() {
 
             if (_run_init) {
                 i2cClearBus();
                 _init();
             }
 
+            _error = SENSOR_ERROR_OK;
+            _state = State::Done;
+            ++_sequence;
+
             if (_chip == 0) {
                 _error = SENSOR_ERROR_UNKNOWN_ID;
                 return;
             }
-            _error = SENSOR_ERROR_OK;
 
             #if BMX280_MODE == 1
-                _forceRead();
+                // We set the sensor in "forced mode" to force a reading.
+                // After the reading the sensor will go back to sleep mode.
+                const uint8_t data[2] = {BMX280_REGISTER_CONTROL, static_cast<uint8_t>((_control & 0xFC) | 0x01)};
+                const uint8_t sequence = _sequence;
+                const bool queued = i2cQueueWrite(_address, data, sizeof(data), [this, sequence](uint8_t error, const uint8_t*, size_t) {
+                    if (sequence != _sequence) return;
+                    if (error) _error = SENSOR_ERROR_I2C;
+                });
+                if (!queued) {
+                    _error = SENSOR_ERROR_I2C;
+                    return;
+                }
+                _started = millis();
+                _state = State::Converting;
+            #else
+                _queueData();
             #endif
 
-            _error = _read();
+        }
+
+        bool poll() {
+            if ((_state == State::Converting) && (millis() - _started >= _measurement_delay)) {
+                if (_error == SENSOR_ERROR_OK) {
+                    _queueData();
+                } else {
+                    _state = State::Done;
+                }
+            }
+            return (_state == State::Done);
+        }
+
+        // Transactions that are still queued will complete later, make sure they are ignored
+        void abort() {
+            _state = State::Done;
+            _error = SENSOR_ERROR_TIMEOUT;
+            ++_sequence;
+        }
+
+        // Pre-read hook (usually to populate registers with up-to-date data)
+        void pre() {
+
+            if (_chip == 0) {
+                _error = SENSOR_ERROR_UNKNOWN_ID;
+                return;
+            }
+
+            if (_error == SENSOR_ERROR_OK) {
+                _error = _read();
+            }
 
             if (_error != SENSOR_ERROR_OK) {
                 _run_init = true;
@@ -254,6 +307,7 @@ class BMX280Sensor : public I2CSensor<> {
             data |= (BMX280_PRESSURE << 2) & 0x1C;
             data |= (BMX280_MODE) & 0x03;
             i2c_write_uint8(_address, BMX280_REGISTER_CONTROL, data);
+            _control = data;
 
             _measurement_delay = _measurementTime();
             _run_init = false;
@@ -261,27 +315,37 @@ class BMX280Sensor : public I2CSensor<> {
 
         }
 
+        // Both blocks of the calibration registers are read at once, 0x88 ... 0xA1 and 0xE1 ... 0xE7
         void _readCoefficients() {
-            _bmx280_calib.dig_T1 = i2c_read_uint16_le(_address, BMX280_REGISTER_DIG_T1);
-            _bmx280_calib.dig_T2 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_T2);
-            _bmx280_calib.dig_T3 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_T3);
-
-            _bmx280_calib.dig_P1 = i2c_read_uint16_le(_address, BMX280_REGISTER_DIG_P1);
-            _bmx280_calib.dig_P2 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P2);
-            _bmx280_calib.dig_P3 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P3);
-            _bmx280_calib.dig_P4 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P4);
-            _bmx280_calib.dig_P5 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P5);
-            _bmx280_calib.dig_P6 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P6);
-            _bmx280_calib.dig_P7 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P7);
-            _bmx280_calib.dig_P8 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P8);
-            _bmx280_calib.dig_P9 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_P9);
-
-            _bmx280_calib.dig_H1 = i2c_read_uint8(_address, BMX280_REGISTER_DIG_H1);
-            _bmx280_calib.dig_H2 = i2c_read_int16_le(_address, BMX280_REGISTER_DIG_H2);
-            _bmx280_calib.dig_H3 = i2c_read_uint8(_address, BMX280_REGISTER_DIG_H3);
-            _bmx280_calib.dig_H4 = (i2c_read_uint8(_address, BMX280_REGISTER_DIG_H4) << 4) | (i2c_read_uint8(_address, BMX280_REGISTER_DIG_H4+1) & 0xF);
-            _bmx280_calib.dig_H5 = (i2c_read_uint8(_address, BMX280_REGISTER_DIG_H5+1) << 4) | (i2c_read_uint8(_address, BMX280_REGISTER_DIG_H5) >> 4);
-            _bmx280_calib.dig_H6 = (int8_t) i2c_read_uint8(_address, BMX280_REGISTER_DIG_H6);
+            uint8_t tp[26] = {0};
+            uint8_t h[7] = {0};
+            i2c_read_buffer(_address, BMX280_REGISTER_DIG_T1, tp, sizeof(tp));
+            i2c_read_buffer(_address, BMX280_REGISTER_DIG_H2, h, sizeof(h));
+
+            auto le16 = [](const uint8_t* data) -> uint16_t {
+                return data[0] | (data[1] << 8);
+            };
+
+            _bmx280_calib.dig_T1 = le16(&tp[0]);
+            _bmx280_calib.dig_T2 = (int16_t) le16(&tp[2]);
+            _bmx280_calib.dig_T3 = (int16_t) le16(&tp[4]);
+
+            _bmx280_calib.dig_P1 = le16(&tp[6]);
+            _bmx280_calib.dig_P2 = (int16_t) le16(&tp[8]);
+            _bmx280_calib.dig_P3 = (int16_t) le16(&tp[10]);
+            _bmx280_calib.dig_P4 = (int16_t) le16(&tp[12]);
+            _bmx280_calib.dig_P5 = (int16_t) le16(&tp[14]);
+            _bmx280_calib.dig_P6 = (int16_t) le16(&tp[16]);
+            _bmx280_calib.dig_P7 = (int16_t) le16(&tp[18]);
+            _bmx280_calib.dig_P8 = (int16_t) le16(&tp[20]);
+            _bmx280_calib.dig_P9 = (int16_t) le16(&tp[22]);
+
+            _bmx280_calib.dig_H1 = tp[BMX280_REGISTER_DIG_H1 - BMX280_REGISTER_DIG_T1];
+            _bmx280_calib.dig_H2 = (int16_t) le16(&h[0]);
+            _bmx280_calib.dig_H3 = h[2];
+            _bmx280_calib.dig_H4 = (h[3] << 4) | (h[4] & 0xF);
+            _bmx280_calib.dig_H5 = (h[5] << 4) | (h[4] >> 4);
+            _bmx280_calib.dig_H6 = (int8_t) h[6];
         }
 
         unsigned long _measurementTime() {
@@ -310,25 +374,35 @@ class BMX280Sensor : public I2CSensor<> {
 
         }
 
-        void _forceRead() {
-
-            // We set the sensor in "forced mode" to force a reading.
-            // After the reading the sensor will go back to sleep mode.
-            uint8_t value = i2c_read_uint8(_address, BMX280_REGISTER_CONTROL);
-            value = (value & 0xFC) + 0x01;
-            i2c_write_uint8(_address, BMX280_REGISTER_CONTROL, value);
-
-            nice_delay(_measurement_delay);
-
+        // Pressure, temperature and humidity, 0xF7 ... 0xFE
+        void _queueData() {
+            const uint8_t sequence = _sequence;
+            const bool queued = i2cQueueRead(_address, BMX280_REGISTER_PRESSUREDATA, sizeof(_data), [this, sequence](uint8_t error, const uint8_t* data, size_t length) {
+                // Result of the reading that was already aborted
+                if (sequence != _sequence) return;
+                if (error) {
+                    _error = SENSOR_ERROR_I2C;
+                } else {
+                    memcpy(_data, data, length);
+                }
+                _state = State::Done;
+            });
+
+            if (queued) {
+                _state = State::Reading;
+            } else {
+                _error = SENSOR_ERROR_I2C;
+                _state = State::Done;
+            }
         }
 
         unsigned char _read() {
 
             #if BMX280_TEMPERATURE > 0
-                int32_t adc_T = i2c_read_uint16(_address, BMX280_REGISTER_TEMPDATA);
+                int32_t adc_T = (_data[3] << 8) | _data[4];
                 if (0xFFFF == adc_T) return SENSOR_ERROR_OUT_OF_RANGE;
                 adc_T <<= 8;
-                adc_T |= i2c_read_uint8(_address, BMX280_REGISTER_TEMPDATA+2);
+                adc_T |= _data[5];
                 adc_T >>= 4;
 
                 int32_t var1t = ((((adc_T>>3) -
@@ -353,10 +427,10 @@ class BMX280Sensor : public I2CSensor<> {
             #if BMX280_PRESSURE > 0
                 int64_t var1, var2, p;
 
-                int32_t adc_P = i2c_read_uint16(_address, BMX280_REGISTER_PRESSUREDATA);
+                int32_t adc_P = (_data[0] << 8) | _data[1];
                 if (0xFFFF == adc_P) return SENSOR_ERROR_OUT_OF_RANGE;
                 adc_P <<= 8;
-                adc_P |= i2c_read_uint8(_address, BMX280_REGISTER_PRESSUREDATA+2);
+                adc_P |= _data[2];
                 adc_P >>= 4;
 
                 var1 = ((int64_t)t_fine) - 128000;
@@ -382,7 +456,7 @@ class BMX280Sensor : public I2CSensor<> {
             #if BMX280_HUMIDITY > 0
             if (_chip == BMX280_CHIP_BME280) {
 
-                int32_t adc_H = i2c_read_uint16(_address, BMX280_REGISTER_HUMIDDATA);
+                int32_t adc_H = (_data[6] << 8) | _data[7];
                 if (0xFFFF == adc_H) return SENSOR_ERROR_OUT_OF_RANGE;
 
                 int32_t v_x1_u32r;
@@ -412,9 +486,22 @@ class BMX280Sensor : public I2CSensor<> {
 
         // ---------------------------------------------------------------------
 
+        enum class State {
+            Done,
+            Converting,
+            Reading
+        };
+
         unsigned char _chip;
         unsigned long _measurement_delay;
         bool _run_init = false;
+
+        State _state = State::Done;
+        uint8_t _sequence = 0;  // Every reading (and abort) gets a new one, queued transactions of the previous ones are ignored
+        unsigned long _started = 0;
+        uint8_t _control = 0;
+        uint8_t _data[8] = {0};
+
         double _temperature = 0;
         double _humidity = 0;
         double _pressure = 0;
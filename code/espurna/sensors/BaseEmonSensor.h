@@ -8,12 +8,48 @@
 #include "../sensor.h"
 #include "BaseSensor.h"
 
+#include <cmath>
+
+namespace sensor {
+
+// Fixed-point energy counter with the 1/1000000 Ws resolution.
+// Only the whole Ws are taken out, the rest is kept until the next sample
+class EnergyAccumulator {
+    public:
+
+    // Power sample in W (or var, VA), held for `ms` milliseconds
+    void add(double power, unsigned long ms) {
+        _uws += static_cast<uint64_t>(std::fabs(power) * ms * 1000.0);
+    }
+
+    void add(uint64_t uws) {
+        _uws += uws;
+    }
+
+    Ws take() {
+        const uint64_t ws = _uws / 1000000ull;
+        _uws -= ws * 1000000ull;
+        return Ws { static_cast<uint32_t>(ws) };
+    }
+
+    void reset() {
+        _uws = 0;
+    }
+
+    private:
+
+    uint64_t _uws { 0 };
+};
+
+} // namespace sensor
+
 class BaseEmonSensor : public BaseSensor {
 
     public:
 
         BaseEmonSensor(size_t devices) :
             _energy(devices),
+            _integrators(devices),
             _devices(devices)
         {}
 
@@ -29,6 +65,7 @@ class BaseEmonSensor : public BaseSensor {
 
         virtual void resizeDevices(size_t devices) {
             _energy.resize(devices);
+            _integrators.resize(devices);
             _devices = devices;
         }
 
@@ -42,12 +79,16 @@ class BaseEmonSensor : public BaseSensor {
 
         virtual void resetEnergy(unsigned char index) {
             _energy[index].reset();
+            _integrators[index] = integrator_t();
         };
 
         virtual void resetEnergy() {
             for (auto& energy : _energy) {
                 energy.reset();
             }
+            for (auto& integrator : _integrators) {
+                integrator = integrator_t();
+            }
         }
 
         virtual sensor::Energy totalEnergy(unsigned char index) {
@@ -66,6 +107,15 @@ class BaseEmonSensor : public BaseSensor {
             return getEnergy(0);
         }
 
+        // Only tracked by the sensors that receive reactive and apparent power samples
+        sensor::Energy totalReactiveEnergy(unsigned char index) {
+            return _integrators[index].reactive_total;
+        }
+
+        sensor::Energy totalApparentEnergy(unsigned char index) {
+            return _integrators[index].apparent_total;
+        }
+
         // --- configuration ---
 
         virtual double defaultVoltage() {
@@ -165,7 +215,46 @@ class BaseEmonSensor : public BaseSensor {
 
     protected:
 
+        // Power is integrated when the sensor receives the sample (e.g. every serial frame) and not when the sensor is read,
+        // so the energy does not depend on the read interval. Sensors that count energy by themselves use _integrateEnergy()
+        struct integrator_t {
+            sensor::EnergyAccumulator active;
+            sensor::EnergyAccumulator reactive;
+            sensor::EnergyAccumulator apparent;
+            sensor::Energy reactive_total;
+            sensor::Energy apparent_total;
+            unsigned long last { 0 };
+            bool started { false };
+        };
+
+        // Sample is the average power since the previous one. The first one only starts the integration
+        void _integrate(unsigned char index, double active, double reactive, double apparent) {
+            auto& integrator = _integrators[index];
+
+            const unsigned long timestamp = millis();
+            if (integrator.started) {
+                const unsigned long elapsed = timestamp - integrator.last;
+                integrator.active.add(active, elapsed);
+                integrator.reactive.add(reactive, elapsed);
+                integrator.apparent.add(apparent, elapsed);
+
+                _energy[index] += integrator.active.take();
+                integrator.reactive_total += integrator.reactive.take();
+                integrator.apparent_total += integrator.apparent.take();
+            }
+
+            integrator.last = timestamp;
+            integrator.started = true;
+        }
+
+        void _integrateEnergy(unsigned char index, uint64_t uws) {
+            auto& integrator = _integrators[index];
+            integrator.active.add(uws);
+            _energy[index] += integrator.active.take();
+        }
+
         std::vector<sensor::Energy> _energy;
+        std::vector<integrator_t> _integrators;
         size_t _devices;
 
 };
@@ -36,6 +36,32 @@ class BaseSensor {
         // Post-read hook (usually to reset things)
         virtual void post() {}
 
+        // Asynchronous reads, for sensors that need to wait for the data (slow buses, conversion delays).
+        // When async() is true, start() is called instead of waiting for the data in pre(). poll() is called
+        // every loop until it returns true (or until SENSOR_ASYNC_TIMEOUT, then abort() is called).
+        // Only after that pre(), value() and post() are called as usual.
+        // Neither of these should hold the loop for more than ~1ms.
+        virtual bool async() { return false; }
+
+        // Start the reading (e.g. send the request)
+        virtual void start() {}
+
+        // Check the progress, `true` when reading is finished (successfully or not, see error())
+        virtual bool poll() { return true; }
+
+        // Reading took too long, stop whatever is in progress
+        virtual void abort() { _error = SENSOR_ERROR_TIMEOUT; }
+
+        // Sensors that detect changes by themselves (GPIO interrupts, driver logic) call _markChanged(), and are read
+        // on the next loop instead of waiting for the read interval. Interval reading only reports the current values,
+        // at least every SENSOR_CHANGE_HEARTBEAT
+        virtual bool notifies() { return false; }
+
+        // Safe to call from the ISR
+        bool changed() { return _changed; }
+
+        void clearChanged() { _changed = false; }
+
         // Descriptive name of the sensor
         virtual String description() = 0;
 
@@ -146,5 +172,8 @@ class BaseSensor {
         bool _dirty = true;
         unsigned char _count = 0;
         bool _ready = false;
+        volatile bool _changed = false;
+
+        void ICACHE_RAM_ATTR _markChanged() { _changed = true; }
 
 };
@@ -300,23 +300,20 @@ class CSE7766Sensor : public BaseEmonSensor {
                 _reactive = 0;
             }
 
-            // Calculate energy
+            // Calculate energy, every frame. Active energy is counted by the chip, one CF pulse is `_coefP` uWs
             uint32_t cf_pulses = _data[21] << 8 | _data[22];
-
-            static uint32_t cf_pulses_last = 0;
-            if (0 == cf_pulses_last) cf_pulses_last = cf_pulses;
+            if (0 == _cf_pulses_last) _cf_pulses_last = cf_pulses;
 
             uint32_t difference;
-            if (cf_pulses < cf_pulses_last) {
-                difference = cf_pulses + (0xFFFF - cf_pulses_last) + 1;
+            if (cf_pulses < _cf_pulses_last) {
+                difference = cf_pulses + (0xFFFF - _cf_pulses_last) + 1;
             } else {
-                difference = cf_pulses - cf_pulses_last;
+                difference = cf_pulses - _cf_pulses_last;
             }
 
-            _energy[0] += sensor::Ws {
-                static_cast<uint32_t>(difference * (float) _coefP / 1000000.0)
-            };
-            cf_pulses_last = cf_pulses;
+            _integrateEnergy(0, static_cast<uint64_t>(difference) * _coefP);
+            _integrate(0, 0.0, _reactive, _voltage * _current);
+            _cf_pulses_last = cf_pulses;
 
         }
 
@@ -403,6 +400,8 @@ class CSE7766Sensor : public BaseEmonSensor {
         double _voltage = 0;
         double _current = 0;
 
+        uint32_t _cf_pulses_last = 0;
+
         double _ratioV;
         double _ratioC;
         double _ratioP;
@@ -17,6 +17,12 @@ constexpr const size_t DHT_MAX_DATA = 5;
 constexpr const size_t DHT_MAX_ERRORS = 5;
 constexpr const uint32_t DHT_MIN_INTERVAL = 2000;
 
+// Asynchronous reading captures the time of every falling edge: response, start of the 40 data bits and the end of the transmission
+constexpr const size_t DHT_MAX_EDGES = 42;
+constexpr const uint32_t DHT_BIT_THRESHOLD = 100;   // us, '0' is ~76us long (50us low + 26us high) and '1' is ~120us (50us low + 70us high)
+constexpr const uint32_t DHT_RECEIVE_TIMEOUT = 10000; // us, the whole transmission takes ~5ms
+constexpr const uint32_t DHT_RESET_TIME = 250;       // ms
+
 enum class DHTChipType {
     DHT11,
     DHT12,
@@ -65,6 +71,7 @@ class DHTSensor : public BaseSensor {
         }
 
         ~DHTSensor() {
+            _detach();
             if (_previous != GPIO_NONE) gpioReleaseLock(_previous);
         }
 
@@ -102,6 +109,8 @@ class DHTSensor : public BaseSensor {
             _count = 0;
 
             // Manage GPIO lock
+            _detach();
+            _state = State::Idle;
             if (_previous != GPIO_NONE) gpioReleaseLock(_previous);
             _previous = GPIO_NONE;
             if (!gpioGetLock(_gpio)) {
@@ -120,10 +129,74 @@ class DHTSensor : public BaseSensor {
 
         // Pre-read hook (usually to populate registers with up-to-date data)
         void pre() {
+            if (async()) return;
             _error = SENSOR_ERROR_OK;
             _read();
         }
 
+        // GPIO16 can't be used with interrupts, so it still uses the blocking read
+        bool async() {
+            return _gpio != 16;
+        }
+
+        void start() {
+            _error = SENSOR_ERROR_OK;
+            if (_warmup()) return;
+
+            pinMode(_gpio, OUTPUT);
+
+            // Send start signal to DHT sensor
+            if (++_errors > DHT_MAX_ERRORS) {
+                _errors = 0;
+                digitalWrite(_gpio, HIGH);
+                _state = State::Reset;
+                _started = millis();
+                return;
+            }
+
+            _startSignal();
+        }
+
+        bool poll() {
+            switch (_state) {
+                case State::Idle:
+                    return true;
+                case State::Reset:
+                    if (millis() - _started >= DHT_RESET_TIME) {
+                        _startSignal();
+                    }
+                    return false;
+                case State::Start:
+                    if (millis() - _started >= 20) {
+                        _receive();
+                    }
+                    return false;
+                case State::Receive:
+                    if ((_edges < DHT_MAX_EDGES) && (micros() - _started < DHT_RECEIVE_TIMEOUT)) {
+                        return false;
+                    }
+                    _detach();
+                    _state = State::Idle;
+                    _decode();
+                    return true;
+            }
+
+            return true;
+        }
+
+        void abort() {
+            _detach();
+            _state = State::Idle;
+            _error = SENSOR_ERROR_TIMEOUT;
+        }
+
+        // Handle interrupt calls from isr[GPIO] functions
+        void ICACHE_RAM_ATTR handleInterrupt() {
+            if (_edges < DHT_MAX_EDGES) {
+                _timings[_edges++] = ESP.getCycleCount();
+            }
+        }
+
         // Descriptive name of the sensor
         String description() {
             char buffer[20];
@@ -161,17 +234,83 @@ class DHTSensor : public BaseSensor {
         // Protected
         // ---------------------------------------------------------------------
 
-        void _read() {
+        enum class State {
+            Idle,
+            Reset,
+            Start,
+            Receive
+        };
 
+        // Sensor can only be read once in DHT_MIN_INTERVAL
+        bool _warmup() {
             if ((_last_ok > 0) && (millis() - _last_ok < DHT_MIN_INTERVAL)) {
                 if ((_temperature == DHT_DUMMY_VALUE) && (_humidity == DHT_DUMMY_VALUE)) {
                     _error = SENSOR_ERROR_WARM_UP;
                 } else {
                     _error = SENSOR_ERROR_OK;
                 }
+                return true;
+            }
+
+            return false;
+        }
+
+        // DHT11 / DHT12 need 20ms of the LOW signal, wait for it in the poll()
+        // Others only need ~1ms, which is short enough to just wait here
+        void _startSignal() {
+            digitalWrite(_gpio, LOW);
+            if ((_type == DHT_CHIP_DHT11) || (_type == DHT_CHIP_DHT12)) {
+                _state = State::Start;
+                _started = millis();
                 return;
             }
 
+            if (_type == DHT_CHIP_SI7021) {
+                delayMicroseconds(500);
+            } else {
+                delayMicroseconds(1100);
+            }
+
+            _receive();
+        }
+
+        // Release the line and let the sensor respond
+        void _receive() {
+            _edges = 0;
+            _attach();
+            pinMode(_gpio, INPUT_PULLUP);
+            _state = State::Receive;
+            _started = micros();
+        }
+
+        // Bit value depends on the time between the falling edges (start of the current and the next bits)
+        // The very first edge (response) could be missed, so only use the last 41 edges
+        void _decode() {
+            const size_t edges = _edges;
+            if (edges < (DHT_MAX_EDGES - 1)) {
+                _error = SENSOR_ERROR_TIMEOUT;
+                return;
+            }
+
+            unsigned char dhtData[DHT_MAX_DATA] = {0};
+            const size_t offset = edges - (DHT_MAX_EDGES - 1);
+            for (size_t bit = 0; bit < (DHT_MAX_DATA * 8); ++bit) {
+                const uint32_t length = clockCyclesToMicroseconds(_timings[offset + bit + 1] - _timings[offset + bit]);
+                if (length > DHT_BIT_THRESHOLD) {
+                    dhtData[bit / 8] |= (1 << (7 - (bit % 8)));
+                }
+            }
+
+            _process(dhtData);
+        }
+
+        void _attach();
+        void _detach();
+
+        void _read() {
+
+            if (_warmup()) return;
+
             unsigned long low = 0;
             unsigned long high = 0;
 
@@ -207,6 +346,7 @@ class DHTSensor : public BaseSensor {
         		// Starts new data transmission with >50us low signal
         		low = _signal(100, LOW);
         		if (low == 0) {
+                    interrupts();
                     _error = SENSOR_ERROR_TIMEOUT;
                     return;
                 }
@@ -214,6 +354,7 @@ class DHTSensor : public BaseSensor {
         		// Check to see if after >70us rx data is a 0 or a 1
         		high = _signal(100, HIGH);
                 if (high == 0) {
+                    interrupts();
                     _error = SENSOR_ERROR_TIMEOUT;
                     return;
                 }
@@ -238,6 +379,12 @@ class DHTSensor : public BaseSensor {
 
             interrupts();
 
+            _process(dhtData);
+
+        }
+
+        void _process(const unsigned char (&dhtData)[DHT_MAX_DATA]) {
+
             // Verify checksum
             if (dhtData[4] != ((dhtData[0] + dhtData[1] + dhtData[2] + dhtData[3]) & 0xFF)) {
                 _error = SENSOR_ERROR_CRC;
@@ -294,6 +441,59 @@ class DHTSensor : public BaseSensor {
         double _temperature = DHT_DUMMY_VALUE;
         double _humidity = DHT_DUMMY_VALUE;
 
+        State _state = State::Idle;
+        unsigned long _started = 0;
+
+        volatile size_t _edges = 0;
+        volatile uint32_t _timings[DHT_MAX_EDGES] = {0};
+
+};
+
+// -----------------------------------------------------------------------------
+// Interrupt helpers
+// -----------------------------------------------------------------------------
+
+DHTSensor * _dht_sensor_instance[10] = {nullptr};
+
+void ICACHE_RAM_ATTR _dht_sensor_isr(unsigned char gpio) {
+    unsigned char index = gpio > 5 ? gpio-6 : gpio;
+    if (_dht_sensor_instance[index]) {
+        _dht_sensor_instance[index]->handleInterrupt();
+    }
+}
+
+void ICACHE_RAM_ATTR _dht_sensor_isr_0() { _dht_sensor_isr(0); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_1() { _dht_sensor_isr(1); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_2() { _dht_sensor_isr(2); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_3() { _dht_sensor_isr(3); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_4() { _dht_sensor_isr(4); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_5() { _dht_sensor_isr(5); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_12() { _dht_sensor_isr(12); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_13() { _dht_sensor_isr(13); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_14() { _dht_sensor_isr(14); }
+void ICACHE_RAM_ATTR _dht_sensor_isr_15() { _dht_sensor_isr(15); }
+
+static void (*_dht_sensor_isr_list[10])() = {
+    _dht_sensor_isr_0, _dht_sensor_isr_1, _dht_sensor_isr_2,
+    _dht_sensor_isr_3, _dht_sensor_isr_4, _dht_sensor_isr_5,
+    _dht_sensor_isr_12, _dht_sensor_isr_13, _dht_sensor_isr_14,
+    _dht_sensor_isr_15
 };
 
+void DHTSensor::_attach() {
+    if (!async() || !gpioValid(_gpio)) return;
+    unsigned char index = _gpio > 5 ? _gpio-6 : _gpio;
+    _dht_sensor_instance[index] = this;
+    attachInterrupt(_gpio, _dht_sensor_isr_list[index], FALLING);
+}
+
+void DHTSensor::_detach() {
+    if (!async() || !gpioValid(_gpio)) return;
+    unsigned char index = _gpio > 5 ? _gpio-6 : _gpio;
+    if (_dht_sensor_instance[index] == this) {
+        detachInterrupt(_gpio);
+        _dht_sensor_instance[index] = nullptr;
+    }
+}
+
 #endif // SENSOR_SUPPORT && DHT_SUPPORT
@@ -38,6 +38,10 @@ class DigitalSensor : public BaseSensor {
             _default = value;
         }
 
+        void setDebounce(unsigned long debounce) {
+            _debounce = debounce;
+        }
+
         // ---------------------------------------------------------------------
 
         unsigned char getGPIO() {
@@ -52,6 +56,10 @@ class DigitalSensor : public BaseSensor {
             return _default;
         }
 
+        unsigned long getDebounce() {
+            return _debounce;
+        }
+
         // ---------------------------------------------------------------------
         // Sensor API
         // ---------------------------------------------------------------------
@@ -59,9 +67,30 @@ class DigitalSensor : public BaseSensor {
         // Initialization method, must be idempotent
         void begin() {
             pinMode(_gpio, _mode);
+            _state = digitalRead(_gpio);
+            _level = _state;
             _ready = true;
         }
 
+        // Only read when the GPIO state changes
+        bool notifies() {
+            return true;
+        }
+
+        // Level is only reported after it stays the same for the debounce time
+        void tick() {
+            const bool level = digitalRead(_gpio);
+            if (level != _level) {
+                _level = level;
+                _level_since = millis();
+            }
+
+            if ((_level != _state) && (millis() - _level_since >= _debounce)) {
+                _state = _level;
+                _markChanged();
+            }
+        }
+
         // Descriptive name of the sensor
         String description() {
             char buffer[20];
@@ -87,7 +116,7 @@ class DigitalSensor : public BaseSensor {
 
         // Current value for slot # index
         double value(unsigned char index) {
-            if (index == 0) return (digitalRead(_gpio) == _default) ? 0 : 1;
+            if (index == 0) return (_state == _default) ? 0 : 1;
             return 0;
         }
 
@@ -101,6 +130,11 @@ class DigitalSensor : public BaseSensor {
         unsigned char _gpio;
         unsigned char _mode;
         bool _default = false;
+        bool _state = false;
+
+        unsigned long _debounce = DIGITAL_DEBOUNCE;
+        unsigned long _level_since = 0;
+        bool _level = false;
 
 };
 
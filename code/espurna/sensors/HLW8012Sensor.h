@@ -219,9 +219,17 @@ class HLW8012Sensor : public BaseEmonSensor {
                 _enableInterrupts(wifiConnected());
             #endif
 
-            _energy_last = _hlw8012->getEnergy();
+            // Library counts CF pulses in the ISR, but only returns the whole Ws.
+            // Resetting it every read would drop the fraction each time, so only reset after ~1kWh
+            const uint32_t counted = _hlw8012->getEnergy();
+            _energy_last = counted - _energy_counted;
             _energy[0] += sensor::Ws { _energy_last };
-            _hlw8012->resetEnergy();
+            _energy_counted = counted;
+
+            if (_energy_counted >= sensor::Energy::KwhMultiplier) {
+                _hlw8012->resetEnergy();
+                _energy_counted = 0;
+            }
         }
 
         #if !HLW8012_USE_INTERRUPTS
@@ -312,6 +320,7 @@ class HLW8012Sensor : public BaseEmonSensor {
         bool _sel_current = true;
 
         uint32_t _energy_last = 0;
+        uint32_t _energy_counted = 0;
 
         HLW8012 * _hlw8012 = NULL;
 
@@ -48,11 +48,13 @@ const static struct {
 
 // PMS sensor utils
 // Command functions copied from: https://github.com/fu-hsi/PMS/blob/master/src/PMS.cpp
-// Reading function is rewrited to support flexible reading for PMS5003T/PMS5003ST
+// Reading function is rewrited to support flexible reading for PMS5003T/PMS5003ST, without waiting for the data
 class PMSX003 {
 
     protected:
-        Stream *_serial = NULL; // Should initialized by child class
+        // Should initialized by child class
+        // Commands written through the SoftwareSerial block for ~7ms (7 bytes at 9600 baud), see PMS_USE_SOFT
+        Stream *_serial = NULL;
 
     public:
 
@@ -86,49 +88,61 @@ class PMSX003 {
             _serial->write(command, sizeof(command));
         }
 
-        // Read sensor's data
+        // Start waiting for the new packet, discarding anything received before
+        void resetData() {
+            while (_serial->available() > 0) _serial->read();
+            _packet_size = 0;
+        }
+
+        // Read sensor's data. Consumes the available bytes, `true` when the whole packet with the valid checksum was received
         bool readData(uint16_t data[], unsigned char data_count) {
 
-            do {
+            const size_t packet_size = PMS_PACKET_SIZE(data_count);
+
+            while (_serial->available() > 0) {
 
-                int avail = _serial->available();
-                #if SENSOR_DEBUG
-                    //DEBUG_MSG("[SENSOR] PMS: Packet available = %d\n", avail);
-                #endif
-                if (avail < PMS_PACKET_SIZE(data_count)) {
-                    break;
+                const int value = _serial->read();
+                if (value < 0) break;
+
+                // Synchronize with the packet start
+                if ((_packet_size == 0) && (value != 0x42)) continue;
+                if ((_packet_size == 1) && (value != 0x4D)) {
+                    _packet_size = (value == 0x42) ? 1 : 0;
+                    continue;
                 }
 
-                if (_serial->read() == 0x42 && _serial->read() == 0x4D) {
+                _packet[_packet_size++] = value;
+                if (_packet_size < packet_size) continue;
+                _packet_size = 0;
 
-                    uint16_t sum = 0x42 + 0x4D;
-                    uint16_t size = read16(sum);
-                    if (size != PMS_PAYLOAD_SIZE(data_count)) {
-                        #if SENSOR_DEBUG
-                            DEBUG_MSG(("[SENSOR] PMS: Payload size: %d != %d.\n"), size, PMS_PAYLOAD_SIZE(data_count));
-                        #endif
-                        break;
-                    }
+                uint16_t sum = 0;
+                for (size_t index = 0; index < (packet_size - 2); ++index) {
+                    sum += _packet[index];
+                }
 
-                    for (int i = 0; i < data_count; i++) {
-                        data[i] = read16(sum);
-                        #if SENSOR_DEBUG
-                            //DEBUG_MSG(("[SENSOR] PMS:   data[%d] = %d\n"), i, data[i]);
-                        #endif
-                    }
+                const uint16_t size = (_packet[2] << 8) | _packet[3];
+                const uint16_t checksum = (_packet[packet_size - 2] << 8) | _packet[packet_size - 1];
+                if (size != PMS_PAYLOAD_SIZE(data_count)) {
+                    #if SENSOR_DEBUG
+                        DEBUG_MSG(("[SENSOR] PMS: Payload size: %d != %d.\n"), size, PMS_PAYLOAD_SIZE(data_count));
+                    #endif
+                    continue;
+                }
 
-                    uint16_t checksum = read16();
-                    if (sum == checksum) {
-                        return true;
-                    } else {
-                        #if SENSOR_DEBUG
-                            DEBUG_MSG(("[SENSOR] PMS checksum: %04X != %04X\n"), sum, checksum);
-                        #endif
-                    }
-                    break;
+                if (sum != checksum) {
+                    #if SENSOR_DEBUG
+                        DEBUG_MSG(("[SENSOR] PMS checksum: %04X != %04X\n"), sum, checksum);
+                    #endif
+                    continue;
                 }
 
-            } while (true);
+                for (int i = 0; i < data_count; i++) {
+                    data[i] = (_packet[4 + (i * 2)] << 8) | _packet[5 + (i * 2)];
+                }
+
+                return true;
+
+            }
 
             return false;
 
@@ -136,19 +150,8 @@ class PMSX003 {
 
     private:
 
-        // Read 16-bit
-        inline uint16_t read16() {
-            return ((uint16_t) _serial->read()) << 8 | _serial->read();
-        }
-
-        // Read 16-bit and calculate checksum
-        uint16_t read16(uint16_t &checksum) {
-            uint8_t high = _serial->read();
-            uint8_t low = _serial->read();
-            checksum += high;
-            checksum += low;
-            return ((uint16_t) high) << 8 | low;
-        }
+        uint8_t _packet[PMS_PACKET_SIZE(PMS_DATA_MAX)];
+        size_t _packet_size = 0;
 
 };
 
@@ -269,7 +272,14 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
             return pms_specs[_type].slot_types[index];
         }
 
-        void pre() {
+        // Request the data and wait for the response in poll()
+        bool async() {
+            return true;
+        }
+
+        void start() {
+
+            _receiving = false;
 
             if (millis() - _startTime < 30000) {
                 _error = SENSOR_ERROR_WARM_UP;
@@ -286,8 +296,6 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
                         #endif
                         wakeUp();
                         return;
-                    } else if (readCycle == 1) {
-                        requestRead();
                     } else if (readCycle > 6) {
                         return;
                     }
@@ -297,60 +305,41 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
                        wakeUp();
                    }
                 }
+                _sleep = (readCycle == 6);
             #endif
 
+            resetData();
+            requestRead();
+            _receiving = true;
+
+        }
+
+        bool poll() {
+
+            if (!_receiving) return true;
+
             uint16_t data[PMS_DATA_MAX];
-            if (readData(data, pms_specs[_type].data_count)) {
-                if (_type == PMS_TYPE_5003ST) {
-                    if (data[14] > 10 && data[14] < 1000 && data[13] < 1000) {
-                        _slot_values[0] = data[4];
-                        _slot_values[1] = (double)data[13] / 10;
-                        _slot_values[2] = (double)data[14] / 10;
-                        _slot_values[3] = (double)data[12] / 1000;
-                        _error = SENSOR_ERROR_OK;
-                    } else {
-                        _error = SENSOR_ERROR_OUT_OF_RANGE;
-                        #if SENSOR_DEBUG
-                            DEBUG_MSG("[SENSOR] %s: Invalid temperature=%d humidity=%d.\n", pms_specs[_type].name, (int)data[13], (int)data[14]);
-                        #endif
-                    }
-                } else if (_type == PMS_TYPE_5003S) {
-                    _slot_values[0] = data[4];
-                    _slot_values[1] = data[5];
-                    _slot_values[2] = (double)data[12] / 1000;
-                    _error = SENSOR_ERROR_OK;
-                } else if (_type == PMS_TYPE_5003T) {
-                    if (data[11] > 10 && data[11] < 1000 && data[10] < 1000) {
-                        _slot_values[0] = data[4];
-                        _slot_values[1] = (double)data[10] / 10;
-                        _slot_values[2] = (double)data[11] / 10;
-                        _error = SENSOR_ERROR_OK;
-                    } else {
-                        _error = SENSOR_ERROR_OUT_OF_RANGE;
-                        #if SENSOR_DEBUG
-                            DEBUG_MSG("[SENSOR] %s: Invalid temperature=%d humidity=%d.\n", pms_specs[_type].name, (int)data[10], (int)data[11]);
-                        #endif
-                    }
-                } else {
-                    _slot_values[0] = data[3];
-                    _slot_values[1] = data[4];
-                    _slot_values[2] = data[5];
-                    _error = SENSOR_ERROR_OK;
-                }
-            }
+            if (!readData(data, pms_specs[_type].data_count)) return false;
+
+            _receiving = false;
+            _process(data);
 
             #if PMS_SMART_SLEEP
-                if (readCycle == 6) {
+                if (_sleep) {
                     sleep();
                     #if SENSOR_DEBUG
                         DEBUG_MSG("[SENSOR] %s: Enter sleep mode: %d\n", pms_specs[_type].name, _readCount);
                     #endif
-                    return;
                 }
             #endif
 
-            requestRead();
+            return true;
+
+        }
 
+        void abort() {
+            _receiving = false;
+            _error = SENSOR_ERROR_TIMEOUT;
         }
 
         // Current value for slot # index
@@ -359,6 +348,45 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
         }
 
     private:
+        void _process(uint16_t data[]) {
+            if (_type == PMS_TYPE_5003ST) {
+                if (data[14] > 10 && data[14] < 1000 && data[13] < 1000) {
+                    _slot_values[0] = data[4];
+                    _slot_values[1] = (double)data[13] / 10;
+                    _slot_values[2] = (double)data[14] / 10;
+                    _slot_values[3] = (double)data[12] / 1000;
+                    _error = SENSOR_ERROR_OK;
+                } else {
+                    _error = SENSOR_ERROR_OUT_OF_RANGE;
+                    #if SENSOR_DEBUG
+                        DEBUG_MSG("[SENSOR] %s: Invalid temperature=%d humidity=%d.\n", pms_specs[_type].name, (int)data[13], (int)data[14]);
+                    #endif
+                }
+            } else if (_type == PMS_TYPE_5003S) {
+                _slot_values[0] = data[4];
+                _slot_values[1] = data[5];
+                _slot_values[2] = (double)data[12] / 1000;
+                _error = SENSOR_ERROR_OK;
+            } else if (_type == PMS_TYPE_5003T) {
+                if (data[11] > 10 && data[11] < 1000 && data[10] < 1000) {
+                    _slot_values[0] = data[4];
+                    _slot_values[1] = (double)data[10] / 10;
+                    _slot_values[2] = (double)data[11] / 10;
+                    _error = SENSOR_ERROR_OK;
+                } else {
+                    _error = SENSOR_ERROR_OUT_OF_RANGE;
+                    #if SENSOR_DEBUG
+                        DEBUG_MSG("[SENSOR] %s: Invalid temperature=%d humidity=%d.\n", pms_specs[_type].name, (int)data[10], (int)data[11]);
+                    #endif
+                }
+            } else {
+                _slot_values[0] = data[3];
+                _slot_values[1] = data[4];
+                _slot_values[2] = data[5];
+                _error = SENSOR_ERROR_OK;
+            }
+        }
+
         void removeSerial() {
             if (_serial && _soft) {
                 delete static_cast<SoftwareSerial*>(_serial);
@@ -373,8 +401,11 @@ class PMSX003Sensor : public BaseSensor, PMSX003 {
         unsigned char _type = PMS_TYPE_X003;
         double _slot_values[PMS_SLOT_MAX] = {0};
 
+        bool _receiving = false;
+
         #if PMS_SMART_SLEEP
             unsigned int _readCount = 0;
+            bool _sleep = false;
         #endif
 
 };
@@ -50,7 +50,7 @@
 #pragma once
 
 #include <Arduino.h>
-#include <PZEM004T.h>
+#include <SoftwareSerial.h>
 
 #include "BaseSensor.h"
 #include "BaseEmonSensor.h"
@@ -65,6 +65,18 @@
 #define PZ_MAGNITUDE_POWER_ACTIVE_INDEX     2
 #define PZ_MAGNITUDE_ENERGY_INDEX           3
 
+#define PZ_BAUD_RATE                        9600
+#define PZ_ERROR_VALUE                      -1.0
+#define PZ_FRAME_SIZE                       7
+
+// Requests are `command, address[4], data, checksum`, responses are `command - 0x10, data[5], checksum`
+#define PZ_COMMAND_VOLTAGE                  0xB0
+#define PZ_COMMAND_CURRENT                  0xB1
+#define PZ_COMMAND_POWER                    0xB2
+#define PZ_COMMAND_ENERGY                   0xB3
+#define PZ_COMMAND_SET_ADDRESS              0xB4
+#define PZ_RESPONSE_OFFSET                  0x10
+
 class PZEM004TSensor : public BaseEmonSensor {
 
     private:
@@ -75,7 +87,7 @@ class PZEM004TSensor : public BaseEmonSensor {
         }
 
         ~PZEM004TSensor() {
-            if (_pzem) delete _pzem;
+            removeSerial();
             PZEM004TSensor::instance = nullptr;
         }
 
@@ -124,6 +136,8 @@ class PZEM004TSensor : public BaseEmonSensor {
         }
 
         void setSerial(HardwareSerial * serial) {
+            removeSerial();
+            _soft = false;
             _serial = serial;
             _dirty = true;
         }
@@ -140,10 +154,10 @@ class PZEM004TSensor : public BaseEmonSensor {
             while (address != 0 && i++ < PZEM004T_MAX_DEVICES) {
                 IPAddress addr;
                 reading_t reading;
-                reading.current = PZEM_ERROR_VALUE;
-                reading.voltage = PZEM_ERROR_VALUE;
-                reading.power = PZEM_ERROR_VALUE;
-                reading.energy = PZEM_ERROR_VALUE;
+                reading.current = PZ_ERROR_VALUE;
+                reading.voltage = PZ_ERROR_VALUE;
+                reading.power = PZ_ERROR_VALUE;
+                reading.energy = PZ_ERROR_VALUE;
                 if (addr.fromString(address)) {
                     _addresses.push_back(addr);
                     _readings.push_back(reading);
@@ -161,13 +175,12 @@ class PZEM004TSensor : public BaseEmonSensor {
         }
 
         // Set the device physical address
+        // Request is sent from the tick() as soon as the current one is finished, result is only logged
         bool setDeviceAddress(IPAddress *addr) {
-            while(_busy) { yield(); };
-
-            _busy = true;
-            bool res = _pzem->setAddress(*addr);
-            _busy = false;
-            return res;
+            if (!_ready) return false;
+            _address = *addr;
+            _address_pending = true;
+            return true;
         }
 
         // ---------------------------------------------------------------------
@@ -188,13 +201,24 @@ class PZEM004TSensor : public BaseEmonSensor {
         void begin() {
             if (!_dirty) return;
 
-            if (_pzem) delete _pzem;
-            if (_serial) {
-                _pzem = new PZEM004T(_serial);
+            if (_soft) {
+                removeSerial();
+                _serial = new SoftwareSerial(_pin_rx, _pin_tx);
+                static_cast<SoftwareSerial*>(_serial)->begin(PZ_BAUD_RATE);
             } else {
-                _pzem = new PZEM004T(_pin_rx, _pin_tx);
+                static_cast<HardwareSerial*>(_serial)->begin(PZ_BAUD_RATE);
+            }
+
+            _waiting = false;
+            _dev = 0;
+            _magnitude = 0;
+            _last_millis = millis() - PZEM004T_READ_INTERVAL;
+
+            // Single device is configured with the expected address before anything else
+            if (_addresses.size() == 1) {
+                _address = _addresses[0];
+                _address_pending = true;
             }
-            if(_addresses.size() == 1) _pzem->setAddress(_addresses[0]);
 
             _ready = true;
             _dirty = false;
@@ -203,10 +227,10 @@ class PZEM004TSensor : public BaseEmonSensor {
         // Descriptive name of the sensor
         String description() {
             char buffer[27];
-            if (_serial) {
-                snprintf(buffer, sizeof(buffer), "PZEM004T @ HwSerial");
-            } else {
+            if (_soft) {
                 snprintf(buffer, sizeof(buffer), "PZEM004T @ SwSerial(%u,%u)", _pin_rx, _pin_tx);
+            } else {
+                snprintf(buffer, sizeof(buffer), "PZEM004T @ HwSerial");
             }
             return String(buffer);
         }
@@ -277,32 +301,41 @@ class PZEM004TSensor : public BaseEmonSensor {
         }
 
         // Loop-like method, call it in your main loop
+        // Only one request is in flight at any time. Instead of waiting for the response,
+        // we return immediately and check for the response bytes on the next tick
         void tick() {
-            static unsigned char dev = 0;
-            static unsigned char magnitude = 0;
-            static unsigned long last_millis = 0;
-
-            if (_busy || millis() - last_millis < PZEM004T_READ_INTERVAL) return;
+            if (!_ready) return;
+
+            if (_waiting) {
+                if (!_receive()) {
+                    if (millis() - _request_millis < PZEM004T_READ_TIMEOUT) return;
+                    _waiting = false;
+                    if (_command == PZ_COMMAND_SET_ADDRESS) {
+                        DEBUG_MSG_P(PSTR("[SENSOR] PZEM004T: Address request timed out\n"));
+                    } else {
+                        _error = SENSOR_ERROR_TIMEOUT;
+                        _next();
+                    }
+                    return;
+                }
 
-            _busy = true;
+                _waiting = false;
+                _store();
+                if (_command != PZ_COMMAND_SET_ADDRESS) {
+                    _next();
+                }
+                return;
+            }
 
-            // Clear buffer in case of late response(Timeout)
-            if (_serial) {
-                while(_serial->available() > 0) _serial->read();
-            } else {
-                // This we cannot do it from outside the library
+            if (_address_pending) {
+                _address_pending = false;
+                _request(_address, PZ_COMMAND_SET_ADDRESS, 0);
+                return;
             }
 
-            tickStoreReading(dev, magnitude);
+            if (_addresses.empty() || (millis() - _last_millis < PZEM004T_READ_INTERVAL)) return;
 
-            if(++dev == _addresses.size()) {
-                dev = 0;
-                last_millis = millis();
-                if(++magnitude == PZ_MAGNITUDE_COUNT) {
-                    magnitude = 0;
-                }
-            }
-            _busy = false;
+            _request(_addresses[_dev], _commandFor(_magnitude), 0);
         }
 
     protected:
@@ -311,40 +344,104 @@ class PZEM004TSensor : public BaseEmonSensor {
         // Protected
         // ---------------------------------------------------------------------
 
-        void tickStoreReading(unsigned char dev, unsigned char magnitude) {
-            float read = PZEM_ERROR_VALUE;
-            float* readings_p = nullptr;
+        void removeSerial() {
+            if (_serial && _soft) {
+                delete static_cast<SoftwareSerial*>(_serial);
+            }
+            _serial = nullptr;
+        }
 
+        static unsigned char _commandFor(unsigned char magnitude) {
             switch (magnitude) {
+                case PZ_MAGNITUDE_CURRENT_INDEX:      return PZ_COMMAND_CURRENT;
+                case PZ_MAGNITUDE_VOLTAGE_INDEX:      return PZ_COMMAND_VOLTAGE;
+                case PZ_MAGNITUDE_POWER_ACTIVE_INDEX: return PZ_COMMAND_POWER;
+                default:                              return PZ_COMMAND_ENERGY;
+            }
+        }
+
+        static unsigned char _checksum(const uint8_t* data, size_t size) {
+            unsigned char result = 0;
+            for (size_t n = 0; n < size; ++n) {
+                result += data[n];
+            }
+            return result;
+        }
+
+        void _request(const IPAddress& address, unsigned char command, unsigned char data) {
+            // Drop anything left from the previous response that came in too late
+            while (_serial->available() > 0) _serial->read();
+
+            uint8_t frame[PZ_FRAME_SIZE] = {
+                command, address[0], address[1], address[2], address[3], data, 0
+            };
+            frame[PZ_FRAME_SIZE - 1] = _checksum(frame, PZ_FRAME_SIZE - 1);
+
+            // Hardware serial only copies the frame into the TX FIFO. SoftwareSerial bit-bangs it,
+            // blocking for the whole frame (~7ms at 9600 baud), which is why it is not the default
+            _serial->write(frame, sizeof(frame));
+
+            _command = command;
+            _response_size = 0;
+            _request_millis = millis();
+            _waiting = true;
+        }
+
+        // Accumulate whatever is available, true when the whole response is here
+        bool _receive() {
+            while ((_response_size < PZ_FRAME_SIZE) && (_serial->available() > 0)) {
+                _response[_response_size++] = _serial->read();
+            }
+            return (_response_size == PZ_FRAME_SIZE);
+        }
+
+        void _store() {
+            const bool valid = (_response[0] == (_command - PZ_RESPONSE_OFFSET))
+                && (_response[PZ_FRAME_SIZE - 1] == _checksum(_response, PZ_FRAME_SIZE - 1));
+
+            if (_command == PZ_COMMAND_SET_ADDRESS) {
+                DEBUG_MSG_P(PSTR("[SENSOR] PZEM004T: Address %s %s\n"),
+                    _address.toString().c_str(), valid ? "set" : "was not set");
+                return;
+            }
+
+            if (!valid) {
+                _error = SENSOR_ERROR_CRC;
+                return;
+            }
+
+            const uint8_t* data = &_response[1];
+            auto& reading = _readings[_dev];
+
+            switch (_magnitude) {
                 case PZ_MAGNITUDE_CURRENT_INDEX:
-                    read = _pzem->current(_addresses[dev]);
-                    readings_p = &_readings[dev].current;
+                    reading.current = (data[0] << 8) + data[1] + (data[2] / 100.0);
                     break;
                 case PZ_MAGNITUDE_VOLTAGE_INDEX:
-                    read = _pzem->voltage(_addresses[dev]);
-                    readings_p = &_readings[dev].voltage;
+                    reading.voltage = (data[0] << 8) + data[1] + (data[2] / 10.0);
                     break;
                 case PZ_MAGNITUDE_POWER_ACTIVE_INDEX:
-                    read = _pzem->power(_addresses[dev]);
-                    readings_p = &_readings[dev].power;
+                    reading.power = (data[0] << 8) + data[1];
                     break;
                 case PZ_MAGNITUDE_ENERGY_INDEX:
-                    read = _pzem->energy(_addresses[dev]);
-                    readings_p = &_readings[dev].energy;
+                    reading.energy = ((uint32_t) data[0] << 16) + ((uint16_t) data[1] << 8) + data[2];
                     break;
                 default:
-                    _busy = false;
-                    return;
+                    break;
             }
+        }
 
-            if (read == PZEM_ERROR_VALUE) {
-                _error = SENSOR_ERROR_TIMEOUT;
-            } else {
-                *readings_p = read;
+        // Every device is read back-to-back, then we wait for the interval before reading the next magnitude
+        void _next() {
+            if (++_dev >= _addresses.size()) {
+                _dev = 0;
+                _last_millis = millis();
+                if (++_magnitude == PZ_MAGNITUDE_COUNT) {
+                    _magnitude = 0;
+                }
             }
         }
 
-
         struct reading_t {
             float voltage;
             float current;
@@ -354,11 +451,24 @@ class PZEM004TSensor : public BaseEmonSensor {
 
         unsigned int _pin_rx = PZEM004T_RX_PIN;
         unsigned int _pin_tx = PZEM004T_TX_PIN;
-        bool _busy = false;
+        bool _soft = true;
+        Stream * _serial = nullptr;
+
         std::vector<reading_t> _readings;
         std::vector<IPAddress> _addresses;
-        HardwareSerial * _serial = NULL;
-        PZEM004T * _pzem = NULL;
+
+        IPAddress _address;
+        bool _address_pending = false;
+
+        bool _waiting = false;
+        unsigned char _command = 0;
+        unsigned char _dev = 0;
+        unsigned char _magnitude = 0;
+        unsigned long _last_millis = 0;
+        unsigned long _request_millis = 0;
+
+        uint8_t _response[PZ_FRAME_SIZE] = {0};
+        size_t _response_size = 0;
 
 };
 
@@ -10,26 +10,45 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 #include "terminal.h"
 
+#include <algorithm>
 #include <vector>
 #include <cstdlib>
 
 #include <ArduinoJson.h>
 
+#include "settings_index.h"
 #include "storage_eeprom.h"
 
 BrokerBind(ConfigBroker);
 
 // -----------------------------------------------------------------------------
 // (HACK) Embedis storage format, reverse engineered
+// See settings_index.h for the layout details
 // -----------------------------------------------------------------------------
 
-unsigned long settingsSize() {
-    unsigned pos = SPI_FLASH_SEC_SIZE - 1;
-    while (size_t len = EEPROMr.read(pos)) {
-        if (0xFF == len) break;
-        pos = pos - len - 2;
+uint8_t _settingsRead(size_t pos) {
+    return EEPROMr.read(pos);
+}
+
+settings::embedis::Index _settings_index(_settingsRead, SPI_FLASH_SEC_SIZE, EEPROM_DATA_END);
+uint32_t _settings_generation = 1;
+
+void _settingsChanged() {
+    _settings_index.invalidate();
+    ++_settings_generation;
+}
+
+String _settingsReadString(size_t pos, size_t length) {
+    String out;
+    out.reserve(length);
+    for (size_t index = 0; index < length; ++index) {
+        out += static_cast<char>(_settings_index.read(pos + index));
     }
-    return SPI_FLASH_SEC_SIZE - pos + EEPROM_DATA_END;
+    return out;
+}
+
+unsigned long settingsSize() {
+    return SPI_FLASH_SEC_SIZE - _settings_index.end() + EEPROM_DATA_END;
 }
 
 // --------------------------------------------------------------------------
@@ -37,6 +56,24 @@ unsigned long settingsSize() {
 namespace settings {
 namespace internal {
 
+uint32_t generation() {
+    return _settings_generation;
+}
+
+bool get(const String& key, String& value) {
+    const auto* entry = _settings_index.find(key.c_str(), key.length());
+    if (!entry) {
+        return false;
+    }
+
+    value = _settingsReadString(
+        _settings_index.valuePosition(*entry),
+        _settings_index.valueLength(*entry)
+    );
+
+    return true;
+}
+
 uint32_t u32fromString(const String& string, int base) {
 
     const char *ptr = string.c_str();
@@ -120,41 +157,15 @@ unsigned char convert(const String& value) {
 // -----------------------------------------------------------------------------
 
 size_t settingsKeyCount() {
-    unsigned count = 0;
-    unsigned pos = SPI_FLASH_SEC_SIZE - 1;
-    while (size_t len = EEPROMr.read(pos)) {
-        if (0xFF == len) break;
-        pos = pos - len - 2;
-        len = EEPROMr.read(pos);
-        pos = pos - len - 2;
-        count ++;
-    }
-    return count;
+    return _settings_index.count();
 }
 
 String settingsKeyName(unsigned int index) {
-
-    String s;
-
-    unsigned count = 0;
-    unsigned pos = SPI_FLASH_SEC_SIZE - 1;
-    while (size_t len = EEPROMr.read(pos)) {
-        if (0xFF == len) break;
-        pos = pos - len - 2;
-        if (count == index) {
-            s.reserve(len);
-            for (unsigned char i = 0 ; i < len; i++) {
-                s += (char) EEPROMr.read(pos + i + 1);
-            }
-            break;
-        }
-        count++;
-        len = EEPROMr.read(pos);
-        pos = pos - len - 2;
+    const auto* entry = _settings_index.at(index);
+    if (!entry) {
+        return String();
     }
-
-    return s;
-
+    return _settingsReadString(entry->key, entry->length);
 }
 
 /*
@@ -221,29 +232,16 @@ std::vector<String> settingsKeys() {
     // Get sorted list of keys
     std::vector<String> keys;
 
-    //unsigned int size = settingsKeyCount();
     auto size = settingsKeyCount();
+    keys.reserve(size);
     for (unsigned int i=0; i<size; i++) {
-
-        //String key = settingsKeyName(i);
-        String key = settingsKeyName(i);
-        bool inserted = false;
-        for (unsigned char j=0; j<keys.size(); j++) {
-
-            // Check if we have to insert it before the current element
-            if (keys[j].compareTo(key) > 0) {
-                keys.insert(keys.begin() + j, key);
-                inserted = true;
-                break;
-            }
-
-        }
-
-        // If we could not insert it, just push it at the end
-        if (!inserted) keys.push_back(key);
-
+        keys.push_back(settingsKeyName(i));
     }
 
+    std::sort(keys.begin(), keys.end(), [](const String& lhs, const String& rhs) {
+        return lhs.compareTo(rhs) < 0;
+    });
+
     return keys;
 }
 
@@ -305,21 +303,10 @@ void moveSettings(const String& from, const String& to) {
     }
 }
 
-#if 0
-template<typename R, settings::internal::convert_t<R> Rfunc = settings::internal::convert>
-R getSetting(const settings_key_t& key, R defaultValue) {
-    String value;
-    if (!Embedis::get(key.toString(), value)) {
-        return defaultValue;
-    }
-    return Rfunc(value);
-}
-#endif
-
 template<>
 String getSetting(const settings_key_t& key, String defaultValue) {
     String value;
-    if (!Embedis::get(key.toString(), value)) {
+    if (!settings::internal::get(key.toString(), value)) {
         value = defaultValue;
     }
     return value;
@@ -375,8 +362,8 @@ bool delSetting(const settings_key_t& key) {
 }
 
 bool hasSetting(const settings_key_t& key) {
-    String value;
-    return Embedis::get(key.toString(), value);
+    const auto name = key.toString();
+    return _settings_index.find(name.c_str(), name.length()) != nullptr;
 }
 
 void saveSettings() {
@@ -389,6 +376,7 @@ void resetSettings() {
     for (unsigned int i = 0; i < EEPROM_SIZE; i++) {
         EEPROMr.write(i, 0xFF);
     }
+    _settingsChanged();
     EEPROMr.commit();
 }
 
@@ -418,6 +406,7 @@ bool settingsRestoreJson(JsonObject& data) {
         for (unsigned int i = EEPROM_DATA_END; i < SPI_FLASH_SEC_SIZE; i++) {
             EEPROMr.write(i, 0xFF);
         }
+        _settingsChanged();
     }
 
     // Dump settings to memory buffer
@@ -486,7 +475,11 @@ void settingsSetup() {
     Embedis::dictionary( F("EEPROM"),
         SPI_FLASH_SEC_SIZE,
         [](size_t pos) -> char { return EEPROMr.read(pos); },
-        [](size_t pos, char value) { EEPROMr.write(pos, value); },
+        [](size_t pos, char value) {
+            // Embedis can shift existing kv pairs when writing, rebuild the index on the next lookup
+            _settingsChanged();
+            EEPROMr.write(pos, value);
+        },
         #if SETTINGS_AUTOSAVE
             []() { eepromCommit(); }
         #else
@@ -494,6 +487,17 @@ void settingsSetup() {
         #endif
     );
 
+    // EEPROM sector is already loaded into the RAM by the eepromSetup()
+    _settings_index.build();
+
+    // Make sure cached values are refreshed when runtime configuration changes
+    ConfigBroker::Register([](const String&, const String&) {
+        ++_settings_generation;
+    });
+    espurnaRegisterReload([]() {
+        ++_settings_generation;
+    });
+
     terminalRegisterCommand(F("CONFIG"), [](const terminal::CommandContext& ctx) {
         // TODO: enough of a buffer?
         DynamicJsonBuffer jsonBuffer(1024);
@@ -563,7 +567,7 @@ void settingsSetup() {
         for (auto it = (ctx.argv.begin() + 1); it != ctx.argv.end(); ++it) {
             const String& key = *it;
             String value;
-            if (!Embedis::get(key, value)) {
+            if (!settings::internal::get(key, value)) {
                 const auto maybeDefault = settingsQueryDefaults(key);
                 if (maybeDefault.length()) {
                     ctx.output.printf("> %s => %s (default)\n", key.c_str(), maybeDefault.c_str());
@@ -10,6 +10,7 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 #include "espurna.h"
 
+#include <array>
 #include <functional>
 #include <utility>
 #include <vector>
@@ -82,6 +83,11 @@ using settings_cfg_list_t = std::initializer_list<settings_cfg_t>;
 namespace settings {
 namespace internal {
 
+bool get(const String& key, String& value);
+
+// Incremented every time settings storage is changed or the configuration is reloaded
+uint32_t generation();
+
 uint32_t u32fromString(const String& string, int base);
 
 template <typename T>
@@ -155,7 +161,7 @@ R getSetting(const settings_key_t& key, R defaultValue) __attribute__((noinline)
 template<typename R, settings::internal::convert_t<R> Rfunc = settings::internal::convert>
 R getSetting(const settings_key_t& key, R defaultValue) {
     String value;
-    if (!Embedis::get(key.toString(), value)) {
+    if (!settings::internal::get(key.toString(), value)) {
         return defaultValue;
     }
     return Rfunc(value);
@@ -179,6 +185,106 @@ bool setSetting(const settings_key_t& key, const String& value);
 bool delSetting(const settings_key_t& key);
 bool hasSetting(const settings_key_t& key);
 
+// --------------------------------------------------------------------------
+// Typed settings cache. Keeps parsed value in RAM and only reads it again after
+// the settings were changed (see settings::internal::generation())
+//
+// settings::Cached<int> _module_value("moduleValue", 5);
+// ...
+// if (_module_value.get() > 5) { ... }
+// --------------------------------------------------------------------------
+
+namespace settings {
+
+template <typename T>
+class Cached {
+    public:
+        Cached(const char* key, T defaultValue) :
+            _key(key),
+            _index(-1),
+            _default(defaultValue),
+            _value(defaultValue)
+        {}
+
+        Cached(const char* key, unsigned char index, T defaultValue) :
+            _key(key),
+            _index(index),
+            _default(defaultValue),
+            _value(defaultValue)
+        {}
+
+        const T& get() {
+            const auto current = internal::generation();
+            if (_generation != current) {
+                _value = (_index < 0)
+                    ? getSetting(settings_key_t(_key), _default)
+                    : getSetting(settings_key_t(_key, _index), _default);
+                _generation = current;
+            }
+            return _value;
+        }
+
+    private:
+        const char* _key;
+        int _index;
+        const T _default;
+        T _value;
+        uint32_t _generation { 0 };
+};
+
+// Same as the above, but for the indexed keys {key, 0} ... {key, Size - 1}
+// size() is the number of existing keys, counting from 0 until the first missing one
+template <typename T, size_t Size>
+class CachedList {
+    public:
+        CachedList(const char* key, T defaultValue) :
+            _key(key),
+            _default(defaultValue)
+        {}
+
+        const T& get(unsigned char index) {
+            _update();
+            return (index < Size) ? _values[index] : _default;
+        }
+
+        size_t size() {
+            _update();
+            return _size;
+        }
+
+        constexpr size_t capacity() const {
+            return Size;
+        }
+
+    private:
+        void _update() {
+            const auto current = internal::generation();
+            if (_generation == current) {
+                return;
+            }
+
+            _size = 0;
+            for (unsigned char index = 0; index < Size; ++index) {
+                const settings_key_t key(_key, index);
+                const bool exists = hasSetting(key);
+                _values[index] = exists ? getSetting(key, _default) : _default;
+                if (exists && (_size == index)) {
+                    ++_size;
+                }
+            }
+
+            _generation = current;
+        }
+
+        const char* _key;
+        const T _default;
+        std::array<T, Size> _values;
+        size_t _size { 0 };
+        uint32_t _generation { 0 };
+};
+
+} // namespace settings
+
 void saveSettings();
 void resetSettings();
 
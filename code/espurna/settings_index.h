@@ -0,0 +1,202 @@
+/*
+
+SETTINGS MODULE
+
+In-memory index of the Embedis key-value storage
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace settings {
+namespace embedis {
+
+// (HACK) Embedis storage format, reverse engineered
+//
+// Key-value pairs are written starting from the end of the storage and grow towards its beginning.
+// Every string is followed by it's length (2 bytes, but only the lower one is used by us),
+// and the key always goes first:
+//
+// ... | value | vlen | key | klen | <- end of the storage
+//
+// Zero or 0xFF length means that there are no more pairs stored.
+//
+// Embedis::get() has to walk the whole list for every lookup. Instead, scan the storage once
+// and remember where every key is, indexed by it's hash. Any write to the storage can move
+// existing pairs around, so the index is simply marked as invalid and rebuilt on the next lookup.
+
+class Index {
+    public:
+
+    using reader_t = uint8_t(*)(size_t position);
+
+    struct entry_t {
+        uint32_t hash;
+        uint16_t key;    // position of the first character of the key
+        uint8_t length;  // key length
+    };
+
+    static constexpr uint16_t Empty = 0xFFFF;
+
+    static uint32_t hash(const char* key, size_t length) {
+        // 32bit FNV-1a
+        uint32_t result = 2166136261UL;
+        for (size_t index = 0; index < length; ++index) {
+            result ^= static_cast<uint8_t>(key[index]);
+            result *= 16777619UL;
+        }
+        return result;
+    }
+
+    Index(reader_t reader, size_t size, size_t start = 0) :
+        _reader(reader),
+        _size(size),
+        _start(start)
+    {}
+
+    void invalidate() {
+        _valid = false;
+    }
+
+    bool valid() const {
+        return _valid;
+    }
+
+    // Number of kv pairs, in the same order as they are stored
+    size_t count() {
+        _ensure();
+        return _entries.size();
+    }
+
+    // Lowest position used by the kv pairs
+    size_t end() {
+        _ensure();
+        return _end;
+    }
+
+    const entry_t* at(size_t index) {
+        _ensure();
+        return (index < _entries.size()) ? &_entries[index] : nullptr;
+    }
+
+    const entry_t* find(const char* key, size_t length) {
+        _ensure();
+        if (_buckets.empty()) {
+            return nullptr;
+        }
+
+        const auto hashed = hash(key, length);
+        const size_t mask = _buckets.size() - 1;
+        for (size_t bucket = hashed & mask; _buckets[bucket] != Empty; bucket = (bucket + 1) & mask) {
+            const auto& entry = _entries[_buckets[bucket]];
+            if ((entry.hash == hashed) && (entry.length == length) && _equals(entry, key)) {
+                return &entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Value immediately precedes the key, positions point to the first character
+    size_t valueLength(const entry_t& entry) const {
+        return _reader(entry.key - 1);
+    }
+
+    size_t valuePosition(const entry_t& entry) const {
+        return entry.key - valueLength(entry) - 2;
+    }
+
+    uint8_t read(size_t position) const {
+        return _reader(position);
+    }
+
+    void build() {
+        _entries.clear();
+        _buckets.clear();
+
+        size_t pos = _size - 1;
+        while (pos > _start) {
+            uint8_t key_length = _reader(pos);
+            if (!key_length || (0xFF == key_length) || (pos < (_start + key_length + 2))) {
+                break;
+            }
+
+            pos -= key_length + 2;
+            const auto key = pos + 1;
+
+            uint8_t value_length = _reader(pos);
+            if ((0xFF == value_length) || (pos < (_start + value_length + 2))) {
+                break;
+            }
+
+            pos -= value_length + 2;
+
+            _entries.push_back({_hash(key, key_length), static_cast<uint16_t>(key), key_length});
+        }
+
+        _end = pos;
+
+        // Keep the load factor below 50%, so the linear probing stays short
+        size_t buckets = 8;
+        while (buckets < (_entries.size() * 2)) {
+            buckets <<= 1;
+        }
+
+        _buckets.assign(buckets, static_cast<uint16_t>(Empty));
+
+        const size_t mask = buckets - 1;
+        for (size_t index = 0; index < _entries.size(); ++index) {
+            size_t bucket = _entries[index].hash & mask;
+            while (_buckets[bucket] != Empty) {
+                bucket = (bucket + 1) & mask;
+            }
+            _buckets[bucket] = index;
+        }
+
+        _valid = true;
+    }
+
+    private:
+
+    void _ensure() {
+        if (!_valid) {
+            build();
+        }
+    }
+
+    uint32_t _hash(size_t position, size_t length) const {
+        uint32_t result = 2166136261UL;
+        for (size_t index = 0; index < length; ++index) {
+            result ^= _reader(position + index);
+            result *= 16777619UL;
+        }
+        return result;
+    }
+
+    bool _equals(const entry_t& entry, const char* key) const {
+        for (size_t index = 0; index < entry.length; ++index) {
+            if (_reader(entry.key + index) != static_cast<uint8_t>(key[index])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    reader_t _reader;
+    size_t _size;
+    size_t _start;
+    size_t _end { 0 };
+    bool _valid { false };
+
+    std::vector<entry_t> _entries;
+    std::vector<uint16_t> _buckets;
+
+};
+
+} // namespace embedis
+} // namespace settings
@@ -7,10 +7,17 @@ EEPROM MODULE
 #include "storage_eeprom.h"
 #include "settings.h"
 
-EEPROM_Rotate EEPROMr;
+EepromRotate EEPROMr;
 bool _eeprom_commit = false;
 
+unsigned long _eeprom_commit_delay = EEPROM_COMMIT_DELAY;
+unsigned long _eeprom_commit_requested = 0;
+
 uint32_t _eeprom_commit_count = 0;
+uint32_t _eeprom_commit_requests = 0;
+uint32_t _eeprom_commit_erases = 0;
+uint32_t _eeprom_commit_last_us = 0;
+uint32_t _eeprom_commit_max_us = 0;
 bool _eeprom_last_commit_result = false;
 
 void eepromRotate(bool value) {
@@ -49,12 +56,39 @@ void eepromSectorsDebug() {
 
 bool _eepromCommit() {
     _eeprom_commit_count++;
+
+    // commit() returns right away when nothing was changed since the last one
+    const bool dirty = EEPROMr.dirty();
+
+    const auto start = micros();
     _eeprom_last_commit_result = EEPROMr.commit();
+    _eeprom_commit_last_us = micros() - start;
+    _eeprom_commit_max_us = std::max(_eeprom_commit_max_us, _eeprom_commit_last_us);
+
+    // Otherwise, the next sector of the pool is erased and written
+    if (dirty && _eeprom_last_commit_result) {
+        _eeprom_commit_erases++;
+    }
+
     return _eeprom_last_commit_result;
 }
 
+// Requests are not written immediately. Instead, the first one starts the commit window,
+// and every request made until the window ends is written to the flash at once.
+// Flushed data is still the whole EEPROM sector, written by the EEPROM_Rotate to the next sector of the pool.
 void eepromCommit() {
-    _eeprom_commit = true;
+    _eeprom_commit_requests++;
+    if (!_eeprom_commit) {
+        _eeprom_commit_requested = millis();
+        _eeprom_commit = true;
+    }
+}
+
+// Write pending changes right now, e.g. when the device is about to reset
+bool eepromFlush() {
+    if (!_eeprom_commit) return true;
+    _eeprom_commit = false;
+    return _eepromCommit();
 }
 
 void eepromBackup(uint32_t index){
@@ -68,15 +102,20 @@ void _eepromInitCommands() {
     terminalRegisterCommand(F("EEPROM"), [](const terminal::CommandContext&) {
         infoMemory("EEPROM", SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE - settingsSize());
         eepromSectorsDebug();
+        DEBUG_MSG_P(PSTR("[MAIN] Commit requests: %u (window %lu ms)\n"), _eeprom_commit_requests, _eeprom_commit_delay);
         if (_eeprom_commit_count > 0) {
-            DEBUG_MSG_P(PSTR("[MAIN] Commits done: %lu\n"), _eeprom_commit_count);
+            DEBUG_MSG_P(PSTR("[MAIN] Commits done: %u\n"), _eeprom_commit_count);
+            DEBUG_MSG_P(PSTR("[MAIN]  Sector erases: %u\n"), _eeprom_commit_erases);
             DEBUG_MSG_P(PSTR("[MAIN]  Last result: %s\n"), _eeprom_last_commit_result ? "OK" : "ERROR");
+            DEBUG_MSG_P(PSTR("[MAIN]  Latency: %u us (max %u us)\n"), _eeprom_commit_last_us, _eeprom_commit_max_us);
         }
         terminalOK();
     });
 
+    // Same as the commit window ending right now
     terminalRegisterCommand(F("EEPROM.COMMIT"), [](const terminal::CommandContext&) {
-        const bool res = _eepromCommit();
+        eepromCommit();
+        const bool res = eepromFlush();
         if (res) {
             terminalOK();
         } else {
@@ -113,12 +152,15 @@ void _eepromInitCommands() {
 // -----------------------------------------------------------------------------
 
 void eepromLoop() {
-    if (_eeprom_commit) {
-        _eepromCommit();
-        _eeprom_commit = false;
+    if (_eeprom_commit && (millis() - _eeprom_commit_requested >= _eeprom_commit_delay)) {
+        eepromFlush();
     }
 }
 
+void _eepromConfigure() {
+    _eeprom_commit_delay = getSetting("eepromDelay", EEPROM_COMMIT_DELAY);
+}
+
 void eepromSetup() {
 
     #ifdef EEPROM_ROTATE_SECTORS
@@ -138,10 +180,14 @@ void eepromSetup() {
     EEPROMr.offset(EEPROM_ROTATE_DATA);
     EEPROMr.begin(EEPROM_SIZE);
 
+    // Embedis is not yet set up, but settings can already be read from the loaded sector
+    _eepromConfigure();
+
     #if TERMINAL_SUPPORT
         _eepromInitCommands();
     #endif
 
-    espurnaRegisterLoop(eepromLoop);
+    espurnaRegisterLoop(eepromLoop, PSTR("eeprom"));
+    espurnaRegisterReload(_eepromConfigure);
 
 }
@@ -13,7 +13,15 @@ EEPROM MODULE
 
 #include "espurna.h"
 
-extern EEPROM_Rotate EEPROMr;
+// Library only tracks the pending changes internally, expose them so we know when commit() actually erases the sector
+class EepromRotate : public EEPROM_Rotate {
+    public:
+        bool dirty() const {
+            return _dirty;
+        }
+};
+
+extern EepromRotate EEPROMr;
 
 void eepromSectorsDebug();
 void eepromRotate(bool value);
@@ -22,5 +30,6 @@ String eepromSectors();
 
 void eepromBackup(uint32_t index);
 void eepromCommit();
+bool eepromFlush();
 
 void eepromSetup();
@@ -140,6 +140,7 @@ unsigned char customResetReason() {
 }
 
 void reset() {
+    eepromFlush();
     ESP.restart();
 }
 
@@ -276,7 +277,7 @@ void systemSetup() {
     _systemSetupSpecificHardware();
 
     // Register Loop
-    espurnaRegisterLoop(systemLoop);
+    espurnaRegisterLoop(systemLoop, PSTR("system"));
 
     // Cache Heartbeat values
     _systemSetupHeartbeat();
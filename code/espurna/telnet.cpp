@@ -479,7 +479,7 @@ void telnetSetup() {
         _telnet_data_buffer.reserve(terminalCapacity());
         _telnetServer.setNoDelay(true);
         _telnetServer.begin();
-        espurnaRegisterLoop(_telnetLoop);
+        espurnaRegisterLoop(_telnetLoop, PSTR("telnet"));
     #else
         _telnetServer.onClient([](void *s, AsyncClient* c) {
             _telnetNewClient(c);
@@ -627,7 +627,7 @@ void terminalSetup() {
     #endif // SERIAL_RX_ENABLED
 
     // Register loop
-    espurnaRegisterLoop(_terminalLoop);
+    espurnaRegisterLoop(_terminalLoop, PSTR("terminal"));
 
 }
 
@@ -142,73 +142,76 @@ void updateOperationMode() {
 //------------------------------------------------------------------------------
 // MQTT
 //------------------------------------------------------------------------------
-void thermostatMQTTCallback(unsigned int type, const char * topic, const char * payload) {
+// Check remote sensor temperature
+void _thermostatMQTTRemoteSensor(const mqtt::match_t&, const char * payload) {
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& root = jsonBuffer.parseObject(payload);
+    if (!root.success()) {
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] Error parsing data\n"));
+        return;
+    }
 
-    if (type == MQTT_CONNECT_EVENT) {
-      mqttSubscribeRaw(thermostat_remote_sensor_topic.c_str());
-      mqttSubscribe(MQTT_TOPIC_HOLD_TEMP);
+    if (root.containsKey(magnitudeTopic(MAGNITUDE_TEMPERATURE))) {
+        String remote_temp = root[magnitudeTopic(MAGNITUDE_TEMPERATURE)];
+        _remote_temp.temp = remote_temp.toFloat();
+        _remote_temp.last_update = millis();
+        _remote_temp.need_display_update = true;
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] Remote sensor temperature: %s\n"), remote_temp.c_str());
+        updateRemoteTemp(true);
     }
 
-    if (type == MQTT_MESSAGE_EVENT) {
+}
 
-        // Match topic
-        String t = mqttMagnitude((char *) topic);
+// Check temperature range change
+void _thermostatMQTTHoldTemp(const mqtt::match_t&, const char * payload) {
 
-        if (strcmp(topic, thermostat_remote_sensor_topic.c_str()) != 0
-         && !t.equals(MQTT_TOPIC_HOLD_TEMP))
-           return;
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& root = jsonBuffer.parseObject(payload);
+    if (!root.success()) {
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] Error parsing data\n"));
+        return;
+    }
 
-        // Parse JSON input
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& root = jsonBuffer.parseObject(payload);
-        if (!root.success()) {
-            DEBUG_MSG_P(PSTR("[THERMOSTAT] Error parsing data\n"));
+    if (root.containsKey(MQTT_TOPIC_HOLD_TEMP_MIN)) {
+        int t_min = root[MQTT_TOPIC_HOLD_TEMP_MIN];
+        int t_max = root[MQTT_TOPIC_HOLD_TEMP_MAX];
+        if (t_min < THERMOSTAT_TEMP_RANGE_MIN_MIN || t_min > THERMOSTAT_TEMP_RANGE_MIN_MAX ||
+            t_max < THERMOSTAT_TEMP_RANGE_MAX_MIN || t_max > THERMOSTAT_TEMP_RANGE_MAX_MAX) {
+            DEBUG_MSG_P(PSTR("[THERMOSTAT] Hold temperature range error\n"));
             return;
         }
+        _temp_range.min = root[MQTT_TOPIC_HOLD_TEMP_MIN];
+        _temp_range.max = root[MQTT_TOPIC_HOLD_TEMP_MAX];
+        setSetting(NAME_TEMP_RANGE_MIN, _temp_range.min);
+        setSetting(NAME_TEMP_RANGE_MAX, _temp_range.max);
+        saveSettings();
+        _temp_range.ask_interval = ASK_TEMP_RANGE_INTERVAL_REGULAR;
+        _temp_range.last_update = millis();
+        _temp_range.need_display_update = true;
+
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] Hold temperature range: (%d - %d)\n"), _temp_range.min, _temp_range.max);
+        // Update websocket clients
+        #if WEB_SUPPORT
+            char buffer[100];
+            snprintf_P(buffer, sizeof(buffer), PSTR("{\"thermostatVisible\": 1, \"tempRangeMin\": %d, \"tempRangeMax\": %d}"), _temp_range.min, _temp_range.max);
+            wsSend(buffer);
+        #endif
+    } else {
+        DEBUG_MSG_P(PSTR("[THERMOSTAT] Error temperature range data\n"));
+    }
 
-        // Check rempte sensor temperature
-        if (strcmp(topic, thermostat_remote_sensor_topic.c_str()) == 0) {
-            if (root.containsKey(magnitudeTopic(MAGNITUDE_TEMPERATURE))) {
-                String remote_temp = root[magnitudeTopic(MAGNITUDE_TEMPERATURE)];
-                _remote_temp.temp = remote_temp.toFloat();
-                _remote_temp.last_update = millis();
-                _remote_temp.need_display_update = true;
-                DEBUG_MSG_P(PSTR("[THERMOSTAT] Remote sensor temperature: %s\n"), remote_temp.c_str());
-                updateRemoteTemp(true);
-            }
-        }
+}
 
-        // Check temperature range change
-        if (t.equals(MQTT_TOPIC_HOLD_TEMP)) {
-            if (root.containsKey(MQTT_TOPIC_HOLD_TEMP_MIN)) {
-                int t_min = root[MQTT_TOPIC_HOLD_TEMP_MIN];
-                int t_max = root[MQTT_TOPIC_HOLD_TEMP_MAX];
-                if (t_min < THERMOSTAT_TEMP_RANGE_MIN_MIN || t_min > THERMOSTAT_TEMP_RANGE_MIN_MAX ||
-                    t_max < THERMOSTAT_TEMP_RANGE_MAX_MIN || t_max > THERMOSTAT_TEMP_RANGE_MAX_MAX) {
-                    DEBUG_MSG_P(PSTR("[THERMOSTAT] Hold temperature range error\n"));
-                    return;
-                }
-                _temp_range.min = root[MQTT_TOPIC_HOLD_TEMP_MIN];
-                _temp_range.max = root[MQTT_TOPIC_HOLD_TEMP_MAX];
-                setSetting(NAME_TEMP_RANGE_MIN, _temp_range.min);
-                setSetting(NAME_TEMP_RANGE_MAX, _temp_range.max);
-                saveSettings();
-                _temp_range.ask_interval = ASK_TEMP_RANGE_INTERVAL_REGULAR;
-                _temp_range.last_update = millis();
-                _temp_range.need_display_update = true;
-
-                DEBUG_MSG_P(PSTR("[THERMOSTAT] Hold temperature range: (%d - %d)\n"), _temp_range.min, _temp_range.max);
-                // Update websocket clients
-                #if WEB_SUPPORT
-                    char buffer[100];
-                    snprintf_P(buffer, sizeof(buffer), PSTR("{\"thermostatVisible\": 1, \"tempRangeMin\": %d, \"tempRangeMax\": %d}"), _temp_range.min, _temp_range.max);
-                    wsSend(buffer);
-                #endif
-            } else {
-                DEBUG_MSG_P(PSTR("[THERMOSTAT] Error temperature range data\n"));
-            }
-        }
+void thermostatMQTTCallback(unsigned int type, const char * topic, const char * payload) {
+
+    if (type == MQTT_CONNECT_EVENT) {
+      mqttUnregisterTopics(_thermostatMQTTRemoteSensor);
+      mqttRegisterRawTopic(thermostat_remote_sensor_topic.c_str(), _thermostatMQTTRemoteSensor);
+      mqttSubscribeRaw(thermostat_remote_sensor_topic.c_str());
+      mqttSubscribe(MQTT_TOPIC_HOLD_TEMP);
     }
+
 }
 
 //------------------------------------------------------------------------------
@@ -650,7 +653,7 @@ void displaySetup() {
 
   displayOn();
 
-  espurnaRegisterLoop(displayLoop);
+  espurnaRegisterLoop(displayLoop, PSTR("display"));
 }
 
 //------------------------------------------------------------------------------
@@ -805,6 +808,7 @@ void thermostatSetup() {
 
   #if MQTT_SUPPORT
     mqttRegister(thermostatMQTTCallback);
+    mqttRegisterTopic(MQTT_TOPIC_HOLD_TEMP, _thermostatMQTTHoldTemp);
   #endif
 
   // Websockets
@@ -815,7 +819,7 @@ void thermostatSetup() {
           .onAction(_thermostatWebSocketOnAction);
   #endif
 
-  espurnaRegisterLoop(thermostatLoop);
+  espurnaRegisterLoop(thermostatLoop, PSTR("thermostat"));
   espurnaRegisterReload(_thermostatReload);
 }
 
@@ -50,6 +50,9 @@ bool _tspk_flush = false;
 unsigned long _tspk_last_flush = 0;
 unsigned char _tspk_tries = THINGSPEAK_TRIES;
 
+espurna_task_t _tspk_flush_task = EspurnaTaskNone;
+constexpr unsigned long THINGSPEAK_FLUSH_RETRY = 1000;
+
 #if THINGSPEAK_USE_ASYNC
 
 class AsyncThingspeak : public AsyncClient {
@@ -150,7 +153,7 @@ void _tspkClearQueue() {
 
 void _tspkRetry(int code) {
     if ((0 == code) && _tspk_tries) {
-        _tspk_flush = true;
+        tspkFlush();
         DEBUG_MSG_P(PSTR("[THINGSPEAK] Re-enqueuing %u more time(s)\n"), _tspk_tries);
     } else {
         _tspkClearQueue();
@@ -431,18 +434,31 @@ bool tspkEnqueueMeasurement(unsigned char index, const char * payload) {
     return false;
 }
 
+// Flush is only attempted when THINGSPEAK_MIN_INTERVAL passes since the last one
+void _tspkFlushSchedule(unsigned long minimum) {
+    const auto elapsed = millis() - _tspk_last_flush;
+    const auto left = (elapsed < THINGSPEAK_MIN_INTERVAL) ? (THINGSPEAK_MIN_INTERVAL - elapsed) : 0;
+    espurnaTaskSchedule(_tspk_flush_task, std::max(left, minimum));
+}
+
 void tspkFlush() {
     _tspk_flush = true;
+    _tspkFlushSchedule(0);
 }
 
 bool tspkEnabled() {
     return _tspk_enabled;
 }
 
-void tspkLoop() {
-    if (!_tspk_enabled) return;
-    if (!wifiConnected() || (WiFi.getMode() != WIFI_STA)) return;
-    _tspkFlush();
+void _tspkFlushTask() {
+    if (_tspk_enabled && wifiConnected() && (WiFi.getMode() == WIFI_STA)) {
+        _tspkFlush();
+    }
+
+    // Still waiting for the network or for the previous request to finish
+    if (_tspk_flush) {
+        _tspkFlushSchedule(THINGSPEAK_FLUSH_RETRY);
+    }
 }
 
 void tspkSetup() {
@@ -464,7 +480,7 @@ void tspkSetup() {
     );
 
     // Main callbacks
-    espurnaRegisterLoop(tspkLoop);
+    _tspk_flush_task = espurnaRegisterTask(_tspkFlushTask, PSTR("thingspeak"));
     espurnaRegisterReload(_tspkConfigure);
 
 }
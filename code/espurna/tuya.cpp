@@ -551,7 +551,7 @@ namespace Tuya {
 
         TUYA_SERIAL.begin(SERIAL_SPEED);
 
-        ::espurnaRegisterLoop(tuyaLoop);
+        ::espurnaRegisterLoop(tuyaLoop, PSTR("tuya"));
         ::wifiRegister([](justwifi_messages_t code, char * parameter) {
             if ((MESSAGE_CONNECTED == code) || (MESSAGE_DISCONNECTED == code)) {
                 sendWiFiStatus();
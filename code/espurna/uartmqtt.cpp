@@ -101,7 +101,7 @@ void uartmqttSetup() {
     mqttRegister(_uartmqttMQTTCallback);
 
     // Register loop
-    espurnaRegisterLoop(_uartmqttLoop);
+    espurnaRegisterLoop(_uartmqttLoop, PSTR("uartmqtt"));
 
 }
 
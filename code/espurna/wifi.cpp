@@ -716,7 +716,7 @@ void wifiSetup() {
     #endif
 
     // Main callbacks
-    espurnaRegisterLoop(wifiLoop);
+    espurnaRegisterLoop(wifiLoop, PSTR("wifi"));
     espurnaRegisterReload(_wifiConfigure);
 
 }
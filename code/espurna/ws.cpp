@@ -713,7 +713,7 @@ void wsSetup() {
         .onConnected(_wsOnConnected)
         .onKeyCheck(_wsOnKeyCheck);
 
-    espurnaRegisterLoop(_wsLoop);
+    espurnaRegisterLoop(_wsLoop, PSTR("ws"));
 }
 
 #endif // WEB_SUPPORT
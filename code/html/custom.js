@@ -2105,6 +2105,22 @@ function processData(data) {
             return;
         }
 
+        // Loop profiler
+        if ("profiler" === key) {
+            var lines = ["kind         id           count      avg        max        p99"];
+            for (var i = 0; i < value.kind.length; ++i) {
+                lines.push([
+                    value.kind[i], value.id[i], value.count[i],
+                    value.avg[i], value.max[i], value.p99[i]
+                ].map(function(item, index) {
+                    var text = String(item);
+                    return (index < 2) ? text.padEnd(13) : text.padEnd(11);
+                }).join(""));
+            }
+            $("#profiler").text(lines.join("\n"));
+            return;
+        }
+
         // Enable options
         var position = key.indexOf("Visible");
         if (position > 0 && position === key.length - 7) {
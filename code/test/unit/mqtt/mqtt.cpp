@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "mqtt_trie.h"
+
+static unsigned int calls = 0;
+static unsigned int last_id = 0;
+static unsigned int last_number = 0;
+
+void callback_relay(const mqtt::match_t& match, const char*) {
+    ++calls;
+    last_id = match.id;
+    match.number(0, last_number);
+}
+
+void callback_other(const mqtt::match_t& match, const char*) {
+    ++calls;
+    last_id = match.id;
+}
+
+void test_match() {
+    mqtt::TopicTrie trie;
+    TEST_ASSERT(trie.add("relay/+", callback_relay));
+    TEST_ASSERT(trie.add("group/kitchen", callback_other, 3));
+
+    calls = 0;
+    TEST_ASSERT_EQUAL(1, trie.match("relay/5", ""));
+    TEST_ASSERT_EQUAL(5, last_number);
+
+    TEST_ASSERT_EQUAL(1, trie.match("group/kitchen", ""));
+    TEST_ASSERT_EQUAL(3, last_id);
+
+    TEST_ASSERT_EQUAL(0, trie.match("relay/5/extra", ""));
+    TEST_ASSERT_EQUAL(2, calls);
+}
+
+void test_remove() {
+    mqtt::TopicTrie trie;
+    trie.add("group/a", callback_other, 0);
+    trie.add("group/b", callback_other, 1);
+    trie.add("relay/+", callback_relay);
+    TEST_ASSERT_EQUAL(3, trie.handlers());
+
+    trie.remove(callback_other);
+    TEST_ASSERT_EQUAL(1, trie.handlers());
+    TEST_ASSERT_EQUAL(0, trie.match("group/a", ""));
+    TEST_ASSERT_EQUAL(0, trie.match("group/b", ""));
+    TEST_ASSERT_EQUAL(1, trie.match("relay/1", ""));
+}
+
+// Same as the MQTT reconnect, every group topic is unregistered and registered again
+void test_reregister() {
+    mqtt::TopicTrie trie;
+    trie.add("relay/+", callback_relay);
+
+    const char* topics[] = {"group/a", "group/b", "group/c", "other/d"};
+    for (unsigned char id = 0; id < 4; ++id) {
+        trie.add(topics[id], callback_other, id);
+    }
+
+    const auto handlers = trie.handlers();
+    const auto capacity = trie.capacity();
+    const auto nodes = trie.nodes();
+
+    for (size_t n = 0; n < 100; ++n) {
+        trie.remove(callback_other);
+        for (unsigned char id = 0; id < 4; ++id) {
+            trie.add(topics[id], callback_other, id);
+        }
+        TEST_ASSERT_EQUAL(handlers, trie.handlers());
+        TEST_ASSERT_EQUAL(capacity, trie.capacity());
+        TEST_ASSERT_EQUAL(nodes, trie.nodes());
+    }
+
+    calls = 0;
+    TEST_ASSERT_EQUAL(1, trie.match("group/c", ""));
+    TEST_ASSERT_EQUAL(2, last_id);
+    TEST_ASSERT_EQUAL(1, trie.match("relay/7", ""));
+    TEST_ASSERT_EQUAL(7, last_number);
+}
+
+// When adding test functions, don't forget to add RUN_TEST(...) in the main()
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_match);
+    RUN_TEST(test_remove);
+    RUN_TEST(test_reregister);
+    UNITY_END();
+}
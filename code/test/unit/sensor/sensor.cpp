@@ -0,0 +1,504 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#define SENSOR_SUPPORT 1
+#include "config/sensors.h"
+
+#include "filters/SensorFilter.h"
+#include "sensor_history.h"
+#include "sensor_report.h"
+
+// -----------------------------------------------------------------------------
+// Count every allocation, magnitude pipeline is not supposed to do any
+// -----------------------------------------------------------------------------
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    free(ptr);
+}
+
+// -----------------------------------------------------------------------------
+// Fake sensor, slow sine wave with some noise and occasional spikes.
+// Values are multiples of 1/16, so float and double filters store them exactly
+// -----------------------------------------------------------------------------
+
+class SimulatedSensor {
+    public:
+
+    explicit SimulatedSensor(uint32_t seed) :
+        _seed(seed)
+    {}
+
+    double value() {
+        ++_step;
+        double value = 20.0 + 5.0 * std::sin(_step / 1000.0) + (_random() - 0.5);
+        if (_random() < 0.001) {
+            value += 100.0;
+        }
+        return std::round(value * 16.0) / 16.0;
+    }
+
+    private:
+
+    double _random() {
+        _seed = (_seed * 1664525ul) + 1013904223ul;
+        return static_cast<double>(_seed >> 8) / 16777216.0;
+    }
+
+    uint32_t _seed;
+    unsigned long _step { 0 };
+};
+
+// -----------------------------------------------------------------------------
+// Same steps as the _sensorReadMagnitude(), without the units and the broker
+// -----------------------------------------------------------------------------
+
+using filter_t = SensorFilter<SENSOR_FILTER_CAPACITY>;
+
+struct magnitude_t {
+    magnitude_t(FilterType type, unsigned char every) :
+        filter(type),
+        every(every)
+    {
+        filter.resize(every);
+    }
+
+    filter_t filter;
+    unsigned char every;
+    unsigned char count { 0 };
+
+    double reported { 0.0 };
+    double min_change { 0.0 };
+    double max_change { 0.0 };
+};
+
+static bool magnitude_read(magnitude_t& magnitude, double value, double& result) {
+    magnitude.count = sensor::report::next(magnitude.count, magnitude.every);
+    magnitude.filter.add(value);
+
+    if (!sensor::report::due(magnitude.count, value, magnitude.reported, magnitude.max_change)) {
+        return false;
+    }
+
+    result = magnitude.filter.result();
+    sensor::report::restart(magnitude.filter, magnitude.every);
+
+    if (!sensor::report::changed(result, magnitude.reported, magnitude.min_change)) {
+        return false;
+    }
+
+    magnitude.reported = result;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Filters, compared with the naive implementation
+// -----------------------------------------------------------------------------
+
+static double reference_median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    if (values.size() & 1) {
+        return values[middle];
+    }
+    return (values[middle - 1] + values[middle]) / 2.0;
+}
+
+void test_filter_windows() {
+    const unsigned char sizes[] = {1, 2, 5, 10, SENSOR_FILTER_CAPACITY};
+    for (auto size : sizes) {
+        filter_t average(FilterType::MovingAverage);
+        filter_t median(FilterType::Median);
+        average.resize(size);
+        median.resize(size);
+
+        SimulatedSensor sensor(size);
+        std::vector<double> values;
+        for (size_t n = 0; n < 1000; ++n) {
+            const double value = sensor.value();
+            values.push_back(value);
+            average.add(value);
+            median.add(value);
+
+            const size_t count = std::min<size_t>(values.size(), size);
+            const std::vector<double> window(values.end() - count, values.end());
+
+            double sum = 0.0;
+            for (auto value : window) {
+                sum += value;
+            }
+
+            TEST_ASSERT_FLOAT_WITHIN(0.001, sum, average.result());
+            TEST_ASSERT_FLOAT_WITHIN(0.001, reference_median(window), median.result());
+        }
+    }
+}
+
+// Report window can be larger than the filter storage
+void test_filter_report_window() {
+    const unsigned char sizes[] = {SENSOR_FILTER_CAPACITY + 1, 2 * SENSOR_FILTER_CAPACITY + 3, SENSOR_REPORT_MAX_EVERY};
+    for (auto size : sizes) {
+        magnitude_t average(FilterType::MovingAverage, size);
+        magnitude_t median(FilterType::Median, size);
+
+        SimulatedSensor sensor(size);
+        std::vector<double> values;
+        size_t reports = 0;
+        for (size_t n = 0; n < 1000; ++n) {
+            const double value = sensor.value();
+            values.push_back(value);
+
+            double sum_result = 0.0;
+            double median_result = 0.0;
+            const bool sum_reported = magnitude_read(average, value, sum_result);
+            const bool median_reported = magnitude_read(median, value, median_result);
+            TEST_ASSERT_EQUAL(sum_reported, median_reported);
+            if (!sum_reported) continue;
+
+            ++reports;
+
+            // Sum is exact at the report, median only looks at the values that fit into the storage
+            const size_t count = std::min<size_t>(values.size(), size);
+            double sum = 0.0;
+            for (auto it = values.end() - count; it != values.end(); ++it) {
+                sum += *it;
+            }
+            TEST_ASSERT_FLOAT_WITHIN(0.01, sum, sum_result);
+
+            const std::vector<double> window(values.end() - std::min<size_t>(count, SENSOR_FILTER_CAPACITY), values.end());
+            TEST_ASSERT_FLOAT_WITHIN(0.001, reference_median(window), median_result);
+        }
+
+        TEST_ASSERT_EQUAL(1000 / size, reports);
+    }
+}
+
+void test_filter_accumulators() {
+    filter_t last(FilterType::Last);
+    filter_t sum(FilterType::Sum);
+    filter_t max(FilterType::Max);
+
+    SimulatedSensor sensor(1);
+    for (size_t round = 0; round < 10; ++round) {
+        double expected_sum = 0.0;
+        double expected_max = 0.0;
+        double value = 0.0;
+        for (size_t n = 0; n < 100; ++n) {
+            value = sensor.value();
+            expected_sum += value;
+            expected_max = std::max(expected_max, value);
+            last.add(value);
+            sum.add(value);
+            max.add(value);
+        }
+
+        TEST_ASSERT_FLOAT_WITHIN(0.001, value, last.result());
+        TEST_ASSERT_FLOAT_WITHIN(0.001, expected_sum, sum.result());
+        TEST_ASSERT_FLOAT_WITHIN(0.001, expected_max, max.result());
+
+        last.reset();
+        sum.reset();
+        max.reset();
+    }
+}
+
+void test_filter_ewma() {
+    filter_t filter(FilterType::Ewma);
+
+    SimulatedSensor sensor(3);
+    double expected = 0.0;
+    for (size_t n = 0; n < 1000; ++n) {
+        const double value = sensor.value();
+        expected = n ? (expected + SENSOR_FILTER_EWMA_ALPHA * (value - expected)) : value;
+        filter.add(value);
+        TEST_ASSERT_FLOAT_WITHIN(0.01, expected, filter.result());
+
+        // State is kept between the reports
+        if ((n % 10) == 0) {
+            sensor::report::restart(filter, 10);
+        }
+    }
+}
+
+// Result is the average of the values since the last reset(), reset before every value to see what was accepted
+void test_filter_hampel() {
+    filter_t filter(FilterType::Hampel);
+
+    const double baseline[] = {20.0, 20.1, 19.9};
+    for (size_t n = 0; n < SENSOR_FILTER_HAMPEL_WINDOW; ++n) {
+        filter.add(baseline[n % 3]);
+    }
+
+    // Single spike is replaced with the median of the window
+    filter.reset();
+    filter.add(100.0);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 20.0, filter.result());
+
+    for (size_t n = 0; n < SENSOR_FILTER_HAMPEL_WINDOW; ++n) {
+        filter.add(baseline[n % 3]);
+    }
+
+    // Step change is rejected until it takes over the half of the window
+    for (size_t n = 0; n < SENSOR_FILTER_HAMPEL_WINDOW; ++n) {
+        filter.reset();
+        filter.add(30.0);
+        if (n <= (SENSOR_FILTER_HAMPEL_WINDOW / 2)) {
+            TEST_ASSERT_FLOAT_WITHIN(0.2, 20.0, filter.result());
+        } else {
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 30.0, filter.result());
+        }
+    }
+}
+
+void test_filter_kalman() {
+    filter_t filter(FilterType::Kalman);
+
+    // Constant value with the uniform noise of +-1
+    uint32_t seed = 7;
+    auto noise = [&]() {
+        seed = (seed * 1664525ul) + 1013904223ul;
+        return 2.0 * (static_cast<double>(seed >> 8) / 16777216.0) - 1.0;
+    };
+
+    filter.add(25.0 + noise());
+    const double first = std::fabs(filter.result() - 25.0);
+
+    for (size_t n = 0; n < 500; ++n) {
+        filter.add(25.0 + noise());
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(0.3, 25.0, filter.result());
+    TEST_ASSERT(std::fabs(filter.result() - 25.0) <= first);
+
+    // Exact value stays exact
+    filter_t exact(FilterType::Kalman);
+    for (size_t n = 0; n < 100; ++n) {
+        exact.add(25.0);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 25.0, exact.result());
+}
+
+void test_filter_type_change() {
+    filter_t filter(FilterType::Median);
+    filter.resize(5);
+    for (size_t n = 0; n < 5; ++n) {
+        filter.add(n);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 2.0, filter.result());
+
+    filter.setType(FilterType::Sum);
+    TEST_ASSERT(FilterType::Sum == filter.type());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, filter.result());
+
+    filter.add(3.0);
+    filter.add(4.0);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 7.0, filter.result());
+}
+
+// -----------------------------------------------------------------------------
+// Report logic
+// -----------------------------------------------------------------------------
+
+void test_report_every() {
+    magnitude_t magnitude(FilterType::Sum, 5);
+
+    double result = 0.0;
+    for (size_t n = 1; n <= 20; ++n) {
+        const bool reported = magnitude_read(magnitude, 1.0, result);
+        TEST_ASSERT_EQUAL((n % 5) == 0, reported);
+        if (reported) {
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 5.0, result);
+        }
+    }
+}
+
+void test_report_max_change() {
+    magnitude_t magnitude(FilterType::Last, 10);
+    magnitude.max_change = 2.0;
+
+    double result = 0.0;
+    TEST_ASSERT(magnitude_read(magnitude, 10.0, result));
+    TEST_ASSERT_FALSE(magnitude_read(magnitude, 11.0, result));
+    TEST_ASSERT_FALSE(magnitude_read(magnitude, 9.0, result));
+    TEST_ASSERT(magnitude_read(magnitude, 12.5, result));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 12.5, result);
+
+    // Counter no longer matters
+    for (size_t n = 0; n < 20; ++n) {
+        TEST_ASSERT_FALSE(magnitude_read(magnitude, 12.5, result));
+    }
+}
+
+void test_report_min_change() {
+    magnitude_t magnitude(FilterType::Last, 1);
+    magnitude.min_change = 1.0;
+
+    double result = 0.0;
+    TEST_ASSERT(magnitude_read(magnitude, 5.0, result));
+    TEST_ASSERT_FALSE(magnitude_read(magnitude, 5.5, result));
+    TEST_ASSERT_FALSE(magnitude_read(magnitude, 4.25, result));
+    TEST_ASSERT(magnitude_read(magnitude, 6.0, result));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 6.0, magnitude.reported);
+}
+
+// -----------------------------------------------------------------------------
+// History
+// -----------------------------------------------------------------------------
+
+void test_history_values() {
+    sensor::History history(16);
+    TEST_ASSERT_EQUAL(0, history.count());
+
+    const int32_t values[] = {100, 101, 99, 100000, -100000, 5, 6};
+    for (auto value : values) {
+        TEST_ASSERT(history.push(value));
+    }
+
+    // Values that do not fit into the int16_t delta take 3 words
+    TEST_ASSERT_EQUAL(7, history.count());
+    TEST_ASSERT_EQUAL(13, history.used());
+
+    std::vector<int32_t> result;
+    history.forEach([&](int32_t value) {
+        result.push_back(value);
+    });
+
+    TEST_ASSERT_EQUAL(7, result.size());
+    TEST_ASSERT_EQUAL_INT32_ARRAY(values, result.data(), 7);
+}
+
+void test_history_overwrite() {
+    sensor::History history(8);
+
+    for (int32_t value = 0; value < 100; ++value) {
+        history.push(value * 1000);
+    }
+
+    std::vector<int32_t> result;
+    history.forEach([&](int32_t value) {
+        result.push_back(value);
+    });
+
+    TEST_ASSERT_EQUAL(8, result.size());
+    for (size_t n = 0; n < result.size(); ++n) {
+        TEST_ASSERT_EQUAL(static_cast<int32_t>((92 + n) * 1000), result[n]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark, push samples through every filter type
+// -----------------------------------------------------------------------------
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t cycles() {
+    return __builtin_ia32_rdtsc();
+}
+#else
+static uint64_t cycles() {
+    return 0;
+}
+#endif
+
+void test_pipeline_benchmark() {
+    constexpr size_t Samples = 1000000;
+
+    struct type_t {
+        FilterType type;
+        const char* name;
+    };
+
+    const type_t types[] = {
+        {FilterType::Last, "last"},
+        {FilterType::Sum, "sum"},
+        {FilterType::Max, "max"},
+        {FilterType::MovingAverage, "average"},
+        {FilterType::Median, "median"},
+        {FilterType::Ewma, "ewma"},
+        {FilterType::Hampel, "hampel"},
+        {FilterType::Kalman, "kalman"}
+    };
+
+    std::vector<double> samples;
+    samples.reserve(Samples);
+
+    SimulatedSensor sensor(42);
+    for (size_t n = 0; n < Samples; ++n) {
+        samples.push_back(sensor.value());
+    }
+
+    for (const auto& type : types) {
+        magnitude_t magnitude(type.type, SENSOR_FILTER_CAPACITY);
+        magnitude.min_change = 0.5;
+
+        size_t reports = 0;
+        double result = 0.0;
+
+        const auto allocated = allocations;
+        const auto start = std::chrono::steady_clock::now();
+        const auto start_cycles = cycles();
+
+        for (auto sample : samples) {
+            reports += magnitude_read(magnitude, sample, result) ? 1 : 0;
+        }
+
+        const auto end_cycles = cycles();
+        const auto end = std::chrono::steady_clock::now();
+
+        TEST_ASSERT_EQUAL(allocated, allocations);
+        TEST_ASSERT(reports > 0);
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        printf("[SENSOR] %8s: %6.1f ns/sample, %6.1f cycles/sample, %u reports\n",
+            type.name,
+            static_cast<double>(elapsed) / Samples,
+            static_cast<double>(end_cycles - start_cycles) / Samples,
+            static_cast<unsigned>(reports));
+    }
+}
+
+// When adding test functions, don't forget to add RUN_TEST(...) in the main()
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_filter_windows);
+    RUN_TEST(test_filter_report_window);
+    RUN_TEST(test_filter_accumulators);
+    RUN_TEST(test_filter_ewma);
+    RUN_TEST(test_filter_hampel);
+    RUN_TEST(test_filter_kalman);
+    RUN_TEST(test_filter_type_change);
+    RUN_TEST(test_report_every);
+    RUN_TEST(test_report_max_change);
+    RUN_TEST(test_report_min_change);
+    RUN_TEST(test_history_values);
+    RUN_TEST(test_history_overwrite);
+    RUN_TEST(test_pipeline_benchmark);
+    UNITY_END();
+}
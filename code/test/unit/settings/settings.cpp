@@ -0,0 +1,247 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "settings_index.h"
+
+// -----------------------------------------------------------------------------
+// Fake Embedis storage, same layout as the one used on the device
+// -----------------------------------------------------------------------------
+
+// Not limited by the SPI_FLASH_SEC_SIZE, so we could benchmark large number of keys
+constexpr size_t StorageSize = 32768;
+
+static uint8_t storage[StorageSize];
+static size_t storage_pos = StorageSize - 1;
+
+static uint8_t storage_read(size_t pos) {
+    return storage[pos];
+}
+
+static void storage_reset() {
+    memset(storage, 0xFF, sizeof(storage));
+    storage_pos = StorageSize - 1;
+}
+
+static void storage_write_string(const std::string& value) {
+    storage[storage_pos] = value.length();
+    storage[storage_pos - 1] = 0;
+    storage_pos -= value.length() + 2;
+    memcpy(&storage[storage_pos + 1], value.data(), value.length());
+}
+
+static void storage_write(const std::string& key, const std::string& value) {
+    storage_write_string(key);
+    storage_write_string(value);
+}
+
+static std::string key_name(size_t index) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "key%u", static_cast<unsigned>(index));
+    return buffer;
+}
+
+static std::string key_value(size_t index) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "value%u", static_cast<unsigned>(index * 7));
+    return buffer;
+}
+
+static void storage_fill(size_t keys) {
+    storage_reset();
+    for (size_t index = 0; index < keys; ++index) {
+        storage_write(key_name(index), key_value(index));
+    }
+}
+
+// Equivalent of the Embedis::get(), walking the whole storage
+static bool linear_find(const std::string& key, std::string& value) {
+    size_t pos = StorageSize - 1;
+    while (size_t len = storage_read(pos)) {
+        if (0xFF == len) break;
+        pos = pos - len - 2;
+        bool match = (len == key.length());
+        for (size_t i = 0; match && (i < len); ++i) {
+            match = (storage_read(pos + i + 1) == static_cast<uint8_t>(key[i]));
+        }
+        len = storage_read(pos);
+        pos = pos - len - 2;
+        if (match) {
+            value.assign(reinterpret_cast<const char*>(&storage[pos + 1]), len);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool index_find(settings::embedis::Index& index, const std::string& key, std::string& value) {
+    const auto* entry = index.find(key.c_str(), key.length());
+    if (!entry) {
+        return false;
+    }
+
+    value.assign(
+        reinterpret_cast<const char*>(&storage[index.valuePosition(*entry)]),
+        index.valueLength(*entry)
+    );
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Tests
+// -----------------------------------------------------------------------------
+
+void test_index_empty() {
+    storage_reset();
+
+    settings::embedis::Index index(storage_read, StorageSize);
+    TEST_ASSERT_EQUAL(0, index.count());
+    TEST_ASSERT_EQUAL(StorageSize - 1, index.end());
+    TEST_ASSERT_NULL(index.find("key", 3));
+}
+
+void test_index_find() {
+    storage_reset();
+    storage_write("hostname", "espurna");
+    storage_write("empty", "");
+    storage_write("relayBoot0", "1");
+
+    settings::embedis::Index index(storage_read, StorageSize);
+    TEST_ASSERT_EQUAL(3, index.count());
+
+    std::string value;
+    TEST_ASSERT(index_find(index, "hostname", value));
+    TEST_ASSERT_EQUAL_STRING("espurna", value.c_str());
+
+    TEST_ASSERT(index_find(index, "empty", value));
+    TEST_ASSERT_EQUAL_STRING("", value.c_str());
+
+    TEST_ASSERT(index_find(index, "relayBoot0", value));
+    TEST_ASSERT_EQUAL_STRING("1", value.c_str());
+
+    TEST_ASSERT_FALSE(index_find(index, "relayBoot", value));
+    TEST_ASSERT_FALSE(index_find(index, "relayBoot1", value));
+    TEST_ASSERT_FALSE(index_find(index, "Hostname", value));
+}
+
+void test_index_order() {
+    storage_fill(50);
+
+    settings::embedis::Index index(storage_read, StorageSize);
+    TEST_ASSERT_EQUAL(50, index.count());
+
+    for (size_t n = 0; n < index.count(); ++n) {
+        const auto* entry = index.at(n);
+        TEST_ASSERT_NOT_NULL(entry);
+        const std::string key(reinterpret_cast<const char*>(&storage[entry->key]), entry->length);
+        TEST_ASSERT_EQUAL_STRING(key_name(n).c_str(), key.c_str());
+    }
+
+    TEST_ASSERT_NULL(index.at(50));
+}
+
+void test_index_invalidate() {
+    storage_fill(10);
+
+    settings::embedis::Index index(storage_read, StorageSize);
+    TEST_ASSERT_EQUAL(10, index.count());
+
+    const auto end = index.end();
+    storage_write("extra", "value");
+
+    // Index is not aware of the write until we tell it
+    TEST_ASSERT_NULL(index.find("extra", 5));
+
+    index.invalidate();
+    TEST_ASSERT_FALSE(index.valid());
+    TEST_ASSERT_EQUAL(11, index.count());
+    TEST_ASSERT(index.valid());
+    TEST_ASSERT_EQUAL(end - (5 + 2) - (5 + 2), index.end());
+
+    std::string value;
+    TEST_ASSERT(index_find(index, "extra", value));
+    TEST_ASSERT_EQUAL_STRING("value", value.c_str());
+}
+
+void test_index_matches_linear() {
+    storage_fill(200);
+
+    settings::embedis::Index index(storage_read, StorageSize);
+
+    std::string expected;
+    std::string value;
+    for (size_t n = 0; n < 250; ++n) {
+        const auto key = key_name(n);
+        const bool found = linear_find(key, expected);
+        TEST_ASSERT_EQUAL(found, index_find(index, key, value));
+        if (found) {
+            TEST_ASSERT_EQUAL_STRING(expected.c_str(), value.c_str());
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark, lookup every key once per round
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static double benchmark_ns(size_t keys, size_t rounds, T&& lookup) {
+    std::vector<std::string> names;
+    for (size_t n = 0; n < keys; ++n) {
+        names.push_back(key_name(n));
+    }
+
+    std::string value;
+    size_t found = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (const auto& name : names) {
+            found += lookup(name, value) ? 1 : 0;
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_EQUAL(keys * rounds, found);
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return static_cast<double>(elapsed) / static_cast<double>(keys * rounds);
+}
+
+void test_index_benchmark() {
+    const size_t sizes[] = {50, 200, 500};
+    for (auto keys : sizes) {
+        storage_fill(keys);
+
+        settings::embedis::Index index(storage_read, StorageSize);
+        index.build();
+
+        const auto linear = benchmark_ns(keys, 100, [](const std::string& key, std::string& value) {
+            return linear_find(key, value);
+        });
+        const auto indexed = benchmark_ns(keys, 100, [&](const std::string& key, std::string& value) {
+            return index_find(index, key, value);
+        });
+
+        printf("[SETTINGS] %3u keys: linear %10.1f ns/lookup, index %8.1f ns/lookup\n",
+            static_cast<unsigned>(keys), linear, indexed);
+    }
+}
+
+// When adding test functions, don't forget to add RUN_TEST(...) in the main()
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_index_empty);
+    RUN_TEST(test_index_find);
+    RUN_TEST(test_index_order);
+    RUN_TEST(test_index_invalidate);
+    RUN_TEST(test_index_matches_linear);
+    RUN_TEST(test_index_benchmark);
+    UNITY_END();
+}